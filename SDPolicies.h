@@ -7,6 +7,7 @@
 
 #include <type_traits>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <chrono>
 
@@ -17,21 +18,65 @@ extern "C" {
 extern SPIDriver spiTester;
 extern std::string SpiDriverPort;
 
+/**
+ * Shim for the SPIDriver USB adapter. Every exchange with the adapter costs a USB round-trip, so everything between
+ * select() and deSelect() is batched: writes are queued, and a read sends the queue together with the read and
+ * brings all responses back at once. queueRead() lets the driver fetch a block and its CRC in one round-trip, and
+ * pollRead() lets it poll for a response, token or the end of busy a whole chunk of bytes per round-trip.
+ * The adapter keeps a CCITT CRC of its traffic: with sd::PeripheralCRC, linkCheck() compares it with the host's
+ * copy once per operation, and the host only keeps that copy while something checks it.
+ */
 struct SPIShim {
-    bool active() { return spiTester.connected > 0; }
+    /// the adapter in spiTester on SpiDriverPort
+    SPIShim() = default;
+    /// another adapter, for a card in a slot of its own. Both must outlive the shim
+    SPIShim(SPIDriver& spi, const std::string& port) : m_spi(&spi), m_port(&port) {}
+
+    bool active() { return m_spi->connected > 0; }
     bool begin() {
         if(!active()) {
-            spi_connect(&spiTester, SpiDriverPort.c_str());
+            spi_connect(m_spi, m_port->c_str());
+            // every card operation waits on the adapter's replies, so have the tty hand them over right away
+            if(active()) { spi_lowlatency(m_spi, 1); }
         }
         return active();
     }
 
-    void select() { spi_sel(&spiTester); }
-    void deSelect() { spi_unsel(&spiTester); }
-    ssize_t write(const uint8_t* buf, const size_t LEN) { spi_write(&spiTester, (const char*)buf, LEN); return LEN; }
+    void select() {
+        spi_batch_begin(m_spi);
+        spi_sel(m_spi);
+    }
+    void deSelect() {
+        spi_unsel(m_spi);
+        spi_batch_end(m_spi);
+    }
+    ssize_t write(const uint8_t* buf, const size_t LEN) { spi_write(m_spi, (const char*)buf, LEN); return LEN; }
     uint8_t write(uint8_t val) { return read(val); }
-    ssize_t read(uint8_t* buf, const size_t LEN) { spi_read(&spiTester, (char*)buf, LEN); return LEN; }
-    uint8_t read(uint8_t val = 0xFF) { spi_writeread(&spiTester, (char*)(&val), 1); return val; }
+    ssize_t read(uint8_t* buf, const size_t LEN) {
+        queueRead(buf, LEN);
+        spi_flush(m_spi);
+        return LEN;
+    }
+    uint8_t read(uint8_t val = 0xFF) {
+        spi_writeread(m_spi, (char*)(&val), 1);
+        spi_flush(m_spi);
+        return val;
+    }
+    /// queue a read, buf is filled by the next read() or deSelect()
+    void queueRead(uint8_t* buf, const size_t LEN) { spi_read(m_spi, (char*)buf, LEN); }
+    /// one status query: TRUE if the adapter saw the same bytes the host sent and received since the last check
+    bool linkCheck() { return spi_crc_check(m_spi) != 0; }
+    void linkCheckEnable(const bool enable) { spi_host_crc(m_spi, enable ? 1 : 0); }
+    /// clock LEN 0xFF bytes and return what the card sent, in one round-trip
+    void pollRead(uint8_t* buf, const size_t LEN) {
+        std::memset(buf, 0xFF, LEN);
+        spi_writeread(m_spi, (char*)buf, LEN);
+        spi_flush(m_spi);
+    }
+
+private:
+    SPIDriver*         m_spi  = &spiTester;
+    const std::string* m_port = &SpiDriverPort;
 };
 
 #endif //SDCARD_SDPOLICIES_H
@@ -0,0 +1,1496 @@
+// Throughput and latency benchmark for sd::SpiCard running against the simulated card. Each run is printed as a
+// table and written as JSON for regression tracking:
+//
+// - CRC: each policy's CRC16 over a single 512 byte block, checked against ShiftedCRC.
+// - Sweep: readBlocks/writeBlocks over block counts 1..1024, sequential and random LBAs and every CRC policy
+//   (CRCChecked with the card checking CRCs as well).
+// - Async: the asynchronous API against SimAsyncShim, with how much of each transfer the driver kept the CPU busy.
+// - Cache: a FatFs-like metadata workload with and without BlockCache.
+// - Streaming: cluster sized sequential reads with plain readBlocks calls and over StreamingCard's CMD18 stream, and a
+//   logger appending one block per call with plain writeBlocks calls and in StreamingCard's CMD25 write session.
+// - Polling: shim calls per block with byte-at-a-time polling and with bulk polling (SimPollShim).
+// - Clock: sequential throughput at a fixed clock, at the card's TRAN_SPEED and in High-Speed (SimClockShim).
+// - Busy: busy polling during writes and erases with defaultTimeouts and with AdaptiveTimeouts sleeping in simulated
+//   time.
+// - Peripheral CRC: host CRC16, a CRC unit (SimCRCShim) and the SPIDriver's link CRC (SimLinkShim), by bytes hashed on
+//   the host, status queries per call and corrupted transfers caught.
+// - Striping: StripedCard over 1, 2 and 4 cards, by the MB/s of the busiest bus, with unaligned reads, an erase that
+//   ends inside a stripe and requests past the end.
+// - Shared bus: two cards on one SimBus driven from two threads, polling and yielding, with and without a
+//   high-priority sensor at another clock and SPI mode.
+// - Disk registry: a cached card, a RAM disk and an image file checked drive by drive, and the dispatch cost against a
+//   direct call.
+// - Stats: the cost of SDStats and SDTrace against noStats, and the SDStats snapshot.
+//
+// usage: SDCardBench [--json FILE] [--blocks N] [--clock HZ] [--trace FILE]
+//   --json FILE   where to write the JSON results (default SDCardBench.json, "-" for stdout)
+//   --trace FILE  also record a short workload with SDTrace and write it for SDTraceDecode
+//   --blocks N    blocks moved per configuration (default 2048)
+//   --clock HZ    simulated SPI clock of the shims without clock control (default 25000000)
+
+#define SPISD_DEBUG(...)  do { } while(0)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "SDCard.hpp"
+#include "SDAdaptiveTimeouts.h"
+#include "SDFastCRC.h"
+#include "SDBlockCache.h"
+#include "SDStreaming.h"
+#include "SDStriped.h"
+#include "SDSharedBus.h"
+#include "SDBlockDevices.h"
+#include "SDDiskIO.h"
+#include "SDStats.h"
+#include "SDTrace.h"
+#include "SDSimShim.h"
+
+namespace {
+
+struct BenchConfig {
+    const char* jsonPath    = "SDCardBench.json";
+    uint32_t    blocksPerRun = 2048;
+    uint32_t    clockHz     = 25000000;
+    const char* tracePath   = nullptr;
+};
+
+struct Result {
+    std::string policy;
+    const char* op;
+    const char* pattern;
+    uint32_t    blocks;
+    uint32_t    calls;
+    uint32_t    errors;
+    double      mbPerSec;       //< payload over host wall time
+    double      busMbPerSec;    //< payload over simulated bus time
+    double      p50us;
+    double      p99us;
+    double      busP50us;
+    double      busP99us;
+    double      spiBytesPerByte;
+    double      busUtilization;
+};
+
+struct CRCResult {
+    std::string policy;
+    bool        matches;        //< agrees with ShiftedCRC on random data of every length up to 1KB, CRC7 up to 16 bytes
+    double      nsPerBlock;
+    double      mbPerSec;
+};
+
+struct AsyncResult {
+    std::string policy;
+    const char* op;
+    uint32_t    blocks;
+    uint32_t    errors;
+    double      mbPerSec;       //< payload over host wall time
+    double      driverCpu;      //< fraction of wall time spent inside pollAsync()
+};
+
+struct CacheResult {
+    const char* config;
+    uint32_t    ops;
+    uint32_t    errors;
+    double      busMs;          //< simulated bus time for the whole workload
+    uint64_t    commands;       //< commands sent to the card
+    double      hitRate;
+};
+
+struct StreamResult {
+    const char* op;
+    const char* config;
+    uint32_t    blocksPerCall;
+    uint32_t    errors;
+    double      busMbPerSec;
+    uint64_t    commands;
+};
+
+struct PollResult {
+    const char* shim;
+    const char* op;
+    uint32_t    blocksPerCall;
+    uint32_t    errors;
+    double      shimCallsPerBlock;  //< stands for the per-call overhead of a USB dongle or a driver ioctl
+    double      busMbPerSec;
+    double      spiBytesPerByte;
+};
+
+struct ClockResult {
+    const char* config;
+    const char* op;
+    uint32_t    clockHz;        //< clock the bus ran at after begin()
+    uint32_t    errors;
+    double      initMs;         //< simulated bus time of begin()
+    double      busMbPerSec;
+};
+
+struct BusyResult {
+    const char* policy;
+    const char* op;
+    uint32_t    blocksPerCall;
+    uint32_t    errors;
+    double      busyPollsPerWait;   //< bytes clocked while the card was busy, per busy period
+    double      busMbPerSec;        //< payload over simulated time, the latency the pacing must not cost
+};
+
+struct PeripheralResult {
+    const char* config;
+    const char* op;
+    uint32_t    errors;             //< failed or wrong transfers without injected errors
+    uint32_t    injected;           //< bytes corrupted on the link
+    uint32_t    detected;           //< transfers that failed with errors injected
+    uint32_t    undetected;         //< transfers that reported success with wrong data
+    double      hostCrcBytesPerBlock;   //< bytes the CRC policy hashed on the host
+    double      queriesPerCall;     //< link CRC status queries
+};
+
+struct StripeResult {
+    const char* config;
+    const char* op;
+    uint32_t    cards;
+    uint32_t    errors;
+    double      mbPerSec;       //< payload over host wall time
+    double      busMbPerSec;    //< payload over the time the busiest bus was in use
+    double      scaling;        //< bus MB/s against one card
+};
+
+struct SharedBusResult {
+    const char* config;
+    const char* op;
+    uint32_t    cards;
+    uint32_t    errors;             //< bad data, cards clocked too fast or selected in the wrong SPI mode
+    double      busMbPerSec;        //< payload of all cards over the bus time
+    uint32_t    transactions;
+    uint32_t    contended;
+    uint32_t    clockChanges;
+    uint32_t    modeChanges;
+    uint32_t    yields;
+    double      sensorMaxWaitUs;    //< longest wall time the sensor waited for the bus, 0 without a sensor
+};
+
+struct DiskIOResult {
+    const char* config;
+    uint32_t    errors;
+    double      nsPerCall;      //< single block read through the table, 0 where only correctness is checked
+};
+
+struct StatsResult {
+    double                 noStatsMbPerSec;
+    double                 statsMbPerSec;
+    double                 traceMbPerSec;
+    uint32_t               errors;
+    sd::CardStatistics     snapshot;
+};
+
+constexpr uint32_t IMAGE_BLOCKS = 65536;
+constexpr uint32_t MAX_COUNT    = 1024;
+
+double percentile(std::vector<double>& v, const double p) {
+    if(v.empty()) { return 0; }
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(p * v.size() + 0.5);
+    idx = idx > 0 ? idx - 1 : 0;
+    return v[std::min(idx, v.size() - 1)];
+}
+
+template<class CRCPolicy>
+void runPolicy(const char* name, const BenchConfig& cfg, std::vector<Result>& results) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    sd::SpiCard<sd::sim::SimShim, CRCPolicy, sd::defaultTimeouts> card(model);
+
+    if(!card.begin()) {
+        fprintf(stderr, "%s: card init failed\n", name);
+        return;
+    }
+
+    std::vector<uint8_t> buf(size_t(MAX_COUNT) * 512);
+    std::mt19937 rng(0x5D5D);
+    for(auto& b : buf) { b = static_cast<uint8_t>(rng()); }
+
+    for(const bool write : { false, true }) {
+        for(const bool random : { false, true }) {
+            for(uint32_t count = 1; count <= MAX_COUNT; count <<= 1) {
+                const uint32_t calls = std::max<uint32_t>(4, cfg.blocksPerRun / count);
+                std::uniform_int_distribution<uint32_t> lbaDist(0, IMAGE_BLOCKS - count);
+                std::vector<double> wall, bus;
+                wall.reserve(calls);
+                bus.reserve(calls);
+
+                uint32_t errors = 0;
+                uint32_t lba = 0;
+                model.resetStats();
+                for(uint32_t i = 0; i < calls; ++i) {
+                    if(random) { lba = lbaDist(rng); }
+                    else if(lba + count > IMAGE_BLOCKS) { lba = 0; }
+
+                    const uint64_t bus0 = model.nowPs();
+                    const auto t0 = std::chrono::steady_clock::now();
+                    const ssize_t n = write ? card.writeBlocks(lba, buf.data(), count)
+                                            : card.readBlocks(lba, buf.data(), count);
+                    const auto t1 = std::chrono::steady_clock::now();
+                    wall.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+                    bus.push_back((model.nowPs() - bus0) * 1e-6);
+
+                    if(n != static_cast<ssize_t>(count)) { errors++; }
+                    if(!random) { lba += count; }
+                }
+
+                const auto report  = model.report();
+                const double bytes = double(calls) * count * 512;
+                Result r;
+                r.policy          = name;
+                r.op              = write ? "write" : "read";
+                r.pattern         = random ? "random" : "sequential";
+                r.blocks          = count;
+                r.calls           = calls;
+                r.errors          = errors;
+                r.mbPerSec        = bytes / report.wallSeconds / 1e6;
+                r.busMbPerSec     = bytes / report.busSeconds / 1e6;
+                r.p50us           = percentile(wall, 0.50);
+                r.p99us           = percentile(wall, 0.99);
+                r.busP50us        = percentile(bus, 0.50);
+                r.busP99us        = percentile(bus, 0.99);
+                r.spiBytesPerByte = model.stats().bytesClocked / bytes;
+                r.busUtilization  = report.busUtilization();
+                results.push_back(r);
+
+                printf("%-14s %-5s %-10s %5u  %9.2f %9.2f  %9.2f %9.2f  %9.2f %9.2f  %6.3f %6.3f%s\n",
+                       name, r.op, r.pattern, count, r.mbPerSec, r.busMbPerSec, r.p50us, r.p99us,
+                       r.busP50us, r.busP99us, r.spiBytesPerByte, r.busUtilization, errors ? "  ERRORS" : "");
+            }
+        }
+    }
+}
+
+template<class CRCPolicy>
+void runAsync(const char* name, const BenchConfig& cfg, std::vector<AsyncResult>& results) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    sd::SpiCard<sd::sim::SimAsyncShim, CRCPolicy, sd::defaultTimeouts> card(model);
+
+    if(!card.begin()) {
+        fprintf(stderr, "%s: card init failed\n", name);
+        return;
+    }
+
+    std::vector<uint8_t> buf(size_t(MAX_COUNT) * 512);
+    std::mt19937 rng(0xA5A5);
+    for(auto& b : buf) { b = static_cast<uint8_t>(rng()); }
+
+    for(const bool write : { false, true }) {
+        for(const uint32_t count : { 1u, 8u, 64u }) {
+            const uint32_t calls = std::max<uint32_t>(4, cfg.blocksPerRun / count);
+            uint32_t errors = 0;
+            uint32_t lba = 0;
+            std::chrono::steady_clock::duration inDriver{};
+
+            const auto t0 = std::chrono::steady_clock::now();
+            for(uint32_t i = 0; i < calls; ++i) {
+                if(lba + count > IMAGE_BLOCKS) { lba = 0; }
+
+                auto p0 = std::chrono::steady_clock::now();
+                auto future = write ? card.writeBlocksAsync(lba, buf.data(), count)
+                                    : card.readBlocksAsync(lba, buf.data(), count);
+                for(;;) {
+                    const bool done = future.ready();
+                    const auto p1 = std::chrono::steady_clock::now();
+                    inDriver += p1 - p0;
+                    if(done) { break; }
+                    // the caller is free here, a real application would do useful work
+                    std::this_thread::yield();
+                    p0 = std::chrono::steady_clock::now();
+                }
+
+                if(future.get() != static_cast<ssize_t>(count)) { errors++; }
+                lba += count;
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+
+            const double wall = std::chrono::duration<double>(t1 - t0).count();
+            AsyncResult r;
+            r.policy    = name;
+            r.op        = write ? "write" : "read";
+            r.blocks    = count;
+            r.errors    = errors;
+            r.mbPerSec  = double(calls) * count * 512 / wall / 1e6;
+            r.driverCpu = std::chrono::duration<double>(inDriver).count() / wall;
+            results.push_back(r);
+
+            printf("%-14s %-5s %5u  %9.2f  %6.3f%s\n", name, r.op, count, r.mbPerSec, r.driverCpu,
+                   errors ? "  ERRORS" : "");
+        }
+    }
+}
+
+/**
+ * Metadata heavy workload shaped like FatFs appending to many small files: each operation reads a directory
+ * sector and a FAT sector, updates both and writes one data sector. f_sync is modelled by flushing every
+ * 16 operations.
+ */
+template<class Device, class Flush>
+uint32_t metadataWorkload(Device& dev, const uint32_t ops, Flush flush) {
+    constexpr uint32_t FAT_LBA  = 2048;
+    constexpr uint32_t FAT_SIZE = 32;
+    constexpr uint32_t DIR_LBA  = FAT_LBA + 2 * FAT_SIZE;
+    constexpr uint32_t DIR_SIZE = 4;
+    constexpr uint32_t DATA_LBA = 8192;
+
+    std::mt19937 rng(0xFA7);
+    uint8_t sector[512];
+    uint32_t errors = 0;
+    for(uint32_t i = 0; i < ops; ++i) {
+        const uint32_t dir = DIR_LBA + rng() % DIR_SIZE;
+        const uint32_t fat = FAT_LBA + (i / 64) % FAT_SIZE;
+        if(dev.readBlocks(dir, sector, 1) != 1) { errors++; }
+        if(dev.readBlocks(fat, sector, 1) != 1) { errors++; }
+        sector[i % 512] ^= 0x5A;
+        if(dev.writeBlocks(fat, sector, 1) != 1) { errors++; }
+        if(dev.writeBlocks(fat + FAT_SIZE, sector, 1) != 1) { errors++; }     // second FAT copy
+        if(dev.writeBlocks(dir, sector, 1) != 1) { errors++; }
+        if(dev.writeBlocks(DATA_LBA + i, sector, 1) != 1) { errors++; }
+        if(i % 16 == 15 && !flush()) { errors++; }
+    }
+    if(!flush()) { errors++; }
+    return errors;
+}
+
+template<class Eviction>
+void runCache(const char* config, const BenchConfig& cfg, const bool cached, std::vector<CacheResult>& results) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    using Card = sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts>;
+    Card card(model);
+
+    if(!card.begin()) {
+        fprintf(stderr, "%s: card init failed\n", config);
+        return;
+    }
+
+    const uint32_t ops = std::max<uint32_t>(64, cfg.blocksPerRun);
+    sd::BlockCache<Card, 16, 4, Eviction> cache(card);
+    model.resetStats();
+    const uint64_t bus0 = model.nowPs();
+    const uint32_t errors = cached ? metadataWorkload(cache, ops, [&] { return cache.flush(); })
+                                   : metadataWorkload(card, ops, [] { return true; });
+
+    CacheResult r;
+    r.config   = config;
+    r.ops      = ops;
+    r.errors   = errors;
+    r.busMs    = (model.nowPs() - bus0) * 1e-9;
+    r.commands = model.stats().commands;
+    r.hitRate  = cached ? cache.stats().hitRate() : 0.0;
+    results.push_back(r);
+
+    printf("%-14s %6u  %10.2f %9llu  %6.3f%s\n", config, ops, r.busMs, (unsigned long long)r.commands, r.hitRate,
+           errors ? "  ERRORS" : "");
+}
+
+/// sequential reads of one cluster per call: plain readBlocks, a CMD18 stream, and a stream with prefetching
+void runStream(const char* config, const BenchConfig& cfg, const uint32_t count, std::vector<StreamResult>& results) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    using Card = sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts>;
+    Card card(model);
+
+    if(!card.begin()) {
+        fprintf(stderr, "%s: card init failed\n", config);
+        return;
+    }
+
+    sd::StreamingCard<Card, 8> stream(card);
+    std::vector<uint8_t> buf(size_t(count) * 512);
+    const bool streaming = std::strcmp(config, "readBlocks") != 0;
+    const bool prefetch  = std::strcmp(config, "prefetch") == 0;
+    const uint32_t blocks = std::max(cfg.blocksPerRun, count * 4);
+
+    model.resetStats();
+    const uint64_t bus0 = model.nowPs();
+    uint32_t errors = 0;
+    for(uint32_t lba = 0; lba + count <= blocks; lba += count) {
+        const ssize_t n = streaming ? stream.readBlocks(lba, buf.data(), count) : card.readBlocks(lba, buf.data(), count);
+        if(n != static_cast<ssize_t>(count)) { errors++; }
+        if(prefetch) { stream.prefetch(); }
+    }
+    stream.close();
+
+    StreamResult r;
+    r.op            = "read";
+    r.config        = config;
+    r.blocksPerCall = count;
+    r.errors        = errors;
+    r.busMbPerSec   = double(blocks) * 512 / ((model.nowPs() - bus0) * 1e-12) / 1e6;
+    r.commands      = model.stats().commands;
+    results.push_back(r);
+
+    printf("%-5s %-14s %5u  %9.2f %9llu%s\n", r.op, config, count, r.busMbPerSec, (unsigned long long)r.commands,
+           errors ? "  ERRORS" : "");
+}
+
+/// a logger appending one block per call: plain writeBlocks, a CMD25 session, and a session with the pre-erase hint
+void runLogger(const char* config, const BenchConfig& cfg, std::vector<StreamResult>& results) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    using Card = sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts>;
+    Card card(model);
+
+    if(!card.begin()) {
+        fprintf(stderr, "%s: card init failed\n", config);
+        return;
+    }
+
+    sd::StreamingCard<Card, 0> stream(card);
+    uint8_t block[512];
+    std::memset(block, 0xA5, sizeof(block));
+    const bool streaming = std::strcmp(config, "writeBlocks") != 0;
+    const uint32_t blocks = cfg.blocksPerRun;
+
+    model.resetStats();
+    const uint64_t bus0 = model.nowPs();
+    uint32_t errors = 0;
+    if(std::strcmp(config, "hinted") == 0 && !stream.beginWriteSession(0, blocks)) { errors++; }
+    for(uint32_t lba = 0; lba < blocks; ++lba) {
+        block[0] = static_cast<uint8_t>(lba);
+        const ssize_t n = streaming ? stream.writeBlocks(lba, block, 1) : card.writeBlocks(lba, block, 1);
+        if(n != 1) { errors++; }
+    }
+    if(!stream.flush()) { errors++; }
+
+    StreamResult r;
+    r.op            = "write";
+    r.config        = config;
+    r.blocksPerCall = 1;
+    r.errors        = errors;
+    r.busMbPerSec   = double(blocks) * 512 / ((model.nowPs() - bus0) * 1e-12) / 1e6;
+    r.commands      = model.stats().commands;
+    results.push_back(r);
+
+    printf("%-5s %-14s %5u  %9.2f %9llu%s\n", r.op, config, 1u, r.busMbPerSec, (unsigned long long)r.commands,
+           errors ? "  ERRORS" : "");
+}
+
+/// counts shim calls, which cost a round-trip each on a USB adapter or a syscall on a kernel SPI driver
+template<class Shim>
+struct CountingShim : Shim {
+    using Shim::Shim;
+    static inline uint64_t calls = 0;
+
+    void select() { calls++; Shim::select(); }
+    void deSelect() { calls++; Shim::deSelect(); }
+    ssize_t write(const uint8_t* buf, const size_t LEN) { calls++; return Shim::write(buf, LEN); }
+    uint8_t write(const uint8_t val) { calls++; return Shim::write(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) { calls++; return Shim::read(buf, LEN); }
+    uint8_t read(const uint8_t val = 0xFF) { calls++; return Shim::read(val); }
+    template<class S = Shim>
+    auto pollRead(uint8_t* buf, const size_t LEN) -> decltype(std::declval<S&>().pollRead(buf, LEN)) {
+        calls++;
+        return Shim::pollRead(buf, LEN);
+    }
+};
+
+/// random single and multi block reads and writes, checked against what was written
+template<class Shim>
+void runPoll(const char* name, const BenchConfig& cfg, std::vector<PollResult>& results) {
+    for(const uint32_t count : { 1u, 8u }) {
+        for(const char* op : { "write", "read" }) {
+            sd::sim::Image image(IMAGE_BLOCKS);
+            sd::sim::CardConfig cardCfg;
+            cardCfg.clockHz = cfg.clockHz;
+            sd::sim::CardModel model(image, cardCfg);
+            using Card = sd::SpiCard<CountingShim<Shim>, sd::SlicedCRC, sd::defaultTimeouts>;
+            Card card(model);
+            if(!card.begin()) {
+                fprintf(stderr, "%s: card init failed\n", name);
+                return;
+            }
+
+            const bool write = std::strcmp(op, "write") == 0;
+            const uint32_t calls = std::max<uint32_t>(1, cfg.blocksPerRun / count);
+            std::vector<uint8_t> buf(count * 512);
+            std::vector<uint8_t> expect(count * 512);
+            std::mt19937 rng(0xB0);
+            uint32_t errors = 0;
+
+            // reads need known contents, write them first outside the measurement. Ranges are aligned to count so
+            // they never partly overlap, a later range would overwrite blocks an earlier one expects
+            std::vector<uint32_t> lbas(calls);
+            for(auto& lba : lbas) { lba = rng() % (IMAGE_BLOCKS / count) * count; }
+            if(!write) {
+                for(const uint32_t lba : lbas) {
+                    for(uint32_t b = 0; b < count * 512; ++b) { buf[b] = static_cast<uint8_t>(lba + b * 7); }
+                    if(card.writeBlocks(lba, buf.data(), count) != static_cast<ssize_t>(count)) { errors++; }
+                }
+            }
+
+            model.resetStats();
+            CountingShim<Shim>::calls = 0;
+            const uint64_t bus0 = model.nowPs();
+            for(const uint32_t lba : lbas) {
+                for(uint32_t b = 0; b < count * 512; ++b) { expect[b] = static_cast<uint8_t>(lba + b * 7); }
+                if(write) {
+                    if(card.writeBlocks(lba, expect.data(), count) != static_cast<ssize_t>(count)) { errors++; }
+                }
+                else if(card.readBlocks(lba, buf.data(), count) != static_cast<ssize_t>(count) || buf != expect) {
+                    errors++;
+                }
+            }
+            const uint64_t shimCalls = CountingShim<Shim>::calls;
+            const double bytes = double(calls) * count * 512;
+
+            PollResult r;
+            r.shim              = name;
+            r.op                = op;
+            r.blocksPerCall     = count;
+            r.errors            = errors;
+            r.shimCallsPerBlock = double(shimCalls) / (double(calls) * count);
+            r.busMbPerSec       = bytes / ((model.nowPs() - bus0) * 1e-12) / 1e6;
+            r.spiBytesPerByte   = model.stats().bytesClocked / bytes;
+            results.push_back(r);
+
+            printf("%-12s %-5s %5u  %10.1f %9.2f %6.3f%s\n", name, op, count, r.shimCallsPerBlock, r.busMbPerSec,
+                   r.spiBytesPerByte, errors ? "  ERRORS" : "");
+        }
+    }
+}
+
+/// sequential multi-block reads and writes at the clock begin() settled on
+template<class Shim>
+void runClock(const char* config, const BenchConfig& cfg, const bool highSpeed, std::vector<ClockResult>& results) {
+    constexpr uint32_t COUNT = 64;
+    for(const char* op : { "write", "read" }) {
+        sd::sim::Image image(IMAGE_BLOCKS);
+        sd::sim::CardConfig cardCfg;
+        cardCfg.clockHz   = cfg.clockHz;
+        cardCfg.highSpeed = highSpeed;
+        sd::sim::CardModel model(image, cardCfg);
+        sd::SpiCard<Shim, sd::SlicedCRC, sd::defaultTimeouts> card(model);
+
+        const uint64_t init0 = model.nowPs();
+        if(!card.begin()) {
+            fprintf(stderr, "%s: card init failed\n", config);
+            return;
+        }
+        const double initMs = (model.nowPs() - init0) * 1e-9;
+
+        const bool write = std::strcmp(op, "write") == 0;
+        const uint32_t blocks = std::max(cfg.blocksPerRun, COUNT) / COUNT * COUNT;
+        std::vector<uint8_t> buf(COUNT * 512, 0x6B);
+        model.resetStats();
+        const uint64_t bus0 = model.nowPs();
+        uint32_t errors = 0;
+        for(uint32_t lba = 0; lba < blocks; lba += COUNT) {
+            const ssize_t n = write ? card.writeBlocks(lba, buf.data(), COUNT) : card.readBlocks(lba, buf.data(), COUNT);
+            if(n != static_cast<ssize_t>(COUNT)) { errors++; }
+        }
+        // a driver in control of the clock must never run the card faster than the speed it negotiated
+        if(sd::detail::hasSetClock<Shim>::value && model.stats().overclocked > 0) { errors++; }
+
+        ClockResult r;
+        r.config      = config;
+        r.op          = op;
+        r.clockHz     = model.clockHz();
+        r.errors      = errors;
+        r.initMs      = initMs;
+        r.busMbPerSec = double(blocks) * 512 / ((model.nowPs() - bus0) * 1e-12) / 1e6;
+        results.push_back(r);
+
+        printf("%-12s %-5s %9.2f %8.2f %9.2f%s\n", config, op, r.clockHz / 1e6, r.initMs, r.busMbPerSec,
+               errors ? "  ERRORS" : "");
+    }
+}
+
+/// simulated time as a steady clock, so AdaptiveTimeouts can run against the simulated card
+struct SimTime {
+    using rep        = int64_t;
+    using period     = std::nano;
+    using duration   = std::chrono::duration<rep, period>;
+    using time_point = std::chrono::time_point<SimTime>;
+    static constexpr bool is_steady = true;
+
+    static inline sd::sim::CardModel* model = nullptr;
+    static time_point now() { return time_point(duration(static_cast<rep>(model->nowPs() / 1000))); }
+};
+
+/// sleeping lets simulated time pass without clocking the bus
+struct SimSleep {
+    static void yield() {}
+    static void sleep(const std::chrono::microseconds us) { SimTime::model->elapse(uint64_t(us.count()) * 1000000); }
+};
+
+/// writes of 1 and 8 blocks and erases, counting the bytes polled while the card was busy
+template<class Timeouts>
+void runBusy(const char* name, const BenchConfig& cfg, std::vector<BusyResult>& results) {
+    for(const char* op : { "write", "erase" }) {
+        for(const uint32_t count : { 1u, 8u }) {
+            sd::sim::Image image(IMAGE_BLOCKS);
+            sd::sim::CardConfig cardCfg;
+            cardCfg.clockHz = cfg.clockHz;
+            sd::sim::CardModel model(image, cardCfg);
+            SimTime::model = &model;
+            sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, Timeouts> card(model);
+            if(!card.begin()) {
+                fprintf(stderr, "%s: card init failed\n", name);
+                return;
+            }
+
+            const bool erase = std::strcmp(op, "erase") == 0;
+            const uint32_t calls = std::max<uint32_t>(8, cfg.blocksPerRun / count / (erase ? 4 : 1));
+            std::vector<uint8_t> buf(count * 512, 0x96);
+            model.resetStats();
+            const uint64_t bus0 = model.nowPs();
+            uint32_t errors = 0;
+            for(uint32_t i = 0; i < calls; ++i) {
+                const uint32_t lba = (i * count) % (IMAGE_BLOCKS - count);
+                if(erase) {
+                    if(!card.eraseBlocks(lba, lba + count - 1)) { errors++; }
+                }
+                else if(card.writeBlocks(lba, buf.data(), count) != static_cast<ssize_t>(count)) {
+                    errors++;
+                }
+            }
+            // the stop token's commit is waited for by the next command
+            if(!card.readBlocks(0, buf.data(), 1)) { errors++; }
+
+            // one busy period per block and one per commit (stop token or CMD38)
+            const uint32_t waits = erase ? calls : calls * (count + (count > 1 ? 1 : 0));
+            BusyResult r;
+            r.policy           = name;
+            r.op               = op;
+            r.blocksPerCall    = count;
+            r.errors           = errors;
+            r.busyPollsPerWait = double(model.stats().busyBytes) / waits;
+            r.busMbPerSec      = double(calls) * count * 512 / ((model.nowPs() - bus0) * 1e-12) / 1e6;
+            results.push_back(r);
+
+            printf("%-18s %-5s %5u  %10.1f %9.2f%s\n", name, op, count, r.busyPollsPerWait, r.busMbPerSec,
+                   errors ? "  ERRORS" : "");
+        }
+    }
+    SimTime::model = nullptr;
+}
+
+/// counts the bytes a CRC16 policy hashes on the host
+template<class Base>
+struct CountingCRC : Base {
+    static inline uint64_t bytes = 0;
+    uint16_t CRC_CCITT_update(const uint16_t crc, const uint8_t* data, const size_t n) {
+        if(Base::useCRC16) { bytes += n; }
+        return Base::CRC_CCITT_update(crc, data, n);
+    }
+};
+
+/**
+ * 8 block writes and reads through a shim with a CRC unit or a link CRC. A clean pass checks the data and counts
+ * the bytes hashed on the host, then a pass with a corrupted byte in every 5th block transfer counts how many
+ * transfers failed as they should and how many reported success with the wrong data.
+ */
+template<class Shim, class CRCPolicy>
+void runPeripheral(const char* config, const BenchConfig& cfg, const bool mustDetect,
+                   std::vector<PeripheralResult>& results) {
+    constexpr uint32_t COUNT = 8;
+    for(const char* op : { "write", "read" }) {
+        sd::sim::Image image(IMAGE_BLOCKS);
+        sd::sim::CardConfig cardCfg;
+        cardCfg.clockHz = cfg.clockHz;
+        sd::sim::CardModel model(image, cardCfg);
+        sd::sim::LinkFaults faults;
+        sd::SpiCard<Shim, CountingCRC<CRCPolicy>, sd::defaultTimeouts> card(model, &faults);
+        if(!card.begin()) {
+            fprintf(stderr, "%s: card init failed\n", config);
+            return;
+        }
+
+        const bool write = std::strcmp(op, "write") == 0;
+        const uint32_t calls = std::max<uint32_t>(8, cfg.blocksPerRun / COUNT);
+        std::vector<uint8_t> buf(COUNT * 512);
+        std::vector<uint8_t> expect(COUNT * 512);
+        const auto fill = [&expect](const uint32_t lba, const uint32_t salt) {
+            for(uint32_t b = 0; b < COUNT * 512; ++b) { expect[b] = static_cast<uint8_t>(lba * 3 + b * 5 + salt); }
+        };
+
+        PeripheralResult r{};
+        r.config = config;
+        r.op     = op;
+        for(uint32_t i = 0; !write && i < calls; ++i) {
+            fill(i * COUNT, 0);
+            if(card.writeBlocks(i * COUNT, expect.data(), COUNT) != static_cast<ssize_t>(COUNT)) { r.errors++; }
+        }
+
+        CountingCRC<CRCPolicy>::bytes = 0;
+        const uint32_t queries0 = faults.queries;
+        for(uint32_t i = 0; i < calls; ++i) {
+            const uint32_t lba = i * COUNT;
+            fill(lba, 0);
+            if(write) {
+                if(card.writeBlocks(lba, expect.data(), COUNT) != static_cast<ssize_t>(COUNT)) { r.errors++; }
+            }
+            else if(card.readBlocks(lba, buf.data(), COUNT) != static_cast<ssize_t>(COUNT) || buf != expect) {
+                r.errors++;
+            }
+        }
+        r.hostCrcBytesPerBlock = double(CountingCRC<CRCPolicy>::bytes) / (double(calls) * COUNT);
+        r.queriesPerCall       = double(faults.queries - queries0) / calls;
+
+        faults.every = 5;
+        std::vector<bool> written(calls, false);
+        for(uint32_t i = 0; i < calls; ++i) {
+            const uint32_t lba = i * COUNT;
+            fill(lba, write ? 1 : 0);
+            if(write) {
+                written[i] = card.writeBlocks(lba, expect.data(), COUNT) == static_cast<ssize_t>(COUNT);
+                if(!written[i]) { r.detected++; }
+            }
+            else if(card.readBlocks(lba, buf.data(), COUNT) != static_cast<ssize_t>(COUNT)) {
+                r.detected++;
+            }
+            else if(buf != expect) {
+                r.undetected++;
+            }
+        }
+        r.injected   = faults.injected;
+        faults.every = 0;
+        // a write that reported success must have stored what it was given
+        for(uint32_t i = 0; write && i < calls; ++i) {
+            fill(i * COUNT, 1);
+            if(written[i] && (card.readBlocks(i * COUNT, buf.data(), COUNT) != static_cast<ssize_t>(COUNT) || buf != expect)) {
+                r.undetected++;
+            }
+        }
+        if(mustDetect && (r.undetected > 0 || (r.injected > 0 && r.detected == 0))) { r.errors++; }
+        results.push_back(r);
+
+        printf("%-16s %-5s %9.1f %9.2f %6u %6u %6u%s\n", config, op, r.hostCrcBytesPerBlock, r.queriesPerCall,
+               r.injected, r.detected, r.undetected, r.errors ? "  ERRORS" : "");
+    }
+}
+
+/// contents of volume block LBA in the striping runs
+uint8_t stripePattern(const uint32_t LBA, const uint32_t b) { return static_cast<uint8_t>(LBA * 131 + (LBA >> 8) + b * 3); }
+
+/**
+ * Sequential 128 block writes, then reads, over N simulated cards striped 16 blocks wide, each card on a bus of its
+ * own. Reads are checked, and followed by random unaligned reads and by reads and an erase past the end of the
+ * volume, which must fail. The write pass also erases a range that starts and ends inside stripes and checks the
+ * blocks around it survived.
+ */
+template<size_t N, class Buses>
+void runStripe(const char* config, const BenchConfig& cfg, std::vector<StripeResult>& results) {
+    constexpr uint32_t COUNT  = 128;
+    constexpr uint32_t STRIPE = 16;
+    using Card = sd::SpiCard<sd::sim::SimPollShim, sd::SlicedCRC, sd::defaultTimeouts>;
+    // buses that take turns are in use one after the other, independent ones at the same time
+    constexpr bool SERIAL = std::is_same_v<Buses, sd::SerialBuses>;
+
+    std::vector<std::unique_ptr<sd::sim::Image>>     images;
+    std::vector<std::unique_ptr<sd::sim::CardModel>> models;
+    std::vector<std::unique_ptr<Card>>               cards;
+    std::array<Card*, N> devices{};
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    for(size_t i = 0; i < N; ++i) {
+        images.push_back(std::make_unique<sd::sim::Image>(IMAGE_BLOCKS / N));
+        models.push_back(std::make_unique<sd::sim::CardModel>(*images.back(), cardCfg));
+        cards.push_back(std::make_unique<Card>(*models.back()));
+        devices[i] = cards.back().get();
+    }
+    sd::StripedCard<Card, N, Buses> volume(devices, STRIPE);
+    if(!volume.begin() || volume.cardCapacity().value_or(0) < IMAGE_BLOCKS - N * STRIPE) {
+        fprintf(stderr, "%s: volume init failed\n", config);
+        return;
+    }
+
+    const uint32_t blocks = std::max(cfg.blocksPerRun * 4, COUNT) / COUNT * COUNT;
+    std::vector<uint8_t> buf(COUNT * 512);
+    std::vector<uint8_t> expect(COUNT * 512);
+    const auto fill = [&expect](const uint32_t LBA, const uint32_t LEN) {
+        for(uint32_t b = 0; b < LEN * 512; ++b) { expect[b] = stripePattern(LBA + b / 512, b % 512); }
+    };
+
+    for(const char* op : { "write", "read" }) {
+        const bool write = std::strcmp(op, "write") == 0;
+        uint32_t errors = 0;
+        std::array<uint64_t, N> bus0{};
+        for(size_t i = 0; i < N; ++i) { bus0[i] = models[i]->nowPs(); }
+        const auto t0 = std::chrono::steady_clock::now();
+        for(uint32_t lba = 0; lba < blocks; lba += COUNT) {
+            fill(lba, COUNT);
+            if(write) {
+                if(volume.writeBlocks(lba, expect.data(), COUNT) != static_cast<ssize_t>(COUNT)) { errors++; }
+            }
+            else if(volume.readBlocks(lba, buf.data(), COUNT) != static_cast<ssize_t>(COUNT) || buf != expect) {
+                errors++;
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        uint64_t busPs = 0;
+        for(size_t i = 0; i < N; ++i) {
+            const uint64_t ps = models[i]->nowPs() - bus0[i];
+            busPs = SERIAL ? busPs + ps : std::max(busPs, ps);
+        }
+
+        // nothing past the end of the volume
+        const uint32_t end = *volume.cardCapacity();
+        if(!write && (volume.readBlocks(end - 1, buf.data(), 2) >= 0 || volume.readBlocks(end, buf.data(), 1) >= 0
+                      || volume.eraseBlocks(end - 1, end))) {
+            errors++;
+        }
+
+        std::mt19937 rng(0x57);
+        for(uint32_t i = 0; !write && i < 64; ++i) {
+            const uint32_t len = 1 + rng() % 100;
+            const uint32_t lba = rng() % (blocks - len);
+            fill(lba, len);
+            if(volume.readBlocks(lba, buf.data(), len) != static_cast<ssize_t>(len) ||
+               std::memcmp(buf.data(), expect.data(), len * 512) != 0) {
+                errors++;
+            }
+        }
+        if(write) {
+            constexpr uint32_t FIRST = STRIPE / 2 + 3;
+            constexpr uint32_t LAST  = 5 * STRIPE + 1;
+            if(!volume.eraseBlocks(FIRST, LAST)) { errors++; }
+            for(uint32_t lba = 0; lba < 6 * STRIPE; ++lba) {
+                if(volume.readBlocks(lba, buf.data(), 1) != 1) { errors++; continue; }
+                fill(lba, 1);
+                const bool erased = std::all_of(buf.begin(), buf.begin() + 512, [&buf](uint8_t b) { return b == buf[0]; });
+                if(lba >= FIRST && lba <= LAST ? !erased : std::memcmp(buf.data(), expect.data(), 512) != 0) { errors++; }
+            }
+            // put the erased blocks back for the read pass
+            fill(0, 6 * STRIPE);
+            if(volume.writeBlocks(0, expect.data(), 6 * STRIPE) != 6 * STRIPE) { errors++; }
+        }
+
+        StripeResult r;
+        r.config      = config;
+        r.op          = op;
+        r.cards       = N;
+        r.errors      = errors;
+        r.mbPerSec    = double(blocks) * 512 / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+        r.busMbPerSec = double(blocks) * 512 / (busPs * 1e-12) / 1e6;
+        r.scaling     = 1.0;
+        for(const StripeResult& one : results) {
+            if(one.cards == 1 && std::strcmp(one.op, op) == 0) { r.scaling = r.busMbPerSec / one.busMbPerSec; }
+        }
+        results.push_back(r);
+
+        printf("%-16s %-5s %5u  %9.2f %9.2f %7.2f%s\n", config, op, r.cards, r.mbPerSec, r.busMbPerSec, r.scaling,
+               errors ? "  ERRORS" : "");
+    }
+}
+
+/// default timeouts, but a busy card lets the thread go between polls, and with it the bus
+struct YieldingTimeouts : sd::defaultTimeouts {
+    void busyBegin(sd::BusyKind) {}
+    void busyPause(sd::BusyKind, uint32_t) { std::this_thread::yield(); }
+    void busyEnd(sd::BusyKind, bool, uint32_t) {}
+};
+
+/**
+ * Cards on one simulated bus, each driven by a thread of its own: sequential 32 block writes, then reads, and with
+ * `sensor` a high priority device that wants the bus every 200us at 40MHz in SPI mode 3. The cards run at 25MHz in
+ * mode 0, so a missed clock or mode switch shows up as an error.
+ */
+template<class Timeouts>
+void runSharedBus(const char* config, const uint32_t cardCount, const bool sensor, const BenchConfig& cfg,
+                  std::vector<SharedBusResult>& results) {
+    constexpr uint32_t COUNT = 32;
+    using Bus  = sd::SharedBus<sd::sim::SimBus>;
+    using Card = sd::SpiCard<sd::BusHandle<Bus>, sd::SlicedCRC, Timeouts>;
+
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz   = cfg.clockHz;
+    cardCfg.highSpeed = false;
+    std::vector<std::unique_ptr<sd::sim::Image>>     images;
+    std::vector<std::unique_ptr<sd::sim::CardModel>> models;
+    std::vector<sd::sim::CardModel*>                 onBus;
+    for(uint32_t i = 0; i < cardCount; ++i) {
+        images.push_back(std::make_unique<sd::sim::Image>(IMAGE_BLOCKS / 4));
+        models.push_back(std::make_unique<sd::sim::CardModel>(*images.back(), cardCfg));
+        onBus.push_back(models.back().get());
+    }
+    Bus bus(onBus);
+    std::vector<std::unique_ptr<Card>> cards;
+    for(uint32_t i = 0; i < cardCount; ++i) {
+        cards.push_back(std::make_unique<Card>(bus, static_cast<uint8_t>(i)));
+        if(!cards.back()->begin()) {
+            fprintf(stderr, "%s: card %u init failed\n", config, i);
+            return;
+        }
+    }
+    sd::BusHandle<Bus> sensorHandle(bus, static_cast<uint8_t>(cardCount), sd::BusDevice{ 40000000, 3, 1, 0 });
+
+    const uint32_t blocks = std::max(cfg.blocksPerRun, COUNT) / COUNT * COUNT;
+    const auto pattern = [](const uint32_t card, const uint32_t LBA, const uint32_t b) {
+        return static_cast<uint8_t>(card * 67 + LBA * 13 + b);
+    };
+
+    for(const char* op : { "write", "read" }) {
+        const bool write = std::strcmp(op, "write") == 0;
+        std::atomic<uint32_t> errors{0};
+        std::atomic<bool>     done{false};
+        std::atomic<uint32_t> ready{0};
+        double   sensorMaxUs = 0;
+        uint64_t overclocked = 0;
+        for(const auto& m : models) { overclocked += m->stats().overclocked; }
+        const uint32_t modeErrors0 = bus.controller().modeErrors();
+        bus.resetStats();
+        const uint64_t bus0 = models[0]->nowPs();
+
+        std::thread sensorThread;
+        if(sensor) {
+            sensorThread = std::thread([&] {
+                uint8_t frame[4] = { 0x80, 0x00, 0x00, 0x00 };
+                while(!done.load(std::memory_order_relaxed)) {
+                    const auto t0 = std::chrono::steady_clock::now();
+                    sensorHandle.select();
+                    const auto t1 = std::chrono::steady_clock::now();
+                    sensorHandle.write(frame, sizeof(frame));
+                    sensorHandle.read(frame, sizeof(frame));
+                    sensorHandle.deSelect();
+                    sensorMaxUs = std::max(sensorMaxUs, std::chrono::duration<double, std::micro>(t1 - t0).count());
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            });
+        }
+        std::vector<std::thread> threads;
+        for(uint32_t c = 0; c < cardCount; ++c) {
+            threads.emplace_back([&, c] {
+                std::vector<uint8_t> buf(COUNT * 512);
+                std::vector<uint8_t> expect(COUNT * 512);
+                // start together, so the cards really compete for the bus
+                ready++;
+                while(ready.load() < cardCount) { std::this_thread::yield(); }
+                for(uint32_t lba = 0; lba < blocks; lba += COUNT) {
+                    for(uint32_t b = 0; b < COUNT * 512; ++b) { expect[b] = pattern(c, lba + b / 512, b % 512); }
+                    if(write) {
+                        if(cards[c]->writeBlocks(lba, expect.data(), COUNT) != static_cast<ssize_t>(COUNT)) { errors++; }
+                    }
+                    else if(cards[c]->readBlocks(lba, buf.data(), COUNT) != static_cast<ssize_t>(COUNT) || buf != expect) {
+                        errors++;
+                    }
+                }
+            });
+        }
+        for(auto& t : threads) { t.join(); }
+        done = true;
+        if(sensorThread.joinable()) { sensorThread.join(); }
+
+        const uint64_t busPs = models[0]->nowPs() - bus0;
+        for(const auto& m : models) { overclocked -= m->stats().overclocked; }
+        const sd::SharedBusStats& st = bus.stats();
+
+        SharedBusResult r;
+        r.config          = config;
+        r.op              = op;
+        r.cards           = cardCount;
+        r.errors          = errors + static_cast<uint32_t>(-overclocked) + (bus.controller().modeErrors() - modeErrors0);
+        r.busMbPerSec     = double(blocks) * cardCount * 512 / (busPs * 1e-12) / 1e6;
+        r.transactions    = st.transactions;
+        r.contended       = st.contended;
+        r.clockChanges    = st.clockChanges;
+        r.modeChanges     = st.modeChanges;
+        r.yields          = st.yields;
+        r.sensorMaxWaitUs = sensorMaxUs;
+        results.push_back(r);
+
+        printf("%-18s %-5s %5u  %9.2f %8u %9u %7u %6u %7u %9.1f%s\n", config, op, r.cards, r.busMbPerSec,
+               r.transactions, r.contended, r.clockChanges, r.modeChanges, r.yields, r.sensorMaxWaitUs,
+               r.errors ? "  ERRORS" : "");
+    }
+}
+
+/// ns per single block RamDisk read, through `read(pdrv, lba, buf)`
+template<class Read>
+double timeReads(const uint32_t calls, Read read) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < calls; ++i) { read(i & 255); }
+    const auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+}
+
+/**
+ * A DiskRegistry of a cached simulated card, a RamDisk and a FileDisk: every drive is written, synced, read back and
+ * trimmed through the table, and a drive number past it must fail. Then the cost of dispatching: single block RamDisk
+ * reads called directly, through a table of one drive and through the table of three.
+ */
+void runDiskRegistry(const BenchConfig& cfg, std::vector<DiskIOResult>& results) {
+    using Card  = sd::SpiCard<sd::sim::SimPollShim, sd::SlicedCRC, sd::defaultTimeouts>;
+    using Cache = sd::BlockCache<Card>;
+    constexpr uint32_t RAM_BLOCKS = 1024;
+    constexpr uint32_t COUNT      = 16;
+    const char* const  IMAGE_PATH = "SDCardBench.img";
+
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    Card  card(model);
+    Cache cache(card);
+    std::vector<uint8_t> ramMem(RAM_BLOCKS * 512);
+    sd::RamDisk ram(ramMem.data(), RAM_BLOCKS);
+    { sd::sim::Image file(IMAGE_PATH, 512); }
+    sd::FileDisk file(IMAGE_PATH);
+
+    sd::DiskRegistry<Cache, sd::RamDisk, sd::FileDisk> disks(&cache, &ram, nullptr);
+    uint32_t errors = 0;
+    if(disks.present(2) || disks.begin(2)) { errors++; }
+    disks.attach<2>(&file);
+
+    std::vector<uint8_t> buf(COUNT * 512);
+    std::vector<uint8_t> expect(COUNT * 512);
+    // attached but not initialized: no I/O and no TRIM
+    if(disks.ready(2) || disks.trim(2, 0, 0) || disks.eraseUnit(2) != 1 || disks.read(2, 0, buf.data(), 1)) { errors++; }
+    const uint32_t sizes[3] = { IMAGE_BLOCKS, RAM_BLOCKS, 512 };
+    for(uint8_t pdrv = 0; pdrv < disks.DRIVES; ++pdrv) {
+        for(uint32_t b = 0; b < COUNT * 512; ++b) { expect[b] = static_cast<uint8_t>(pdrv * 89 + b * 7 + (b >> 9)); }
+        if(!disks.begin(pdrv) || disks.blockCount(pdrv).value_or(0) != sizes[pdrv]) { errors++; }
+        if(!disks.write(pdrv, 8, expect.data(), COUNT) || !disks.sync(pdrv)) { errors++; }
+        // single blocks go through the card's cache
+        if(!disks.write(pdrv, 100, expect.data(), 1) || !disks.sync(pdrv)) { errors++; }
+        if(!disks.read(pdrv, 8, buf.data(), COUNT) || buf != expect) { errors++; }
+        if(!disks.read(pdrv, 100, buf.data(), 1) || std::memcmp(buf.data(), expect.data(), 512) != 0) { errors++; }
+        if(!disks.trim(pdrv, 200, 263) || disks.eraseUnit(pdrv) == 0) { errors++; }
+        // past the end of the drive
+        if(disks.read(pdrv, sizes[pdrv] - 1, buf.data(), 2)) { errors++; }
+    }
+    if(disks.read(disks.DRIVES, 0, buf.data(), 1) || disks.begin(disks.DRIVES)) { errors++; }
+    if(model.stats().blocksWritten < COUNT + 1) { errors++; }
+    file.close();
+    std::remove(IMAGE_PATH);
+    results.push_back(DiskIOResult{ "card, RAM, image", errors, 0 });
+
+    // dispatch cost, with the drive number opaque to the compiler
+    const uint32_t calls = std::max<uint32_t>(100000, cfg.blocksPerRun * 100);
+    volatile uint8_t ramDrive = 1;
+    volatile uint8_t oneDrive = 0;
+    sd::DiskRegistry<sd::RamDisk> single(&ram);
+    single.begin(0);
+    std::array<uint8_t, 512> block{};
+    const double direct = timeReads(calls, [&](uint32_t lba) { ram.readBlocks(lba, block.data(), 1); });
+    const double one    = timeReads(calls, [&](uint32_t lba) { single.read(oneDrive, lba, block.data(), 1); });
+    const double three  = timeReads(calls, [&](uint32_t lba) { disks.read(ramDrive, lba, block.data(), 1); });
+    results.push_back(DiskIOResult{ "direct call", 0, direct });
+    results.push_back(DiskIOResult{ "1 drive table", 0, one });
+    results.push_back(DiskIOResult{ "3 drive table", 0, three });
+
+    for(const DiskIOResult& r : results) {
+        printf("%-18s %6u %9.1f%s\n", r.config, r.errors, r.nsPerCall, r.errors ? "  ERRORS" : "");
+    }
+}
+
+/// wall time of a mixed read/write loop, best of several passes to keep scheduler noise out of the comparison
+template<class StatsPolicy>
+double statsLoop(const BenchConfig& cfg, uint32_t& errors, sd::CardStatistics* snapshot) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts, StatsPolicy> card(model);
+
+    if(!card.begin()) {
+        errors++;
+        return 0;
+    }
+
+    constexpr uint32_t COUNT = 8;
+    std::vector<uint8_t> buf(COUNT * 512, 0x3C);
+    double best = 0;
+    for(int pass = 0; pass < 3; ++pass) {
+        card.resetStats();
+        const auto t0 = std::chrono::steady_clock::now();
+        for(uint32_t lba = 0; lba + COUNT <= cfg.blocksPerRun; lba += COUNT) {
+            if(card.writeBlocks(lba, buf.data(), COUNT) != COUNT) { errors++; }
+            if(card.readBlocks(lba, buf.data(), COUNT) != COUNT) { errors++; }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        const double mbPerSec = 2.0 * cfg.blocksPerRun * 512 / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+        best = std::max(best, mbPerSec);
+    }
+    if constexpr (std::is_same_v<typename StatsPolicy::Snapshot, sd::CardStatistics>) {
+        if(snapshot) { *snapshot = card.statsSnapshot(); }
+    }
+    return best;
+}
+
+void runStats(const BenchConfig& cfg, StatsResult& r) {
+    r.errors          = 0;
+    r.noStatsMbPerSec = statsLoop<sd::noStats>(cfg, r.errors, nullptr);
+    r.statsMbPerSec   = statsLoop<sd::SDStats<>>(cfg, r.errors, &r.snapshot);
+    r.traceMbPerSec   = statsLoop<sd::SDTrace<1024>>(cfg, r.errors, nullptr);
+
+    const auto& s = r.snapshot;
+    printf("noStats %9.2f MB/s, SDStats %9.2f MB/s (%+.1f%%), SDTrace %9.2f MB/s (%+.1f%%)%s\n", r.noStatsMbPerSec,
+           r.statsMbPerSec, (r.statsMbPerSec / r.noStatsMbPerSec - 1) * 100, r.traceMbPerSec,
+           (r.traceMbPerSec / r.noStatsMbPerSec - 1) * 100, r.errors ? "  ERRORS" : "");
+    printf("  CMD18 %u  CMD12 %u  CMD25 %u  ACMD23 %u  CMD55 %u\n", s.commandCount(sd::SDCMD::CMD18),
+           s.commandCount(sd::SDCMD::CMD12), s.commandCount(sd::SDCMD::CMD25), s.appCommandCount(sd::SDCMD::ACMD23),
+           s.commandCount(sd::SDCMD::CMD55));
+    printf("  read %llu B  written %llu B  busy waits %u (%llu polls, %llu us)  crc errors %u  timeouts %u\n",
+           (unsigned long long)s.bytesRead, (unsigned long long)s.bytesWritten, s.busyWaits,
+           (unsigned long long)s.busyPolls, (unsigned long long)s.busyUs, s.crcErrors, s.timeouts);
+    for(const auto op : { sd::Operation::READ, sd::Operation::WRITE }) {
+        const auto& o = s.op(op);
+        printf("  %-5s %u calls  mean %u us  p50 <%u us  p99 <%u us  max %u us\n", op == sd::Operation::READ ? "read" : "write",
+               o.count, o.meanUs(), o.percentileUs(0.5f), o.percentileUs(0.99f), o.maxUs);
+    }
+}
+
+/// record initialization and a few reads and writes with SDTrace and write the trace to cfg.tracePath
+bool writeTraceFile(const BenchConfig& cfg) {
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardConfig cardCfg;
+    cardCfg.clockHz = cfg.clockHz;
+    sd::sim::CardModel model(image, cardCfg);
+    sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts, sd::SDTrace<4096>> card(model);
+    sd::StreamingCard<decltype(card)> stream(card);
+
+    bool ok = card.begin();
+    std::vector<uint8_t> buf(8 * 512, 0x5A);
+    ok = ok && card.writeBlocks(100, buf.data(), 1) == 1;
+    ok = ok && card.writeBlocks(200, buf.data(), 8) == 8;
+    ok = ok && card.readBlocks(100, buf.data(), 1) == 1;
+    ok = ok && card.readBlocks(200, buf.data(), 8) == 8;
+    for(uint32_t lba = 300; lba < 304; ++lba) { ok = ok && stream.readBlocks(lba, buf.data(), 1) == 1; }
+    ok = ok && stream.close();
+
+    FILE* f = std::fopen(cfg.tracePath, "wb");
+    if(!f) {
+        perror(cfg.tracePath);
+        return false;
+    }
+    auto& trace = card.statsPolicy();
+    ok = sd::writeTrace(f, trace.traceBuffer(), trace.traceHeader()) && ok;
+    std::fclose(f);
+    printf("trace of %u events written to %s\n", trace.traceBuffer().recorded(), cfg.tracePath);
+    return ok;
+}
+
+template<class CRCPolicy>
+void runCRC(const char* name, std::vector<CRCResult>& results) {
+    std::vector<uint8_t> buf(1024 + 8);
+    std::mt19937 rng(0xC4C);
+    for(auto& b : buf) { b = static_cast<uint8_t>(rng()); }
+
+    CRCPolicy policy;
+    sd::ShiftedCRC reference;
+    bool matches = true;
+    for(size_t n = 0; n <= 1024; ++n) {
+        const uint8_t* p = buf.data() + (n & 7);
+        if(CRCPolicy::useCRC16 && policy.CRC_CCITT(p, n) != reference.CRC_CCITT(p, n)) { matches = false; }
+        // command frames are 5 bytes, registers 15
+        if(CRCPolicy::useCRC16 && n <= 16 && policy.getCRC7(p, uint8_t(n)) != reference.getCRC7(p, uint8_t(n))) {
+            matches = false;
+        }
+        // the CRC of a block is the CRC of its head combined with the CRC of the rest, as sd::PeripheralCRC uses it
+        const size_t head = n / 3;
+        if(CRCPolicy::useCRC16 && sd::detail::crc16Combine(policy.CRC_CCITT(p, head), policy.CRC_CCITT(p + head, n - head),
+                                                           n - head) != reference.CRC_CCITT(p, n)) {
+            matches = false;
+        }
+    }
+
+    constexpr uint32_t ITERATIONS = 200000;
+    volatile uint16_t sink = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < ITERATIONS; ++i) {
+        buf[0] = static_cast<uint8_t>(i);
+        sink = sink ^ policy.CRC_CCITT(buf.data(), 512);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    CRCResult r;
+    r.policy     = name;
+    r.matches    = matches;
+    r.nsPerBlock = std::chrono::duration<double, std::nano>(t1 - t0).count() / ITERATIONS;
+    r.mbPerSec   = 512.0 / r.nsPerBlock * 1e3;
+    results.push_back(r);
+
+    printf("%-14s %9.1f ns/block %9.1f MB/s%s\n", name, r.nsPerBlock, r.mbPerSec, matches ? "" : "  MISMATCH");
+}
+
+bool writeJson(const BenchConfig& cfg, const std::vector<Result>& results, const std::vector<CRCResult>& crcResults,
+               const std::vector<AsyncResult>& asyncResults, const std::vector<CacheResult>& cacheResults,
+               const std::vector<StreamResult>& streamResults, const std::vector<PollResult>& pollResults,
+               const std::vector<ClockResult>& clockResults, const std::vector<BusyResult>& busyResults,
+               const std::vector<PeripheralResult>& peripheralResults,
+               const std::vector<StripeResult>& stripeResults,
+               const std::vector<SharedBusResult>& sharedResults,
+               const std::vector<DiskIOResult>& diskResults, const StatsResult& stats) {
+    FILE* f = (std::strcmp(cfg.jsonPath, "-") == 0) ? stdout : std::fopen(cfg.jsonPath, "w");
+    if(!f) {
+        perror(cfg.jsonPath);
+        return false;
+    }
+
+    fprintf(f, "{\n  \"benchmark\": \"SDCardBench\",\n  \"clock_hz\": %u,\n  \"blocks_per_run\": %u,\n  \"results\": [\n",
+            cfg.clockHz, cfg.blocksPerRun);
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(f, "    {\"policy\": \"%s\", \"op\": \"%s\", \"pattern\": \"%s\", \"blocks\": %u, \"calls\": %u, "
+                   "\"errors\": %u, \"mb_per_s\": %.3f, \"bus_mb_per_s\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+                   "\"bus_p50_us\": %.3f, \"bus_p99_us\": %.3f, \"spi_bytes_per_payload_byte\": %.4f, "
+                   "\"bus_to_wall\": %.4f}%s\n",
+                r.policy.c_str(), r.op, r.pattern, r.blocks, r.calls, r.errors, r.mbPerSec, r.busMbPerSec,
+                r.p50us, r.p99us, r.busP50us, r.busP99us, r.spiBytesPerByte, r.busUtilization,
+                (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"crc\": [\n");
+    for(size_t i = 0; i < crcResults.size(); ++i) {
+        const CRCResult& r = crcResults[i];
+        fprintf(f, "    {\"policy\": \"%s\", \"matches_reference\": %s, \"ns_per_block\": %.2f, \"mb_per_s\": %.1f}%s\n",
+                r.policy.c_str(), r.matches ? "true" : "false", r.nsPerBlock, r.mbPerSec,
+                (i + 1 < crcResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"async\": [\n");
+    for(size_t i = 0; i < asyncResults.size(); ++i) {
+        const AsyncResult& r = asyncResults[i];
+        fprintf(f, "    {\"policy\": \"%s\", \"op\": \"%s\", \"blocks\": %u, \"errors\": %u, \"mb_per_s\": %.3f, "
+                   "\"driver_cpu\": %.4f}%s\n",
+                r.policy.c_str(), r.op, r.blocks, r.errors, r.mbPerSec, r.driverCpu,
+                (i + 1 < asyncResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"cache\": [\n");
+    for(size_t i = 0; i < cacheResults.size(); ++i) {
+        const CacheResult& r = cacheResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"ops\": %u, \"errors\": %u, \"bus_ms\": %.3f, \"commands\": %llu, "
+                   "\"hit_rate\": %.4f}%s\n",
+                r.config, r.ops, r.errors, r.busMs, (unsigned long long)r.commands, r.hitRate,
+                (i + 1 < cacheResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"streaming\": [\n");
+    for(size_t i = 0; i < streamResults.size(); ++i) {
+        const StreamResult& r = streamResults[i];
+        fprintf(f, "    {\"op\": \"%s\", \"config\": \"%s\", \"blocks\": %u, \"errors\": %u, \"bus_mb_per_s\": %.3f, \"commands\": %llu}%s\n",
+                r.op, r.config, r.blocksPerCall, r.errors, r.busMbPerSec, (unsigned long long)r.commands,
+                (i + 1 < streamResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"polling\": [\n");
+    for(size_t i = 0; i < pollResults.size(); ++i) {
+        const PollResult& r = pollResults[i];
+        fprintf(f, "    {\"shim\": \"%s\", \"op\": \"%s\", \"blocks\": %u, \"errors\": %u, "
+                   "\"shim_calls_per_block\": %.2f, \"bus_mb_per_s\": %.3f, \"spi_bytes_per_payload_byte\": %.4f}%s\n",
+                r.shim, r.op, r.blocksPerCall, r.errors, r.shimCallsPerBlock, r.busMbPerSec, r.spiBytesPerByte,
+                (i + 1 < pollResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"clock\": [\n");
+    for(size_t i = 0; i < clockResults.size(); ++i) {
+        const ClockResult& r = clockResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"op\": \"%s\", \"clock_hz\": %u, \"errors\": %u, \"init_ms\": %.3f, "
+                   "\"bus_mb_per_s\": %.3f}%s\n",
+                r.config, r.op, r.clockHz, r.errors, r.initMs, r.busMbPerSec, (i + 1 < clockResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"busy\": [\n");
+    for(size_t i = 0; i < busyResults.size(); ++i) {
+        const BusyResult& r = busyResults[i];
+        fprintf(f, "    {\"policy\": \"%s\", \"op\": \"%s\", \"blocks\": %u, \"errors\": %u, "
+                   "\"busy_polls_per_wait\": %.2f, \"bus_mb_per_s\": %.3f}%s\n",
+                r.policy, r.op, r.blocksPerCall, r.errors, r.busyPollsPerWait, r.busMbPerSec,
+                (i + 1 < busyResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"peripheral_crc\": [\n");
+    for(size_t i = 0; i < peripheralResults.size(); ++i) {
+        const PeripheralResult& r = peripheralResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"op\": \"%s\", \"errors\": %u, \"host_crc_bytes_per_block\": %.2f, "
+                   "\"queries_per_call\": %.3f, \"injected\": %u, \"detected\": %u, \"undetected\": %u}%s\n",
+                r.config, r.op, r.errors, r.hostCrcBytesPerBlock, r.queriesPerCall, r.injected, r.detected,
+                r.undetected, (i + 1 < peripheralResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"striping\": [\n");
+    for(size_t i = 0; i < stripeResults.size(); ++i) {
+        const StripeResult& r = stripeResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"op\": \"%s\", \"cards\": %u, \"errors\": %u, \"mb_per_s\": %.3f, "
+                   "\"bus_mb_per_s\": %.3f, \"scaling\": %.3f}%s\n",
+                r.config, r.op, r.cards, r.errors, r.mbPerSec, r.busMbPerSec, r.scaling,
+                (i + 1 < stripeResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"shared_bus\": [\n");
+    for(size_t i = 0; i < sharedResults.size(); ++i) {
+        const SharedBusResult& r = sharedResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"op\": \"%s\", \"cards\": %u, \"errors\": %u, \"bus_mb_per_s\": %.3f, "
+                   "\"transactions\": %u, \"contended\": %u, \"clock_changes\": %u, \"mode_changes\": %u, "
+                   "\"yields\": %u, \"sensor_max_wait_us\": %.1f}%s\n",
+                r.config, r.op, r.cards, r.errors, r.busMbPerSec, r.transactions, r.contended, r.clockChanges,
+                r.modeChanges, r.yields, r.sensorMaxWaitUs, (i + 1 < sharedResults.size()) ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"disk_registry\": [\n");
+    for(size_t i = 0; i < diskResults.size(); ++i) {
+        const DiskIOResult& r = diskResults[i];
+        fprintf(f, "    {\"config\": \"%s\", \"errors\": %u, \"ns_per_call\": %.2f}%s\n", r.config, r.errors,
+                r.nsPerCall, (i + 1 < diskResults.size()) ? "," : "");
+    }
+    const auto& read  = stats.snapshot.op(sd::Operation::READ);
+    const auto& write = stats.snapshot.op(sd::Operation::WRITE);
+    fprintf(f, "  ],\n  \"stats\": {\"no_stats_mb_per_s\": %.3f, \"stats_mb_per_s\": %.3f, \"trace_mb_per_s\": %.3f, "
+               "\"errors\": %u, "
+               "\"read_mean_us\": %u, \"read_max_us\": %u, \"write_mean_us\": %u, \"write_max_us\": %u, "
+               "\"busy_waits\": %u, \"busy_us\": %llu}\n}\n",
+            stats.noStatsMbPerSec, stats.statsMbPerSec, stats.traceMbPerSec, stats.errors, read.meanUs(), read.maxUs, write.meanUs(),
+            write.maxUs, stats.snapshot.busyWaits, (unsigned long long)stats.snapshot.busyUs);
+
+    if(f != stdout) { std::fclose(f); }
+    return true;
+}
+
+}   // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchConfig cfg;
+    for(int i = 1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+            cfg.jsonPath = argv[++i];
+        }
+        else if(!std::strcmp(argv[i], "--blocks") && i + 1 < argc) {
+            cfg.blocksPerRun = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!std::strcmp(argv[i], "--clock") && i + 1 < argc) {
+            cfg.clockHz = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+            cfg.tracePath = argv[++i];
+        }
+        else {
+            printf("Usage: SDCardBench [--json FILE] [--blocks N] [--clock HZ] [--trace FILE]\n");
+            return 1;
+        }
+    }
+
+    printf("CRC16 over one 512 byte block:\n");
+    std::vector<CRCResult> crcResults;
+    runCRC<sd::ShiftedCRC>("ShiftedCRC", crcResults);
+    runCRC<sd::tableBasedCRC>("tableBasedCRC", crcResults);
+    runCRC<sd::SlicedCRC>("SlicedCRC", crcResults);
+    printf("\n");
+
+    printf("%-14s %-5s %-10s %5s  %9s %9s  %9s %9s  %9s %9s  %6s %6s\n",
+           "policy", "op", "pattern", "blks", "MB/s", "bus MB/s", "p50 us", "p99 us",
+           "bus p50", "bus p99", "B/B", "bus/wall");
+
+    std::vector<Result> results;
+    runPolicy<sd::noCRC>("noCRC", cfg, results);
+    runPolicy<sd::ShiftedCRC>("ShiftedCRC", cfg, results);
+    runPolicy<sd::tableBasedCRC>("tableBasedCRC", cfg, results);
+    runPolicy<sd::SlicedCRC>("SlicedCRC", cfg, results);
+    runPolicy<sd::CRCChecked<sd::SlicedCRC>>("CRCChecked", cfg, results);
+
+    printf("\nAsynchronous API, sequential:\n");
+    printf("%-14s %-5s %5s  %9s  %6s\n", "policy", "op", "blks", "MB/s", "cpu");
+    std::vector<AsyncResult> asyncResults;
+    runAsync<sd::noCRC>("noCRC", cfg, asyncResults);
+    runAsync<sd::SlicedCRC>("SlicedCRC", cfg, asyncResults);
+
+    printf("\nMetadata workload through BlockCache:\n");
+    printf("%-14s %6s  %10s %9s  %6s\n", "config", "ops", "bus ms", "commands", "hits");
+    std::vector<CacheResult> cacheResults;
+    runCache<sd::LRUEviction>("uncached", cfg, false, cacheResults);
+    runCache<sd::LRUEviction>("LRU", cfg, true, cacheResults);
+    runCache<sd::ClockEviction>("CLOCK", cfg, true, cacheResults);
+
+    printf("\nSequential streaming, one call per cluster:\n");
+    printf("%-5s %-14s %5s  %9s %9s\n", "op", "config", "blks", "bus MB/s", "commands");
+    std::vector<StreamResult> streamResults;
+    for(const uint32_t count : { 1u, 8u, 64u }) {
+        runStream("readBlocks", cfg, count, streamResults);
+        runStream("stream", cfg, count, streamResults);
+        runStream("prefetch", cfg, count, streamResults);
+    }
+    runLogger("writeBlocks", cfg, streamResults);
+    runLogger("session", cfg, streamResults);
+    runLogger("hinted", cfg, streamResults);
+
+    printf("\nResponse, token and busy polling, random addresses:\n");
+    printf("%-12s %-5s %5s  %10s %9s %6s\n", "shim", "op", "blks", "calls/blk", "bus MB/s", "B/B");
+    std::vector<PollResult> pollResults;
+    runPoll<sd::sim::SimShim>("byte", cfg, pollResults);
+    runPoll<sd::sim::SimPollShim>("bulk", cfg, pollResults);
+
+    printf("\nBus clock, sequential %u block calls:\n", 64u);
+    printf("%-12s %-5s %9s %8s %9s\n", "config", "op", "clock MHz", "init ms", "bus MB/s");
+    std::vector<ClockResult> clockResults;
+    runClock<sd::sim::SimShim>("fixed", cfg, true, clockResults);
+    runClock<sd::sim::SimClockShim>("TRAN_SPEED", cfg, false, clockResults);
+    runClock<sd::sim::SimClockShim>("High-Speed", cfg, true, clockResults);
+
+    printf("\nBusy waits:\n");
+    printf("%-18s %-5s %5s  %10s %9s\n", "policy", "op", "blks", "polls/wait", "bus MB/s");
+    std::vector<BusyResult> busyResults;
+    runBusy<sd::defaultTimeouts>("defaultTimeouts", cfg, busyResults);
+    runBusy<sd::AdaptiveTimeouts<SimTime, SimSleep>>("AdaptiveTimeouts", cfg, busyResults);
+
+    printf("\nPeripheral CRC, %u block calls, a corrupted byte in every 5th block transfer:\n", 8u);
+    printf("%-16s %-5s %9s %9s %6s %6s %6s\n", "config", "op", "host B/blk", "queries", "inject", "caught", "missed");
+    std::vector<PeripheralResult> peripheralResults;
+    runPeripheral<sd::sim::SimCRCShim, sd::CRCChecked<sd::SlicedCRC>>("host CRC16", cfg, true, peripheralResults);
+    runPeripheral<sd::sim::SimCRCShim, sd::CRCChecked<sd::PeripheralCRC<sd::SlicedCRC>>>("CRC unit", cfg, true,
+                                                                                        peripheralResults);
+    runPeripheral<sd::sim::SimLinkShim, sd::noCRC>("link unchecked", cfg, false, peripheralResults);
+    runPeripheral<sd::sim::SimLinkShim, sd::PeripheralCRC<sd::noCRC>>("link CRC", cfg, true, peripheralResults);
+
+    printf("\nStriped volume, sequential %u block calls, %u block stripes:\n", 128u, 16u);
+    printf("%-16s %-5s %5s  %9s %9s %7s\n", "config", "op", "cards", "MB/s", "bus MB/s", "scaling");
+    std::vector<StripeResult> stripeResults;
+    runStripe<1, sd::ThreadBuses<1>>("1 card", cfg, stripeResults);
+    runStripe<2, sd::ThreadBuses<2>>("2 cards", cfg, stripeResults);
+    runStripe<4, sd::ThreadBuses<4>>("4 cards", cfg, stripeResults);
+    runStripe<4, sd::SerialBuses>("4 cards, serial", cfg, stripeResults);
+
+    printf("\nShared bus, sequential %u block calls, a thread per card, yielding while busy unless polling:\n", 32u);
+    printf("%-18s %-5s %5s  %9s %8s %9s %7s %6s %7s %9s\n", "config", "op", "cards", "bus MB/s", "transact",
+           "contended", "clocks", "modes", "yields", "sensor us");
+    std::vector<SharedBusResult> sharedResults;
+    runSharedBus<YieldingTimeouts>("1 card", 1, false, cfg, sharedResults);
+    runSharedBus<sd::defaultTimeouts>("2 cards, polling", 2, false, cfg, sharedResults);
+    runSharedBus<YieldingTimeouts>("2 cards", 2, false, cfg, sharedResults);
+    runSharedBus<YieldingTimeouts>("2 cards + sensor", 2, true, cfg, sharedResults);
+
+    printf("\nDisk registry, drive checks and single block RamDisk reads:\n");
+    printf("%-18s %6s %9s\n", "config", "errors", "ns/call");
+    std::vector<DiskIOResult> diskResults;
+    runDiskRegistry(cfg, diskResults);
+
+    printf("\nStatistics policy:\n");
+    StatsResult stats;
+    runStats(cfg, stats);
+
+    const bool traceFailed = cfg.tracePath && !writeTraceFile(cfg);
+
+    if(!writeJson(cfg, results, crcResults, asyncResults, cacheResults, streamResults, pollResults, clockResults, busyResults,
+                  peripheralResults, stripeResults, sharedResults, diskResults, stats)) { return 1; }
+
+    const bool failed = std::any_of(results.begin(), results.end(), [](const Result& r) { return r.errors > 0; })
+                     || std::any_of(asyncResults.begin(), asyncResults.end(), [](const AsyncResult& r) { return r.errors > 0; })
+                     || std::any_of(cacheResults.begin(), cacheResults.end(), [](const CacheResult& r) { return r.errors > 0; })
+                     || std::any_of(streamResults.begin(), streamResults.end(), [](const StreamResult& r) { return r.errors > 0; })
+                     || std::any_of(pollResults.begin(), pollResults.end(), [](const PollResult& r) { return r.errors > 0; })
+                     || std::any_of(clockResults.begin(), clockResults.end(), [](const ClockResult& r) { return r.errors > 0; })
+                     || std::any_of(busyResults.begin(), busyResults.end(), [](const BusyResult& r) { return r.errors > 0; })
+                     || std::any_of(peripheralResults.begin(), peripheralResults.end(), [](const PeripheralResult& r) { return r.errors > 0; })
+                     || std::any_of(stripeResults.begin(), stripeResults.end(), [](const StripeResult& r) { return r.errors > 0; })
+                     || std::any_of(sharedResults.begin(), sharedResults.end(), [](const SharedBusResult& r) { return r.errors > 0; })
+                     || std::any_of(diskResults.begin(), diskResults.end(), [](const DiskIOResult& r) { return r.errors > 0; })
+                     || stats.errors > 0 || traceFailed
+                     || std::any_of(crcResults.begin(), crcResults.end(), [](const CRCResult& r) { return !r.matches; });
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,154 @@
+// Check and benchmark of the C++20 coroutine front-end (SDCoroutine.h) against the simulated card.
+//
+// Built as C++20, the rest of the tree is C++17 and compiles SDCoroutine.h out. Two logger tasks share one card,
+// each writing its own region with co_writeBlocks, waiting with co_waitNotBusy and reading the blocks back with
+// co_readBlocks, while a third task only yields. The data read back is compared with what was written, and the
+// number of scheduler passes the yielding task got while the loggers were suspended on the card is reported.
+// Last, a scheduler is destroyed while a task waits on a transfer, and the card must be idle and usable after it.
+//
+// usage: SDCoroutineBench [--blocks N] [--count N]
+//   --blocks N    blocks written and read back by each logger (default 512)
+//   --count N     blocks per call (default 8)
+
+#define SPISD_DEBUG(...)  do { } while(0)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "SDCard.hpp"
+#include "SDFastCRC.h"
+#include "SDCoroutine.h"
+#include "SDSimShim.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "SDCoroutineBench needs a compiler with C++20 coroutines"
+#endif
+
+using Card = sd::SpiCard<sd::sim::SimShim, sd::SlicedCRC, sd::defaultTimeouts>;
+
+struct LoggerResult {
+    uint32_t calls   = 0;
+    uint32_t blocks  = 0;
+    uint32_t errors  = 0;       //< failed calls and blocks read back with the wrong contents
+    bool     done    = false;
+};
+
+constexpr uint32_t IMAGE_BLOCKS = 8192;
+
+sd::co::Task<> logger(Card& card, const uint32_t firstLBA, const uint32_t blocks, const uint32_t count,
+                      const uint32_t seed, LoggerResult& result) {
+    std::vector<uint8_t> src(size_t(count) * 512), back(size_t(count) * 512);
+    std::mt19937 rng(seed);
+
+    for(uint32_t done = 0; done + count <= blocks; done += count) {
+        for(auto& b : src) { b = static_cast<uint8_t>(rng()); }
+        const uint32_t lba = firstLBA + done;
+
+        result.calls++;
+        if(co_await sd::co::co_writeBlocks(card, lba, src.data(), count) != static_cast<ssize_t>(count)) {
+            result.errors++;
+            continue;
+        }
+        if(co_await sd::co::co_waitNotBusy(card) != 0) { result.errors++; }
+
+        std::memset(back.data(), 0, back.size());
+        if(co_await sd::co::co_readBlocks(card, lba, back.data(), count) != static_cast<ssize_t>(count)) {
+            result.errors++;
+            continue;
+        }
+        for(uint32_t i = 0; i < count; ++i) {
+            if(std::memcmp(src.data() + size_t(i) * 512, back.data() + size_t(i) * 512, 512) != 0) { result.errors++; }
+        }
+        result.blocks += count;
+    }
+    result.done = true;
+}
+
+/// counts the passes it gets until every logger has finished
+sd::co::Task<> ticker(const LoggerResult* const loggers, const size_t LEN, uint32_t& ticks) {
+    const auto finished = [=] {
+        for(size_t i = 0; i < LEN; ++i) {
+            if(!loggers[i].done) { return false; }
+        }
+        return true;
+    };
+    while(!finished()) {
+        ticks++;
+        co_await sd::co::yield();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t blocks = 512;
+    uint32_t count  = 8;
+    for(int i = 1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "--blocks") && i + 1 < argc) {
+            blocks = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        }
+        else if(!std::strcmp(argv[i], "--count") && i + 1 < argc) {
+            count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        }
+        else {
+            printf("Usage: SDCoroutineBench [--blocks N] [--count N]\n");
+            return 1;
+        }
+    }
+    if(count == 0 || blocks < count || blocks > IMAGE_BLOCKS / 2) {
+        fprintf(stderr, "need 0 < count <= blocks <= %u\n", IMAGE_BLOCKS / 2);
+        return 1;
+    }
+
+    sd::sim::Image image(IMAGE_BLOCKS);
+    sd::sim::CardModel model(image);
+    Card card(model);
+    if(!card.begin()) {
+        fprintf(stderr, "card init failed\n");
+        return 2;
+    }
+
+    LoggerResult loggers[2];
+    uint32_t ticks = 0;
+    sd::co::Scheduler sched;
+    sched.spawn(logger(card, 0, blocks, count, 0x5D01, loggers[0]));
+    sched.spawn(logger(card, IMAGE_BLOCKS / 2, blocks, count, 0x5D02, loggers[1]));
+    sched.spawn(ticker(loggers, 2, ticks));
+
+    model.resetStats();
+    uint32_t passes = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    while(sched.runOnce()) { passes++; }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const auto report  = model.report();
+    const double bytes = 2.0 * (loggers[0].blocks + loggers[1].blocks) * 512;    // written and read back
+    printf("Coroutine front-end, 2 loggers on one card, %u block calls:\n", count);
+    printf("%-8s %6s %6s %6s\n", "task", "calls", "blocks", "errors");
+    for(size_t i = 0; i < 2; ++i) {
+        printf("logger%-2zu %6u %6u %6u%s\n", i, loggers[i].calls, loggers[i].blocks, loggers[i].errors,
+               loggers[i].errors ? "  ERRORS" : "");
+    }
+    printf("scheduler passes %u, yielding task ran %u, bus MB/s %.2f, wall %.1f ms\n", passes, ticks,
+           bytes / report.busSeconds / 1e6, std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+    // a scheduler destroyed while a logger waits on a transfer: the transfer is drained, the card stays usable
+    bool abandoned = false;
+    {
+        LoggerResult left;
+        sd::co::Scheduler short_lived;
+        short_lived.spawn(logger(card, 0, blocks, count, 0x5D03, left));
+        for(int i = 0; i < 2; ++i) { short_lived.runOnce(); }
+        abandoned = left.calls > 0 && !left.done;
+    }
+    std::vector<uint8_t> check(size_t(count) * 512);
+    const bool drained = abandoned && card.pollAsync() && card.readBlocks(0, check.data(), count) == static_cast<ssize_t>(count);
+    printf("scheduler destroyed mid-transfer: %s\n", drained ? "drained" : "ERRORS");
+
+    const bool failed = loggers[0].errors || loggers[1].errors || loggers[0].blocks != blocks / count * count
+                     || loggers[1].blocks != blocks / count * count || !drained;
+    return failed ? 2 : 0;
+}
@@ -107,6 +107,18 @@ DWORD writeToSerialPort(HANDLE hSerial, const char * data, int length)
     return dwBytesRead;
 }
 
+void writevToSerialPort(HANDLE hSerial, struct iovec *iov, int cnt)
+{
+    int i;
+    for (i = 0; i < cnt; i++)
+        writeToSerialPort(hSerial, (const char *)iov[i].iov_base, (int)iov[i].iov_len);
+}
+
+int setSerialLowLatency(HANDLE hSerial, int enable)
+{
+    return -1;
+}
+
 void closeSerialPort(HANDLE hSerial)
 {
     CloseHandle(hSerial);
@@ -114,14 +126,23 @@ void closeSerialPort(HANDLE hSerial)
 
 #else               // }{
 
+#include <poll.h>
 #include <termios.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
+
+// The port is non-blocking with VMIN = VTIME = 0, so read() only ever returns what the tty already holds. All
+// waiting happens in poll(): the thread sleeps until the adapter answers, and a silent adapter times out after
+// SPI_SERIAL_TIMEOUT_MS instead of hanging the host.
 
 int openSerialPort(const char *portname)
 {
   struct termios Settings;
   int fd;
   
-  fd = open(portname, O_RDWR | O_NOCTTY);
+  fd = open(portname, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (fd == -1) {
     perror(portname);
     return -1;
@@ -136,43 +157,133 @@ int openSerialPort(const char *portname)
   cfsetospeed(&Settings, B460800);
 
   cfmakeraw(&Settings);
-  Settings.c_cc[VMIN] = 1;
+  Settings.c_cflag |= CLOCAL | CREAD;
+  Settings.c_cc[VMIN] = 0;
+  Settings.c_cc[VTIME] = 0;
   if (tcsetattr(fd, TCSANOW, &Settings) != 0) {
     perror("Serial settings");
+    close(fd);
     return -1;
   }
+  tcflush(fd, TCIOFLUSH);
 
   return fd;
 }
 
+// wait until fd is ready for events. Returns 0 on timeout, hangup or error
+static int waitSerialPort(int fd, short events)
+{
+  struct pollfd p;
+  p.fd = fd;
+  p.events = events;
+  for (;;) {
+    p.revents = 0;
+    int r = poll(&p, 1, SPI_SERIAL_TIMEOUT_MS);
+    if (r > 0)
+      return (p.revents & events) != 0;
+    if (r == 0)
+      return 0;
+    if (errno != EINTR) {
+      perror("poll");
+      return 0;
+    }
+  }
+}
+
 size_t readFromSerialPort(int fd, char *b, size_t s)
 {
-  ssize_t n, t;
-  t = 0;
+  size_t t = 0;
+  int woken = 0;
   while (t < s) {
-    n = read(fd, b + t, s);
-    if (n > 0)
+    ssize_t n = read(fd, b + t, s - t);
+    if (n > 0) {
       t += n;
+      woken = 0;
+      continue;
+    }
+    if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      perror("read");
+      break;
+    }
+    // readable but nothing to read: the adapter is gone
+    if ((n == 0) && woken)
+      break;
+    if (!waitSerialPort(fd, POLLIN))
+      break;
+    woken = 1;
   }
 #ifdef VERBOSE
-  printf(" READ %d %d: ", (int)s, (int)n);
-  int i;
-  for (i = 0; i < s; i++)
+  printf(" READ %d %d: ", (int)s, (int)t);
+  size_t i;
+  for (i = 0; i < t; i++)
     printf("%02x ", 0xff & b[i]);
   printf("\n");
 #endif
-  return s;
+  return t;
 }
 
-void writeToSerialPort(int fd, const char *b, size_t s)
+// write all of iov, waiting in poll() whenever the tty's output buffer is full. The iovecs are consumed
+void writevToSerialPort(int fd, struct iovec *iov, int cnt)
 {
-  write(fd, b, s);
 #ifdef VERBOSE
-  printf("WRITE %u: ", (int)s);
-  int i;
-  for (i = 0; i < s; i++)
-    printf("%02x ", 0xff & b[i]);
-  printf("\n");
+  int k;
+  for (k = 0; k < cnt; k++) {
+    printf("WRITE %u: ", (int)iov[k].iov_len);
+    size_t i;
+    for (i = 0; i < iov[k].iov_len; i++)
+      printf("%02x ", 0xff & ((const char *)iov[k].iov_base)[i]);
+    printf("\n");
+  }
+#endif
+  while (cnt > 0) {
+    ssize_t n = writev(fd, iov, cnt);
+    if (n < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        if (!waitSerialPort(fd, POLLOUT))
+          return;
+        continue;
+      }
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      return;
+    }
+    while ((cnt > 0) && ((size_t)n >= iov->iov_len)) {
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+void writeToSerialPort(int fd, const char *b, size_t s)
+{
+  struct iovec iov;
+  iov.iov_base = (void *)b;
+  iov.iov_len = s;
+  writevToSerialPort(fd, &iov, 1);
+}
+
+int setSerialLowLatency(int fd, int enable)
+{
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+  // on FTDI based adapters like the SPIDriver this also drops the USB latency timer from 16ms to 1ms
+  struct serial_struct ss;
+  if (ioctl(fd, TIOCGSERIAL, &ss) != 0)
+    return -1;
+  if (enable)
+    ss.flags |= ASYNC_LOW_LATENCY;
+  else
+    ss.flags &= ~ASYNC_LOW_LATENCY;
+  return ioctl(fd, TIOCSSERIAL, &ss);
+#else
+  (void)fd;
+  (void)enable;
+  return -1;
 #endif
 }
 #endif              // }
@@ -227,6 +338,131 @@ static void crc_update(SPIDriver *sd, const char *data, size_t data_len)
     sd->e_ccitt_crc = crc;
 }
 
+// ******************************  Batching  **********************************
+
+// Every transfer is queued as a list of iovecs. Protocol bytes are copied to sd->txbuf; outside a batch the
+// caller's MOSI buffer is still alive when the queue is sent, so payloads are referenced in place and the headers
+// and payloads go out with one writev. A queued read records where its response goes; spi_flush sends the whole
+// queue, reads every response with one bulk read and scatters them. Outside a batch each call flushes on return,
+// which still turns a long transfer into one round-trip instead of one per 64 bytes.
+
+static void batch_reset(SPIDriver *sd)
+{
+  sd->txlen = 0;
+  sd->rxlen = 0;
+  sd->nseg = 0;
+  sd->niov = 0;
+}
+
+static void batch_done(SPIDriver *sd)
+{
+  if (!sd->batching)
+    spi_flush(sd);
+}
+
+// queue len bytes, either copied to txbuf (src == NULL reserves them) or referenced in place
+static char *batch_append(SPIDriver *sd, const char *src, size_t len, int copy)
+{
+  struct iovec *last = sd->niov ? &sd->iov[sd->niov - 1] : NULL;
+  char *p = sd->txbuf + sd->txlen;
+
+  if (!copy) {
+    sd->iov[sd->niov].iov_base = (void *)src;
+    sd->iov[sd->niov++].iov_len = len;
+    return (char *)src;
+  }
+  if (last && ((char *)last->iov_base + last->iov_len == p)) {
+    last->iov_len += len;
+  } else {
+    sd->iov[sd->niov].iov_base = p;
+    sd->iov[sd->niov++].iov_len = len;
+  }
+  if (src)
+    memcpy(p, src, len);
+  sd->txlen += len;
+  return p;
+}
+
+// queue a bare protocol command that has no payload ('s', 'u', 'a', 'b')
+static void batch_command(SPIDriver *sd, const char *cmd, size_t len)
+{
+  if ((sd->txlen + len > SPI_BATCH_SIZE) || (sd->niov + 1 > SPI_BATCH_IOVECS))
+    spi_flush(sd);
+  batch_append(sd, cmd, len, 1);
+}
+
+// queue transfers of up to 64 bytes. op is 0xc0 (write) or 0x80 (write and read back into dst)
+static void batch_transfer(SPIDriver *sd, char op, const char *mosi, char *dst, size_t nn)
+{
+  // a payload can only be sent from the caller's buffer if the queue goes out before the call returns
+  int copy = sd->batching || !mosi;
+  size_t i;
+  for (i = 0; i < nn; i += 64) {
+    size_t len = ((nn - i) < 64) ? (nn - i) : 64;
+    if ((sd->txlen + 1 + (copy ? len : 0) > SPI_BATCH_SIZE) ||
+        (dst && (sd->rxlen + len > SPI_BATCH_SIZE)) ||
+        (sd->nseg == SPI_BATCH_SEGMENTS) ||
+        (sd->niov + 2 > SPI_BATCH_IOVECS))
+      spi_flush(sd);
+
+    SPIBatchSegment *seg = &sd->seg[sd->nseg++];
+    char header = (char)(op + len - 1);
+    batch_append(sd, &header, 1, 1);
+    seg->dst = dst ? dst + i : NULL;
+    seg->len = len;
+    if (mosi) {
+      seg->mosi = batch_append(sd, mosi + i, len, copy);
+    } else {
+      seg->mosi = memset(batch_append(sd, NULL, len, 1), 0, len);
+    }
+    if (dst)
+      sd->rxlen += len;
+  }
+}
+
+void spi_batch_begin(SPIDriver *sd)
+{
+  sd->batching = 1;
+}
+
+void spi_batch_end(SPIDriver *sd)
+{
+  sd->batching = 0;
+  spi_flush(sd);
+}
+
+void spi_flush(SPIDriver *sd)
+{
+  size_t i, got = 0, rx = 0;
+
+  if (sd->niov)
+    writevToSerialPort(sd->port, sd->iov, (int)sd->niov);
+  while (got < sd->rxlen) {
+    size_t n = readFromSerialPort(sd->port, sd->rxbuf + got, sd->rxlen - got);
+    if (n == 0)
+      break;
+    got += n;
+  }
+  // an adapter that stopped answering reads as an idle bus
+  if (got < sd->rxlen)
+    memset(sd->rxbuf + got, 0xff, sd->rxlen - got);
+
+  // hand out the responses and replay the host CRC in transfer order: MOSI then MISO for each chunk.
+  // The MOSI bytes are hashed before a writeread overwrites them with the response
+  for (i = 0; i < sd->nseg; i++) {
+    SPIBatchSegment *seg = &sd->seg[i];
+    if (sd->host_crc)
+      crc_update(sd, seg->mosi, seg->len);
+    if (seg->dst) {
+      memcpy(seg->dst, sd->rxbuf + rx, seg->len);
+      if (sd->host_crc)
+        crc_update(sd, seg->dst, seg->len);
+      rx += seg->len;
+    }
+  }
+  batch_reset(sd);
+}
+
 // ******************************  SPIDriver  *********************************
 
 void spi_connect(SPIDriver *sd, const char* portname)
@@ -234,6 +470,9 @@ void spi_connect(SPIDriver *sd, const char* portname)
   int i;
 
   sd->connected = 0;
+  sd->batching = 0;
+  sd->host_crc = 1;
+  batch_reset(sd);
   sd->port = openSerialPort(portname);
 #if !defined(WIN32)
   if (sd->port == -1)
@@ -257,11 +496,17 @@ void spi_connect(SPIDriver *sd, const char* portname)
   sd->e_ccitt_crc = sd->ccitt_crc;
 }
 
+int spi_lowlatency(SPIDriver *sd, int enable)
+{
+  return setSerialLowLatency(sd->port, enable);
+}
+
 void spi_getstatus(SPIDriver *sd)
 {
   char readbuffer[100];
   int bytesRead;
 
+  spi_flush(sd);
   writeToSerialPort(sd->port, "?", 1);
   bytesRead = readFromSerialPort(sd->port, readbuffer, 80);
   readbuffer[bytesRead] = 0;
@@ -280,69 +525,72 @@ void spi_getstatus(SPIDriver *sd)
     );
 }
 
+void spi_host_crc(SPIDriver *sd, int enable)
+{
+  spi_flush(sd);
+  if (enable && !sd->host_crc) {
+    spi_getstatus(sd);
+    sd->e_ccitt_crc = sd->ccitt_crc;
+  }
+  sd->host_crc = enable;
+}
+
+int spi_crc_check(SPIDriver *sd)
+{
+  int ok;
+
+  spi_getstatus(sd);
+  ok = sd->host_crc && (sd->e_ccitt_crc == sd->ccitt_crc);
+  sd->e_ccitt_crc = sd->ccitt_crc;
+  return ok;
+}
+
 void spi_sel(SPIDriver *sd)
 {
-  writeToSerialPort(sd->port, "s", 1);
+  batch_command(sd, "s", 1);
+  batch_done(sd);
   sd->cs = 0;
 }
 
 void spi_unsel(SPIDriver *sd)
 {
-  writeToSerialPort(sd->port, "u", 1);
+  batch_command(sd, "u", 1);
+  batch_done(sd);
   sd->cs = 1;
 }
 
 void spi_seta(SPIDriver *sd, char v)
 {
   char cmd[2] = {'a', v};
-  writeToSerialPort(sd->port, cmd, 2);
+  batch_command(sd, cmd, 2);
+  batch_done(sd);
   sd->a = v;
 }
 
 void spi_setb(SPIDriver *sd, char v)
 {
   char cmd[2] = {'b', v};
-  writeToSerialPort(sd->port, cmd, 2);
+  batch_command(sd, cmd, 2);
+  batch_done(sd);
   sd->b = v;
 }
 
 void spi_write(SPIDriver *sd, const char bytes[], size_t nn)
 {
-  size_t i;
-  for (i = 0; i < nn; i += 64) {
-    size_t len = ((nn - i) < 64) ? (nn - i) : 64;
-    char cmd[65] = {(char)(0xc0 + len - 1)};
-    memcpy(cmd + 1, bytes + i, len);
-    writeToSerialPort(sd->port, cmd, 1 + len);
-  }
-  crc_update(sd, bytes, nn);
+  batch_transfer(sd, (char)0xc0, bytes, NULL, nn);
+  batch_done(sd);
 }
 
 void spi_read(SPIDriver *sd, char bytes[], size_t nn)
 {
-  size_t i;
-  for (i = 0; i < nn; i += 64) {
-    size_t len = ((nn - i) < 64) ? (nn - i) : 64;
-    char cmd[65] = {(char)(0x80 + len - 1), 0};
-    writeToSerialPort(sd->port, cmd, 1 + len);
-    crc_update(sd, cmd + 1, len);
-    readFromSerialPort(sd->port, bytes + i, len);
-    crc_update(sd, bytes + i, len);
-  }
+  batch_transfer(sd, (char)0x80, NULL, bytes, nn);
+  batch_done(sd);
 }
 
 void spi_writeread(SPIDriver *sd, char bytes[], size_t nn)
 {
-  size_t i;
-  for (i = 0; i < nn; i += 64) {
-    size_t len = ((nn - i) < 64) ? (nn - i) : 64;
-    char cmd[65] = {(char)(0x80 + len - 1)};
-    memcpy(cmd + 1, bytes + i, len);
-    writeToSerialPort(sd->port, cmd, 1 + len);
-    crc_update(sd, cmd + 1, len);
-    readFromSerialPort(sd->port, bytes + i, len);
-    crc_update(sd, bytes + i, len);
-  }
+  batch_transfer(sd, (char)0x80, bytes, bytes, nn);
+  batch_done(sd);
 }
 
 int spi_commands(SPIDriver *sd, int argc, char *argv[])
@@ -1,14 +1,31 @@
 #ifndef SPIDRIVER_H
 #define SPIDRIVER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(WIN32)
 #include <windows.h>
+struct iovec {
+  void      *iov_base;
+  size_t    iov_len;
+};
 #else
+#include <sys/uio.h>
 #define HANDLE int
 #endif
 
+#define SPI_BATCH_SIZE     4096   // protocol bytes queued before a batch is sent
+#define SPI_BATCH_SEGMENTS 128    // transfers queued before a batch is sent
+#define SPI_BATCH_IOVECS   (2 * SPI_BATCH_SEGMENTS + 1)  // pieces of one writev: header runs and payloads
+#define SPI_SERIAL_TIMEOUT_MS 1000  // a read gives up when the adapter is silent this long
+
+typedef struct {
+  char      *dst;         // where the MISO bytes go, NULL for a write
+  const char *mosi;       // the MOSI bytes, in txbuf or the caller's buffer
+  size_t    len;
+} SPIBatchSegment;
+
 typedef struct {
   int connected;          // Set to 1 when connected
   HANDLE port;
@@ -22,10 +39,21 @@ typedef struct {
   unsigned int
             ccitt_crc,    // Hardware CCITT CRC
             e_ccitt_crc;  // Host CCITT CRC, should match
+  int       host_crc;     // keep e_ccitt_crc, see spi_host_crc
+
+  int       batching;     // set by spi_batch_begin
+  char      txbuf[SPI_BATCH_SIZE];  // queued protocol bytes
+  char      rxbuf[SPI_BATCH_SIZE];  // responses to the queued reads
+  size_t    txlen, rxlen, nseg, niov;
+  SPIBatchSegment seg[SPI_BATCH_SEGMENTS];
+  struct iovec iov[SPI_BATCH_IOVECS];     // what the next flush writes, in order
 } SPIDriver;
 
 void spi_connect(SPIDriver *sd, const char* portname);
 void spi_getstatus(SPIDriver *sd);
+// ask the serial driver to deliver bytes as soon as they arrive instead of batching them on a timer.
+// Returns 0 if the port accepted the flag, it is only supported on Linux
+int spi_lowlatency(SPIDriver *sd, int enable);
 void spi_sel(SPIDriver *sd);
 void spi_unsel(SPIDriver *sd);
 void spi_seta(SPIDriver *sd, char v);
@@ -34,6 +62,22 @@ void spi_write(SPIDriver *sd, const char bytes[], size_t nn);
 void spi_read(SPIDriver *sd, char bytes[], size_t nn);
 void spi_writeread(SPIDriver *sd, char bytes[], size_t nn);
 
+// Batched transfers. Between spi_batch_begin and spi_batch_end the calls above only queue their bytes. The queue
+// goes out with one write to the port, and all responses come back with one bulk read, when spi_flush or
+// spi_batch_end is called or the queue fills. Read buffers are filled at that point.
+void spi_batch_begin(SPIDriver *sd);
+void spi_batch_end(SPIDriver *sd);
+void spi_flush(SPIDriver *sd);
+
+// The adapter keeps a CCITT CRC of every byte it moves (MOSI, then MISO for a read) and reports it in the status.
+// The host keeps the same CRC of what it sent and received in e_ccitt_crc, so one status query checks a whole batch.
+// spi_host_crc turns the host's copy on (the default) or off: it costs a pass over every byte, so turn it off when
+// nothing calls spi_crc_check. Turning it on synchronizes it with the adapter.
+void spi_host_crc(SPIDriver *sd, int enable);
+// flush, then compare the adapter's CRC with the host's. Returns 1 if they match, 0 if a byte was lost or
+// corrupted on the way (or the host CRC is off), and synchronizes them for the next check
+int spi_crc_check(SPIDriver *sd);
+
 int spi_commands(SPIDriver *sd, int argc, char *argv[]);
 
 #endif
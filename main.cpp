@@ -2,11 +2,16 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cctype>
+#include <cstring>
 #include <array>
 #include <time.h>
 #include <SDCard_info.h>
 #include "SDPolicies.h"
 #include "SDCard.hpp"
+#include "SDBlockCache.h"
+#include "SDStreaming.h"
+#include "SDBlockDevices.h"
+#include "SDDiskIO.h"
 
 //#undef _WIN32
 
@@ -16,7 +21,25 @@
 SPIDriver spiTester;
 std::string SpiDriverPort;
 
-sd::SpiCard<SPIShim, sd::noCRC> sdcard;
+// the adapter's running CRC checks every operation with one status query, the card's data CRC16 is not computed
+sd::SpiCard<SPIShim, sd::PeripheralCRC<sd::noCRC>> sdcard;
+sd::StreamingCard<decltype(sdcard)> sdstream(sdcard);
+sd::BlockCache<decltype(sdstream)> sdcache(sdstream);
+
+#if FF_VOLUMES > 1
+// drive 0 is the card, drive 1 a RAM disk for scratch files, drive 2 a card image named on the command line
+constexpr uint32_t RAM_DISK_BLOCKS = 256;
+static uint8_t ramDiskMem[RAM_DISK_BLOCKS * 512];
+sd::RamDisk ramdisk(ramDiskMem, RAM_DISK_BLOCKS);
+sd::DiskRegistry<decltype(sdcache), sd::RamDisk, sd::FileDisk> disks(&sdcache, &ramdisk, nullptr);
+#else
+sd::DiskRegistry<decltype(sdcache)> disks(&sdcache);
+#endif
+
+#if FF_MULTI_PARTITION
+// volumes 0: and 3: are the first and second partition of the card, 1: is the RAM disk and 2: the image
+PARTITION VolToPart[FF_VOLUMES] = { {0, 0}, {1, 0}, {2, 0}, {0, 2} };
+#endif
 
 int test_diskio (
         BYTE pdrv,      /* Physical drive number to be checked (all data on the drive will be lost) */
@@ -25,6 +48,10 @@ int test_diskio (
         UINT sz_buff    /* Size of the working buffer in unit of byte */
 );
 
+/// idle work between disk operations: a CMD25 session left open by the last write keeps CS low and its blocks are
+/// not committed, poll() ends it once it has been idle for the card's streamTimeout
+static void idle() { sdstream.poll(); }
+
 /* Pseudo random number generator */
 /* 0:Initialize, !0:Read */
 static DWORD pn ( DWORD pns);
@@ -32,38 +59,45 @@ static DWORD pn ( DWORD pns);
 int main(int argc, char *argv[])
 {
     if (argc < 2) {
-        printf("Usage: spicl <PORTNAME>\n");
+        printf("Usage: spicl <PORTNAME> [IMAGE]\n");
         exit(1);
     }
     SpiDriverPort = std::string(argv[1]);
+#if FF_VOLUMES > 1
+    sd::FileDisk image(argc > 2 ? argv[2] : nullptr);
+    if(argc > 2) { disks.attach<2>(&image); }
+#endif
 
     int rc;
     DWORD buff[FF_MAX_SS];  /* Working buffer (4 sector in size) */
 
     sdcard.begin();
 
-    auto ocr = sdcard.readOCR();
-    printf("ocr: 0x%02X %02X %02X %02X\n", ocr->raw[0], ocr->raw[1], ocr->raw[2], ocr->raw[3]);
+    // registers were read by begin(), info() costs no bus traffic
+    const sd::CardInfo& info = sdcard.info();
+    printf("ocr: 0x%02X %02X %02X %02X\n", info.ocr.raw[0], info.ocr.raw[1], info.ocr.raw[2], info.ocr.raw[3]);
 
-    auto cid = sdcard.readCID();
     printf("cid: 0x");
-    for(const auto &c : cid->raw ) {
+    for(const auto &c : info.cid.raw ) {
         printf("%02X", c);
     }
     printf("\n");
 
-    auto csd = sdcard.readCSD();
     printf("csd: 0x");
-    for(const auto &c : csd->raw ) {
+    for(const auto &c : info.csd.raw ) {
         printf("%02X", c);
     }
     printf("\n");
 
-    printf("Block Count: %d\n", csd->blockCount());
-    printf("CardSize: %d\n", csd->cardCapacity());
+    printf("Block Count: %u\n", info.blockCount);
+    printf("CardSize: %u\n", info.csd.cardCapacity());
+    if(info.hasStatus) {
+        printf("Speed class: %u, AU: %u blocks\n", info.speedClass, info.auBlocks);
+    }
 
     /* Check function/compatibility of the physical drive #0 */
     rc = test_diskio(0, 3, buff, sizeof buff);
+    idle();
 
         if (rc) {
             printf("Sorry the function/compatibility test failed. (rc=%d)\nFatFs will not work with this disk driver.\n", rc);
@@ -71,6 +105,12 @@ int main(int argc, char *argv[])
         else {
             printf("Congratulations! The disk driver works well.\n");
         }
+#if FF_VOLUMES > 1
+        printf("RAM disk: %s\n", test_diskio(1, 1, buff, sizeof buff) ? "failed" : "ok");
+#endif
+        idle();
+        printf("Cache: %u hits, %u misses, %u write backs in %u flush runs\n", sdcache.stats().hits,
+               sdcache.stats().misses, sdcache.stats().writeBacks, sdcache.stats().flushRuns);
 
 //        BYTE Buff[4096];	/* Working buffer */
 //        FATFS FatFs;		/* FatFs work area needed for each volume */
@@ -94,25 +134,29 @@ int main(int argc, char *argv[])
 //
 //        }
 
+    // write back the cache and close any write session before exiting, so every block written is on the card
+    if(disks.ready(0) && disk_ioctl(0, CTRL_SYNC, nullptr) != RES_OK) {
+        printf("Sync failed\n");
+        return 1;
+    }
     return 0;
 }
 
-static DSTATUS stat = STA_NOINIT;
+/// drive numbers past the table are a parameter error, drives not initialized are not ready
+static DRESULT driveCheck(const BYTE pdrv) {
+    if(pdrv >= disks.DRIVES) { return RES_PARERR; }
+    return disks.ready(pdrv) ? RES_OK : RES_NOTRDY;
+}
 
 DSTATUS disk_status ( BYTE pdrv ) {
-    (void)pdrv;
-    return stat;
+    if(!disks.present(pdrv)) { return STA_NOINIT | STA_NODISK; }
+    return disks.ready(pdrv) ? 0 : STA_NOINIT;
 }
 
 DSTATUS disk_initialize ( BYTE pdrv ) {
-    (void)pdrv;
-    if(!sdcard.begin()) {
-        stat = STA_NODISK;
-    }
-    else {
-        stat = 0;
-    }
-    return stat;
+    if(!disks.present(pdrv)) { return STA_NOINIT | STA_NODISK; }
+    // a cached drive drops its cache and streams before the card starts over
+    return disks.begin(pdrv) ? 0 : STA_NOINIT;
 }
 
 DRESULT disk_read (
@@ -122,9 +166,8 @@ DRESULT disk_read (
         UINT count     /* [IN] Number of sectros to read */
 )
 {
-    (void)pdrv;
-    const ssize_t err = sdcard.readBlocks(sector, buff, count);
-    return err == count ? RES_OK : RES_ERROR;
+    if(const DRESULT dr = driveCheck(pdrv); dr != RES_OK) { return dr; }
+    return disks.read(pdrv, sector, buff, count) ? RES_OK : RES_ERROR;
 }
 
 DRESULT disk_write (
@@ -134,9 +177,8 @@ DRESULT disk_write (
         UINT count        /* [IN] Number of sectors to write */
 )
 {
-    (void)pdrv;
-    const ssize_t err = sdcard.writeBlocks(sector, buff, count);
-    return err == count ? RES_OK : RES_ERROR;
+    if(const DRESULT dr = driveCheck(pdrv); dr != RES_OK) { return dr; }
+    return disks.write(pdrv, sector, buff, count) ? RES_OK : RES_ERROR;
 
 }
 
@@ -146,28 +188,27 @@ DRESULT disk_ioctl (
         void* buff     /* [I/O] Parameter and data buffer */
 )
 {
-    (void)pdrv;
+    if(const DRESULT dr = driveCheck(pdrv); dr != RES_OK) { return dr; }
     switch(cmd) {
         case CTRL_SYNC :
-            break;
+            // the cache writes back its dirty sectors, then the stream closes its write session
+            return disks.sync(pdrv) ? RES_OK : RES_ERROR;
         case GET_SECTOR_COUNT :
-            {
-                if(auto cap = sdcard.cardCapacity(); cap.has_value()) {
-                    *((DWORD*)buff) = *cap;
-                }
-                else {
-                    *((DWORD*)buff) = 0;
-                }
-                break;
-            }
+            *((DWORD*)buff) = disks.blockCount(pdrv).value_or(0);
+            break;
         case GET_SECTOR_SIZE :
             *((DWORD*)buff) = 512;
             break;
         case GET_BLOCK_SIZE :
-            *((DWORD*)buff) = 1;
+            // erase block size in sectors, used by f_mkfs to align the data area
+            *((DWORD*)buff) = disks.eraseUnit(pdrv);
             break;
         case CTRL_TRIM :
-            break;
+            {
+                // freed sectors {first, last} from a delete or truncate, erased so later writes find them ready
+                const DWORD* range = static_cast<const DWORD*>(buff);
+                return disks.trim(pdrv, range[0], range[1]) ? RES_OK : RES_ERROR;
+            }
         default: break;
     }
     return RES_OK;
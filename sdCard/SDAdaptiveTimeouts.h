@@ -0,0 +1,149 @@
+#ifndef SDCARD_SDADAPTIVETIMEOUTS_H
+#define SDCARD_SDADAPTIVETIMEOUTS_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include "SDDefaultPolicies.h"
+
+namespace sd {
+
+/// lets the thread go while the card is busy: std::this_thread::yield and sleep_for
+struct ThreadSleep {
+    static void yield() { std::this_thread::yield(); }
+    static void sleep(const std::chrono::microseconds us) { std::this_thread::sleep_for(us); }
+};
+
+/**
+ * Timeout policy that paces busy waits instead of polling the card for the whole programming time:
+ *
+ *     sd::SpiCard<Shim, sd::SlicedCRC, sd::AdaptiveTimeouts<>> card;
+ *
+ * It learns how long each kind of busy wait (BusyKind) takes on this card. When the first poll finds the card
+ * busy it sleeps through 7/8 of the shortest recent wait of that kind, then backs off: a couple of yields, then
+ * sleeps doubling from MIN_SLEEP_US, capped at 1/16 of the learned time so the end of busy is not overslept by
+ * much. A wait nothing is known about yet backs off up to MAX_SLEEP_US. The estimate drops to any shorter wait at
+ * once and rises by 1/8 of the difference per longer one, so a new card or a slower region is picked up quickly.
+ * A wait that ends after a sleep counts as if the card finished when the sleep started, so oversleeping never
+ * teaches a longer time.
+ *
+ * isTimedOut() only reads the clock every CheckEvery calls, and after every pause, since a sleep is long enough
+ * to have used up the timeout. Timeouts may be noticed a few polls late, never a whole sleep late.
+ * @tparam Clock a monotonic std::chrono style clock
+ * @tparam Sleep provides static yield() and sleep(std::chrono::microseconds)
+ * @tparam CheckEvery isTimedOut() reads Clock on every CheckEvery-th call
+ */
+template<class Clock = std::chrono::steady_clock, class Sleep = ThreadSleep, uint8_t CheckEvery = 8>
+class AdaptiveTimeouts {
+public:
+    static_assert(Clock::is_steady, "timeouts need a clock that does not jump");
+    static_assert(CheckEvery > 0, "the clock must be read at some point");
+
+    // timout values and time types
+    using timeType = std::chrono::milliseconds::rep;
+
+    timeType getTime() {
+        m_calls = 0;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    bool isTimedOut(const timeType t0, const uint32_t Timeout) {
+        if(++m_calls < CheckEvery && !m_paused) { return false; }
+        m_paused = false;
+        return (getTime() - t0) > Timeout;
+    }
+
+    using cmd0_retry   = std::integral_constant<uint8_t,  10>;
+    using cmdTimeout   = std::integral_constant<uint32_t, 300>;
+    using initTimeout  = std::integral_constant<uint32_t, 2000>;
+    using eraseTimeout = std::integral_constant<uint32_t, 10000>;
+    using readTimeout  = std::integral_constant<uint32_t, 1000>;
+    using writeTimeout = std::integral_constant<uint32_t, 2000>;
+    using streamTimeout = std::integral_constant<uint32_t, 50>;     //< idle time before an open stream is closed
+
+    static constexpr uint32_t MIN_SLEEP_US = 16;        //< first backoff sleep
+    static constexpr uint32_t MAX_SLEEP_US = 1000;      //< longest backoff sleep
+    static constexpr uint32_t YIELDS       = 2;         //< pauses that only yield before the backoff sleeps start
+
+    /// a busy wait of this kind starts
+    void busyBegin(BusyKind) {
+        m_busyStart = Clock::now();
+        m_sleptUs   = 0;
+    }
+
+    /// the card was still busy after `attempt` earlier pauses of this wait
+    void busyPause(const BusyKind kind, const uint32_t attempt) {
+        m_paused = true;
+        const Learned& l = m_learned[index(kind)];
+        if(attempt == 0 && l.samples > 0) {
+            const uint32_t target = l.floorUs - l.floorUs / 8;
+            const uint32_t spent  = elapsedUs();
+            if(target > spent + MIN_SLEEP_US) {
+                sleep(target - spent);
+                return;
+            }
+        }
+        if(attempt < YIELDS) {
+            Sleep::yield();
+            m_sleptUs = 0;
+            return;
+        }
+        const uint32_t backoff = MIN_SLEEP_US << std::min<uint32_t>(attempt - YIELDS, 10);
+        const uint32_t cap     = l.samples > 0 ? std::max(MIN_SLEEP_US, l.floorUs / 16) : MAX_SLEEP_US;
+        sleep(std::min({ backoff, cap, MAX_SLEEP_US }));
+    }
+
+    /// the wait is over. Only waits where the card was busy and then finished teach anything
+    void busyEnd(const BusyKind kind, const bool ready, const uint32_t polls) {
+        if(!ready || polls == 0) { return; }
+        Learned& l = m_learned[index(kind)];
+        // the card may have finished right at the start of the last sleep, learn the shortest time it could have taken
+        const uint32_t elapsed = elapsedUs();
+        const uint32_t us      = elapsed > m_sleptUs ? elapsed - m_sleptUs : 0;
+        if(l.samples == 0 || us < l.floorUs) { l.floorUs = us; }
+        else                                 { l.floorUs += (us - l.floorUs) / 8; }
+        if(l.samples < UINT16_MAX) { l.samples++; }
+    }
+
+    /// learned duration of a busy wait of this kind in us, 0 until one has been seen
+    uint32_t expectedBusyUs(const BusyKind kind) const {
+        const Learned& l = m_learned[index(kind)];
+        return l.samples ? l.floorUs : 0;
+    }
+    /// number of busy waits of this kind learned from
+    uint16_t busySamples(const BusyKind kind) const { return m_learned[index(kind)].samples; }
+    /// drop everything learned, for example after a card was swapped
+    void forgetBusyTimes() { m_learned = {}; }
+
+private:
+    struct Learned {
+        uint32_t floorUs = 0;
+        uint16_t samples = 0;
+    };
+
+    static constexpr size_t index(const BusyKind kind) { return static_cast<size_t>(kind); }
+
+    void sleep(const uint32_t us) {
+        Sleep::sleep(std::chrono::microseconds(us));
+        m_sleptUs = us;
+    }
+
+    uint32_t elapsedUs() const {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_busyStart).count();
+        return us < 0 ? 0 : (us > INT32_MAX ? INT32_MAX : static_cast<uint32_t>(us));
+    }
+
+    std::array<Learned, static_cast<size_t>(BusyKind::COUNT)> m_learned{};
+    typename Clock::time_point m_busyStart{};
+    uint32_t m_sleptUs = 0;         //< length of the last pause of the current wait if it slept, 0 otherwise
+    uint8_t  m_calls   = 0;
+    bool     m_paused  = false;
+};
+
+}   // namespace sd
+
+#endif //SDCARD_SDADAPTIVETIMEOUTS_H
@@ -0,0 +1,342 @@
+#ifndef SDCARD_SDBLOCKCACHE_H
+#define SDCARD_SDBLOCKCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include "SDBlockSpan.h"
+
+namespace sd {
+
+/// statistics kept by BlockCache
+struct CacheStats {
+    uint32_t hits       = 0;    //< sectors served from the cache
+    uint32_t misses     = 0;    //< sectors read from the device
+    uint32_t evictions  = 0;    //< valid lines replaced
+    uint32_t writeBacks = 0;    //< dirty sectors written to the device
+    uint32_t flushRuns  = 0;    //< device writes issued by flush(), each covering a run of adjacent sectors
+
+    float hitRate() const { return (hits + misses) ? float(hits) / float(hits + misses) : 0.0f; }
+};
+
+/// least recently used eviction. Each access stamps the line, the oldest stamp in the set is evicted
+struct LRUEviction {
+    struct Line  { uint32_t stamp = 0; };
+    struct Set   { };
+
+    uint32_t m_tick = 0;
+
+    void touch(Set&, Line& line) { line.stamp = ++m_tick; }
+    template<class L>
+    size_t victim(Set&, const L* lines, const size_t ways) {
+        size_t v = 0;
+        for(size_t w = 1; w < ways; ++w) {
+            // unsigned difference keeps the order correct across a wrap of the tick counter
+            if(uint32_t(m_tick - lines[w].stamp) > uint32_t(m_tick - lines[v].stamp)) { v = w; }
+        }
+        return v;
+    }
+};
+
+/// CLOCK (second chance) eviction. Cheaper than LRU: a reference bit per line and a hand per set
+struct ClockEviction {
+    struct Line  { bool referenced = false; };
+    struct Set   { uint8_t hand = 0; };
+
+    void touch(Set&, Line& line) { line.referenced = true; }
+    template<class L>
+    size_t victim(Set& set, L* lines, const size_t ways) {
+        for(;;) {
+            auto& line = lines[set.hand];
+            const size_t w = set.hand;
+            set.hand = static_cast<uint8_t>((set.hand + 1) % ways);
+            if(!line.referenced) { return w; }
+            line.referenced = false;
+        }
+    }
+};
+
+/**
+ * Write-back, N-way set associative sector cache wrapped around a block device (SpiCard or anything with the same
+ * readBlocks/writeBlocks signature). Meant for the single sector FAT and directory traffic of a filesystem:
+ *   - single sector reads allocate a line, single sector writes are held dirty in the cache
+ *   - multi sector reads and writes go straight to the device, but are served from / update cached copies so the
+ *     cache never returns stale data
+ *   - flush() writes the dirty sectors in LBA order, coalescing adjacent ones into one multi-block write. Devices
+ *     with a gather writeBlocks (ConstBlockSpan list) get the lines directly, others through a staging buffer
+ * Sector n maps to set (n % Sets), so neighbouring sectors land in different sets and can be dirty at once.
+ *
+ * @tparam Device the wrapped block device
+ * @tparam Sets number of sets, a power of two
+ * @tparam Ways lines per set
+ * @tparam Eviction LRUEviction or ClockEviction
+ * @tparam MaxRun largest run of sectors flush() writes with one command
+ */
+template<class Device, size_t Sets = 16, size_t Ways = 4, class Eviction = LRUEviction, size_t MaxRun = 8>
+class BlockCache : private Eviction {
+    static_assert(Sets > 0 && (Sets & (Sets - 1)) == 0, "number of sets must be a power of two");
+    static_assert(Ways > 0 && Ways < 256, "ways must be between 1 and 255");
+    static_assert(Sets * Ways <= 65536, "line indices are 16 bit");
+    static_assert(MaxRun > 0, "flush run must hold at least one sector");
+
+public:
+    static constexpr size_t LINES = Sets * Ways;
+
+    explicit BlockCache(Device& device) : m_device(&device) {}
+
+    /**
+     * Read sectors through the cache
+     * @return number of sectors read, or < 0 on a device error
+     */
+    ssize_t readBlocks(uint32_t LBA, uint8_t* buf, size_t LEN);
+
+    /**
+     * Write sectors through the cache. A single sector is only written to the cache until it is evicted or flushed
+     * @return number of sectors written, or < 0 on a device error
+     */
+    ssize_t writeBlocks(uint32_t LBA, const uint8_t* src, size_t LEN);
+
+    /// write every dirty sector to the device, then flush the device if it holds writes back too. Returns FALSE if a
+    /// write failed, the failed sectors stay dirty
+    bool flush();
+
+    /// drop every cached sector and initialize the device
+    template<class D = Device>
+    auto begin() -> decltype(bool(std::declval<D&>().begin())) {
+        invalidate();
+        return m_device->begin();
+    }
+    /// the device's capacity in sectors
+    template<class D = Device>
+    auto cardCapacity() const -> decltype(std::declval<const D&>().cardCapacity()) { return m_device->cardCapacity(); }
+    /// the device's card registers
+    template<class D = Device>
+    auto info() const -> decltype(std::declval<const D&>().info()) { return m_device->info(); }
+
+    /**
+     * Erase sectors on the device (TRIM). Cached copies of the range are dropped, dirty ones without being written.
+     * @return the device's result
+     */
+    bool eraseBlocks(uint32_t firstLBA, uint32_t lastLBA) {
+        for(auto& line : m_lines) {
+            if(line.valid && line.lba >= firstLBA && line.lba <= lastLBA) { line.valid = line.dirty = false; }
+        }
+        return m_device->eraseBlocks(firstLBA, lastLBA);
+    }
+
+    /// drop every cached sector. Dirty sectors are lost, call flush() first to keep them
+    void invalidate() {
+        for(auto& line : m_lines) { line.valid = line.dirty = false; }
+    }
+
+    /// number of dirty sectors waiting for flush()
+    size_t dirtyCount() const {
+        return static_cast<size_t>(std::count_if(m_lines.begin(), m_lines.end(), [](const Line& l) { return l.dirty; }));
+    }
+
+    const CacheStats& stats() const { return m_stats; }
+    void resetStats() { m_stats = CacheStats(); }
+
+    Device& device() { return *m_device; }
+
+private:
+    struct Line : Eviction::Line {
+        uint32_t lba   = 0;
+        bool     valid = false;
+        bool     dirty = false;
+    };
+
+    static size_t setOf(const uint32_t LBA) { return LBA & (Sets - 1); }
+    Line& line(const size_t set, const size_t way) { return m_lines[set * Ways + way]; }
+    uint8_t* data(const Line& l) { return m_data[&l - m_lines.data()].data(); }
+
+    /// the line holding LBA, or nullptr
+    Line* find(uint32_t LBA);
+    /// a line for LBA, evicting (and writing back) the set's victim if needed. nullptr if the write back failed
+    Line* allocate(uint32_t LBA);
+    /// write a single dirty line back to the device
+    bool writeBack(Line& l);
+    /// write the lines of one flush run, lines[0] holding LBA and the rest following it
+    ssize_t writeRun(uint32_t LBA, const uint16_t* lines, size_t run);
+
+    Device*                                     m_device;
+    std::array<Line, LINES>                     m_lines{};
+    std::array<typename Eviction::Set, Sets>    m_sets{};
+    std::array<std::array<uint8_t, 512>, LINES> m_data{};
+    std::array<uint8_t, detail::hasSpanWrite<Device>::value ? 0 : MaxRun * 512> m_staging{};
+    CacheStats                                  m_stats;
+};
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+typename BlockCache<Device, Sets, Ways, Eviction, MaxRun>::Line*
+BlockCache<Device, Sets, Ways, Eviction, MaxRun>::find(const uint32_t LBA)
+{
+    const size_t set = setOf(LBA);
+    for(size_t w = 0; w < Ways; ++w) {
+        Line& l = line(set, w);
+        if(l.valid && l.lba == LBA) {
+            Eviction::touch(m_sets[set], l);
+            return &l;
+        }
+    }
+    return nullptr;
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+typename BlockCache<Device, Sets, Ways, Eviction, MaxRun>::Line*
+BlockCache<Device, Sets, Ways, Eviction, MaxRun>::allocate(const uint32_t LBA)
+{
+    const size_t set = setOf(LBA);
+    Line* target = nullptr;
+    for(size_t w = 0; w < Ways && !target; ++w) {
+        if(!line(set, w).valid) { target = &line(set, w); }
+    }
+
+    if(!target) {
+        target = &line(set, Eviction::victim(m_sets[set], &line(set, 0), Ways));
+        if(target->dirty && !writeBack(*target)) { return nullptr; }
+        m_stats.evictions++;
+    }
+
+    target->lba   = LBA;
+    target->valid = true;
+    target->dirty = false;
+    Eviction::touch(m_sets[set], *target);
+    return target;
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+bool BlockCache<Device, Sets, Ways, Eviction, MaxRun>::writeBack(Line& l)
+{
+    if(m_device->writeBlocks(l.lba, data(l), 1) != 1) { return false; }
+    l.dirty = false;
+    m_stats.writeBacks++;
+    return true;
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+ssize_t BlockCache<Device, Sets, Ways, Eviction, MaxRun>::readBlocks(const uint32_t LBA, uint8_t* buf, const size_t LEN)
+{
+    if(LEN == 1) {
+        if(Line* l = find(LBA)) {
+            m_stats.hits++;
+            std::memcpy(buf, data(*l), 512);
+            return 1;
+        }
+        m_stats.misses++;
+        Line* l = allocate(LBA);
+        if(!l) { return -1; }
+        if(m_device->readBlocks(LBA, data(*l), 1) != 1) {
+            l->valid = false;
+            return -1;
+        }
+        std::memcpy(buf, data(*l), 512);
+        return 1;
+    }
+
+    // bulk reads bypass allocation, hits are copied and each run of misses is one device read
+    size_t i = 0;
+    while(i < LEN) {
+        if(Line* l = find(LBA + i)) {
+            m_stats.hits++;
+            std::memcpy(buf + i * 512, data(*l), 512);
+            ++i;
+            continue;
+        }
+        size_t run = 1;
+        while(i + run < LEN && !find(LBA + i + run)) { ++run; }
+        const ssize_t n = m_device->readBlocks(LBA + i, buf + i * 512, run);
+        if(n != static_cast<ssize_t>(run)) { return n < 0 ? n : static_cast<ssize_t>(i) + n; }
+        m_stats.misses += run;
+        i += run;
+    }
+    return LEN;
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+ssize_t BlockCache<Device, Sets, Ways, Eviction, MaxRun>::writeBlocks(const uint32_t LBA, const uint8_t* src, const size_t LEN)
+{
+    if(LEN == 1) {
+        Line* l = find(LBA);
+        if(!l && !(l = allocate(LBA))) { return -1; }
+        std::memcpy(data(*l), src, 512);
+        l->dirty = true;
+        return 1;
+    }
+
+    // bulk writes go through, cached copies are refreshed and now match the device
+    const ssize_t n = m_device->writeBlocks(LBA, src, LEN);
+    for(size_t i = 0; i < LEN; ++i) {
+        if(Line* l = find(LBA + i)) {
+            if(n >= 0 && i < static_cast<size_t>(n)) {
+                std::memcpy(data(*l), src + i * 512, 512);
+                l->dirty = false;
+            }
+        }
+    }
+    return n;
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+ssize_t BlockCache<Device, Sets, Ways, Eviction, MaxRun>::writeRun(const uint32_t LBA, const uint16_t* lines,
+                                                                   const size_t run)
+{
+    if constexpr (detail::hasSpanWrite<Device>::value) {
+        std::array<ConstBlockSpan, MaxRun> spans;
+        for(size_t r = 0; r < run; ++r) { spans[r] = ConstBlockSpan{ m_data[lines[r]].data(), 1 }; }
+        return m_device->writeBlocks(LBA, spans.data(), run);
+    }
+    else {
+        for(size_t r = 0; r < run; ++r) { std::memcpy(m_staging.data() + r * 512, m_data[lines[r]].data(), 512); }
+        return m_device->writeBlocks(LBA, m_staging.data(), run);
+    }
+}
+
+template<class Device, size_t Sets, size_t Ways, class Eviction, size_t MaxRun>
+bool BlockCache<Device, Sets, Ways, Eviction, MaxRun>::flush()
+{
+    // insertion sort of the dirty lines by LBA, the cache is small
+    std::array<uint16_t, LINES> dirty;
+    size_t count = 0;
+    for(size_t i = 0; i < LINES; ++i) {
+        if(!m_lines[i].dirty) { continue; }
+        size_t j = count++;
+        while(j > 0 && m_lines[dirty[j - 1]].lba > m_lines[i].lba) {
+            dirty[j] = dirty[j - 1];
+            --j;
+        }
+        dirty[j] = static_cast<uint16_t>(i);
+    }
+
+    bool ok = true;
+    size_t i = 0;
+    while(i < count) {
+        // extend the run while the next dirty sector is adjacent
+        size_t run = 1;
+        while(i + run < count && run < MaxRun && m_lines[dirty[i + run]].lba == m_lines[dirty[i]].lba + run) { ++run; }
+
+        if(run == 1) {
+            ok = writeBack(m_lines[dirty[i]]) && ok;
+        }
+        else {
+            if(writeRun(m_lines[dirty[i]].lba, &dirty[i], run) == static_cast<ssize_t>(run)) {
+                for(size_t r = 0; r < run; ++r) { m_lines[dirty[i + r]].dirty = false; }
+                m_stats.writeBacks += run;
+            }
+            else {
+                ok = false;
+            }
+        }
+        m_stats.flushRuns++;
+        i += run;
+    }
+    if constexpr (detail::hasFlush<Device>::value) { ok = m_device->flush() && ok; }
+    return ok;
+}
+
+}   // sd namespace
+
+#endif //SDCARD_SDBLOCKCACHE_H
@@ -0,0 +1,153 @@
+#ifndef SDCARD_SDBLOCKDEVICES_H
+#define SDCARD_SDBLOCKDEVICES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <sys/types.h>
+#include "SDBlockSpan.h"
+
+namespace sd {
+
+namespace detail {
+    // 64 bit file offsets: off_t with fseeko/ftello (define _FILE_OFFSET_BITS=64 on 32 bit POSIX systems)
+#if defined(_MSC_VER)
+    using FileOffset = __int64;
+    inline int fileSeek(std::FILE* file, const FileOffset offset, const int whence) {
+        return _fseeki64(file, offset, whence);
+    }
+    inline FileOffset fileTell(std::FILE* file) { return _ftelli64(file); }
+#else
+    using FileOffset = off_t;
+    inline int fileSeek(std::FILE* file, const FileOffset offset, const int whence) {
+        return fseeko(file, offset, whence);
+    }
+    inline FileOffset fileTell(std::FILE* file) { return ftello(file); }
+#endif
+}
+
+/**
+ * Block device over a buffer in memory, with the same interface as a card (readBlocks/writeBlocks, their span
+ * overloads, eraseBlocks, cardCapacity). Erased blocks read back as 0xFF, like erased flash.
+ *
+ *     static uint8_t mem[128 * 512];
+ *     sd::RamDisk ram(mem, 128);
+ */
+class RamDisk {
+public:
+    /// @param mem [in] storage for `blocks` 512 byte blocks, must outlive the disk
+    RamDisk(uint8_t* mem, const uint32_t blocks) : m_mem(mem), m_blocks(blocks) {}
+
+    bool begin() { return m_mem != nullptr && m_blocks > 0; }
+    std::optional<uint32_t> cardCapacity() const {
+        return m_blocks ? std::optional<uint32_t>(m_blocks) : std::optional<uint32_t>();
+    }
+
+    ssize_t readBlocks(const uint32_t LBA, uint8_t* buf, const size_t LEN) {
+        if(!inRange(LBA, LEN)) { return -1; }
+        std::memcpy(buf, at(LBA), LEN * 512);
+        return static_cast<ssize_t>(LEN);
+    }
+    ssize_t writeBlocks(const uint32_t LBA, const uint8_t* src, const size_t LEN) {
+        if(!inRange(LBA, LEN)) { return -1; }
+        std::memcpy(at(LBA), src, LEN * 512);
+        return static_cast<ssize_t>(LEN);
+    }
+    ssize_t readBlocks(const uint32_t LBA, const BlockSpan* spans, const size_t count) {
+        return detail::eachSpan(LBA, spans, count, [this](uint32_t lba, uint8_t* buf, size_t n) { return readBlocks(lba, buf, n); });
+    }
+    ssize_t writeBlocks(const uint32_t LBA, const ConstBlockSpan* spans, const size_t count) {
+        return detail::eachSpan(LBA, spans, count, [this](uint32_t lba, const uint8_t* src, size_t n) { return writeBlocks(lba, src, n); });
+    }
+
+    bool eraseBlocks(const uint32_t firstLBA, const uint32_t lastLBA) {
+        if(lastLBA < firstLBA || !inRange(firstLBA, size_t(lastLBA - firstLBA) + 1)) { return false; }
+        std::memset(at(firstLBA), 0xFF, (size_t(lastLBA - firstLBA) + 1) * 512);
+        return true;
+    }
+
+private:
+    bool inRange(const uint32_t LBA, const size_t LEN) const { return LBA < m_blocks && LEN <= m_blocks - LBA; }
+    uint8_t* at(const uint32_t LBA) { return m_mem + size_t(LBA) * 512; }
+
+    uint8_t* m_mem;
+    uint32_t m_blocks;
+};
+
+/**
+ * Block device over a raw disk image file, for mounting a card image on the host. The file is opened by begin() and
+ * must already exist; its size sets the capacity, a partial last block is left out. eraseBlocks only checks the range,
+ * TRIM is a hint and nothing is written. A transfer that moves fewer blocks than asked for (a read error, a full disk)
+ * returns -1, so a DiskRegistry reports it as a failed call.
+ */
+class FileDisk {
+public:
+    /// @param path [in] the image file, must outlive the disk
+    explicit FileDisk(const char* path) : m_path(path) {}
+    ~FileDisk() { close(); }
+    FileDisk(const FileDisk&) = delete;
+    FileDisk& operator=(const FileDisk&) = delete;
+
+    /// open the image (again). TRUE if it holds at least one block
+    bool begin() {
+        close();
+        m_file = m_path ? std::fopen(m_path, "r+b") : nullptr;
+        if(!m_file) { return false; }
+        const detail::FileOffset size = detail::fileSeek(m_file, 0, SEEK_END) == 0 ? detail::fileTell(m_file) : -1;
+        if(size < 512) {
+            close();
+            return false;
+        }
+        const detail::FileOffset blocks = size / 512;
+        m_blocks = blocks > std::numeric_limits<uint32_t>::max() ? std::numeric_limits<uint32_t>::max()
+                                                                  : static_cast<uint32_t>(blocks);
+        return true;
+    }
+    void close() {
+        if(m_file) { std::fclose(m_file); }
+        m_file   = nullptr;
+        m_blocks = 0;
+    }
+    std::optional<uint32_t> cardCapacity() const {
+        return m_blocks ? std::optional<uint32_t>(m_blocks) : std::optional<uint32_t>();
+    }
+
+    ssize_t readBlocks(const uint32_t LBA, uint8_t* buf, const size_t LEN) {
+        if(!seek(LBA, LEN) || std::fread(buf, 512, LEN, m_file) != LEN) { return -1; }
+        return static_cast<ssize_t>(LEN);
+    }
+    ssize_t writeBlocks(const uint32_t LBA, const uint8_t* src, const size_t LEN) {
+        if(!seek(LBA, LEN) || std::fwrite(src, 512, LEN, m_file) != LEN) { return -1; }
+        return static_cast<ssize_t>(LEN);
+    }
+    ssize_t readBlocks(const uint32_t LBA, const BlockSpan* spans, const size_t count) {
+        return detail::eachSpan(LBA, spans, count, [this](uint32_t lba, uint8_t* buf, size_t n) { return readBlocks(lba, buf, n); });
+    }
+    ssize_t writeBlocks(const uint32_t LBA, const ConstBlockSpan* spans, const size_t count) {
+        return detail::eachSpan(LBA, spans, count, [this](uint32_t lba, const uint8_t* src, size_t n) { return writeBlocks(lba, src, n); });
+    }
+
+    bool eraseBlocks(const uint32_t firstLBA, const uint32_t lastLBA) {
+        return m_file && firstLBA <= lastLBA && lastLBA < m_blocks;
+    }
+    /// hand buffered writes to the operating system
+    bool flush() { return m_file && std::fflush(m_file) == 0; }
+
+private:
+    bool seek(const uint32_t LBA, const size_t LEN) {
+        if(!m_file || LBA >= m_blocks || LEN > m_blocks - LBA) { return false; }
+        std::clearerr(m_file);
+        return detail::fileSeek(m_file, static_cast<detail::FileOffset>(LBA) * 512, SEEK_SET) == 0;
+    }
+
+    const char* m_path;
+    std::FILE*  m_file   = nullptr;
+    uint32_t    m_blocks = 0;
+};
+
+}   // namespace sd
+
+#endif //SDCARD_SDBLOCKDEVICES_H
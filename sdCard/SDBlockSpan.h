@@ -0,0 +1,66 @@
+#ifndef SDCARD_SDBLOCKSPAN_H
+#define SDCARD_SDBLOCKSPAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <sys/types.h>
+
+namespace sd {
+
+/// one buffer of a scatter-gather read: `blocks` consecutive 512 byte blocks at `data`
+struct BlockSpan {
+    uint8_t* data;
+    size_t   blocks;
+};
+
+/// one buffer of a scatter-gather write: `blocks` consecutive 512 byte blocks at `data`
+struct ConstBlockSpan {
+    const uint8_t* data;
+    size_t         blocks;
+};
+
+namespace detail {
+    /// total blocks in a span list
+    template<class Span>
+    size_t spanBlocks(const Span* spans, const size_t count) {
+        size_t total = 0;
+        for(size_t s = 0; s < count; ++s) { total += spans[s].blocks; }
+        return total;
+    }
+
+    /**
+     * Run a contiguous transfer `ssize_t fn(uint32_t LBA, data, size_t LEN)` for each span in turn, for devices that
+     * have no scatter-gather transfer of their own. Stops at the first short transfer.
+     * @return blocks transferred, or the first call's error if nothing was
+     */
+    template<class Span, class Fn>
+    ssize_t eachSpan(const uint32_t LBA, const Span* spans, const size_t count, Fn&& fn) {
+        size_t done = 0;
+        for(size_t s = 0; s < count; ++s) {
+            const ssize_t n = fn(LBA + static_cast<uint32_t>(done), spans[s].data, spans[s].blocks);
+            if(n < 0) { return done ? static_cast<ssize_t>(done) : n; }
+            done += static_cast<size_t>(n);
+            if(static_cast<size_t>(n) != spans[s].blocks) { break; }
+        }
+        return static_cast<ssize_t>(done);
+    }
+
+    /// TRUE for block devices with `ssize_t writeBlocks(uint32_t LBA, const ConstBlockSpan* spans, size_t count)`
+    template<class Device, class = void>
+    struct hasSpanWrite : std::false_type {};
+    template<class Device>
+    struct hasSpanWrite<Device, std::void_t<decltype(std::declval<Device&>().writeBlocks(
+        uint32_t(), std::declval<const ConstBlockSpan*>(), size_t()))>> : std::true_type {};
+
+    /// TRUE for block devices that hold writes back until `bool flush()`
+    template<class Device, class = void>
+    struct hasFlush : std::false_type {};
+    template<class Device>
+    struct hasFlush<Device, std::void_t<decltype(bool(std::declval<Device&>().flush()))>> : std::true_type {};
+}
+
+}   // sd namespace
+
+#endif //SDCARD_SDBLOCKSPAN_H
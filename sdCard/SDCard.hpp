@@ -2,23 +2,183 @@
 #define SDCARD_SPI_H
 
 #include <stddef.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include "SDBlockSpan.h"
 #include "SDCard_info.h"
 #include "SDDefaultPolicies.h"
 
 #include <cstdio>
+// Human readable debug output. Off by default: an fprintf and fflush per block changes the timing it is meant to
+// observe. Use the SDTrace statistics policy (SDTrace.h) to trace a running system, or define SPISD_DEBUG_PRINTF
+// to get the messages on stderr.
+#ifndef SPISD_DEBUG
+#if defined(SPISD_DEBUG_PRINTF)
 #define SPISD_DEBUG(...)  do { fprintf(stderr, __VA_ARGS__); fflush(stderr); } while(0)
+#else
+#define SPISD_DEBUG(...)  do { } while(0)
+#endif
+#endif
 
 namespace sd {
 
-template<class SPIShim, class SDPolicy = sd::ShiftedCRC, class TimeoutPolicy = sd::CountBasedTimouts >
-class SpiCard : private SPIShim, SDPolicy, TimeoutPolicy {
+namespace detail {
+    /// bytes moved per shim call inside a data block. Shims may declare `static constexpr size_t chunkSize`
+    template<class Shim, class = void>
+    struct shimChunkSize : std::integral_constant<size_t, 512> {};
+    template<class Shim>
+    struct shimChunkSize<Shim, std::void_t<decltype(Shim::chunkSize)>> : std::integral_constant<size_t, Shim::chunkSize> {};
+
+    /// command frame with its CRC7, so commands with a fixed argument are built by the compiler
+    constexpr std::array<uint8_t, 6> makeCommandFrame(const SDCMD cmd, const uint32_t arg) {
+        std::array<uint8_t, 6> f{ static_cast<uint8_t>(0x40U | static_cast<uint8_t>(cmd)), static_cast<uint8_t>(arg >> 24U),
+                                  static_cast<uint8_t>(arg >> 16U), static_cast<uint8_t>(arg >> 8U),
+                                  static_cast<uint8_t>(arg), 0 };
+        f[5] = crc7(f.data(), 5);
+        return f;
+    }
+    template<SDCMD CMD, uint32_t ARG>
+    inline constexpr std::array<uint8_t, 6> commandFrame = makeCommandFrame(CMD, ARG);
+    static_assert(commandFrame<SDCMD::CMD0, 0>[5] == 0x95, "CRC7 of CMD0 must be 0x95");
+    static_assert(commandFrame<SDCMD::CMD8, 0x1AA>[5] == 0x87, "CRC7 of CMD8 must be 0x87");
+
+    /// TRUE for shims that batch transfers and can queue a read, `void queueRead(uint8_t* buf, size_t LEN)`,
+    /// whose data arrives in buf with the next read() call
+    template<class Shim, class = void>
+    struct hasQueueRead : std::false_type {};
+    template<class Shim>
+    struct hasQueueRead<Shim, std::void_t<decltype(std::declval<Shim&>().queueRead(std::declval<uint8_t*>(), size_t()))>>
+        : std::true_type {};
+
+    /// TRUE for shims that can clock a run of fill bytes in one call, `void pollRead(uint8_t* buf, size_t LEN)`:
+    /// LEN 0xFF bytes go out and what the card sent comes back in buf
+    template<class Shim, class = void>
+    struct hasPollRead : std::false_type {};
+    template<class Shim>
+    struct hasPollRead<Shim, std::void_t<decltype(std::declval<Shim&>().pollRead(std::declval<uint8_t*>(), size_t()))>>
+        : std::true_type {};
+
+    /// TRUE for shims that can change the SPI clock, `uint32_t setClock(uint32_t hz)`: run the bus at no more than
+    /// hz and return the clock actually used
+    template<class Shim, class = void>
+    struct hasSetClock : std::false_type {};
+    template<class Shim>
+    struct hasSetClock<Shim, std::void_t<decltype(std::declval<Shim&>().setClock(uint32_t()))>> : std::true_type {};
+
+    /// TRUE for shims with a CRC unit hashing the data on the bus (an MCU SPI or DMA CRC engine): `void crcStart()`
+    /// starts a CRC16 (XMODEM: init 0, poly 0x1021) with the next byte written or read, `uint16_t crcRead()` returns
+    /// the CRC of everything moved since
+    template<class Shim, class = void>
+    struct hasCRCUnit : std::false_type {};
+    template<class Shim>
+    struct hasCRCUnit<Shim, std::void_t<decltype(std::declval<Shim&>().crcStart()),
+                                        decltype(uint16_t(std::declval<Shim&>().crcRead()))>> : std::true_type {};
+
+    /// TRUE for shims whose adapter keeps a CRC of its traffic that the host can check, like the SPIDriver's:
+    /// `bool linkCheck()` is TRUE if every byte moved since the last check arrived intact, and
+    /// `void linkCheckEnable(bool)` turns the host's copy of the CRC on or off
+    template<class Shim, class = void>
+    struct hasLinkCheck : std::false_type {};
+    template<class Shim>
+    struct hasLinkCheck<Shim, std::void_t<decltype(bool(std::declval<Shim&>().linkCheck())),
+                                          decltype(std::declval<Shim&>().linkCheckEnable(bool()))>> : std::true_type {};
+
+    /// TRUE for shims on a bus shared with other devices (sd::BusHandle): `void suspend(bool always)` raises CS and
+    /// lets other devices use the bus during a busy wait, if any are waiting or always, and `void resume()` takes it back
+    template<class Shim, class = void>
+    struct hasBusYield : std::false_type {};
+    template<class Shim>
+    struct hasBusYield<Shim, std::void_t<decltype(std::declval<Shim&>().suspend(bool())),
+                                         decltype(std::declval<Shim&>().resume())>> : std::true_type {};
+
+    /// TRUE for CRC policies that leave what they can to the peripheral (sd::PeripheralCRC)
+    template<class Policy, class = void>
+    struct usesPeripheralCRC : std::false_type {};
+    template<class Policy>
+    struct usesPeripheralCRC<Policy, std::void_t<decltype(Policy::peripheralCRC)>>
+        : std::bool_constant<Policy::peripheralCRC> {};
+
+    /// TRUE for timeout policies that pace busy waits: `void busyBegin(BusyKind)`, `void busyPause(BusyKind,
+    /// uint32_t attempt)` after each poll that found the card busy, and `void busyEnd(BusyKind, bool ready,
+    /// uint32_t polls)`
+    template<class Policy, class = void>
+    struct hasBusyPacing : std::false_type {};
+    template<class Policy>
+    struct hasBusyPacing<Policy, std::void_t<decltype(std::declval<Policy&>().busyBegin(BusyKind())),
+                                             decltype(std::declval<Policy&>().busyPause(BusyKind(), uint32_t())),
+                                             decltype(std::declval<Policy&>().busyEnd(BusyKind(), bool(), uint32_t()))>>
+        : std::true_type {};
+
+    /// pollFor() pause between polls that does nothing
+    struct NoPause {
+        void operator()(uint32_t) const {}
+    };
+
+    /// poll chunk size that follows the number of bytes recent waits of one kind needed
+    class AdaptivePoll {
+    public:
+        explicit constexpr AdaptivePoll(const uint16_t initial) : m_avg(initial * 4) {}
+        size_t chunk(const size_t max) const {
+            const size_t c = (m_avg + 3) / 4;
+            return c < 1 ? 1 : (c > max ? max : c);
+        }
+        /// moving average, each wait weighs 1/4
+        void update(uint32_t needed) {
+            if(needed > 4096) { needed = 4096; }
+            m_avg = static_cast<uint16_t>(m_avg - m_avg / 4 + needed);
+        }
+    private:
+        uint16_t m_avg;     //< average bytes needed, times 4
+    };
+
+    /// kinds of wait, each with its own adaptive chunk size
+    enum class PollKind : uint8_t { RESPONSE, TOKEN, BUSY };
+
+    /// bytes a bulk poll clocked past what it was looking for, handed out by the next reads
+    template<size_t N>
+    struct PollBacklog {
+        std::array<uint8_t, N>      data{};
+        uint16_t                    pos   = 0;
+        uint16_t                    count = 0;
+        std::array<AdaptivePoll, 3> adapt{ AdaptivePoll(2), AdaptivePoll(8), AdaptivePoll(8) };   //< by PollKind
+    };
+    struct NoBacklog {};
+}
+
+/**
+ * TRUE for shims that can run a transfer in the background (DMA, interrupt or worker thread). Such a shim provides
+ *   bool startRead(uint8_t* buf, size_t LEN);        // start clocking LEN fill bytes into buf
+ *   bool startWrite(const uint8_t* buf, size_t LEN); // start clocking LEN bytes out of buf
+ *   bool transferDone();                             // TRUE once the last started transfer has finished
+ * The buffers must stay valid until transferDone() returns TRUE. No other shim call is made before then.
+ */
+template<class Shim, class = void>
+struct isAsyncShim : std::false_type {};
+template<class Shim>
+struct isAsyncShim<Shim, std::void_t<decltype(std::declval<Shim&>().startRead(std::declval<uint8_t*>(), size_t())),
+                                     decltype(std::declval<Shim&>().startWrite(std::declval<const uint8_t*>(), size_t())),
+                                     decltype(std::declval<Shim&>().transferDone())>> : std::true_type {};
+
+template<class SPIShim, class SDPolicy = sd::ShiftedCRC, class TimeoutPolicy = sd::CountBasedTimouts,
+         class StatsPolicy = sd::noStats >
+class SpiCard : private SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy {
 public:
     using SDPolicyTimeType = typename TimeoutPolicy::timeType;
 
     /// constructor
     SpiCard() noexcept : m_errorCode(ErrorCode::INIT_NOT_CALLED), m_type(CardType::UNK) {}
 
+    /// constructor for shims that need arguments (bus or device handles, simulated cards, etc.)
+    template<class ShimArg, class... ShimArgs,
+             class = std::enable_if_t<!std::is_same_v<std::decay_t<ShimArg>, SpiCard>>>
+    explicit SpiCard(ShimArg&& arg, ShimArgs&&... args)
+        : SPIShim(std::forward<ShimArg>(arg), std::forward<ShimArgs>(args)...),
+          m_errorCode(ErrorCode::INIT_NOT_CALLED), m_type(CardType::UNK) {}
+
     /// initialize the SD card. Returns true if the card is successfully configured.
     bool begin();
     /// Get the card type
@@ -29,20 +189,55 @@ public:
     std::optional<CSD> readCSD();
     /// get the OCR register
     std::optional<OCR> readOCR();
+    /// get the SD Configuration Register (ACMD51): spec version, bus widths, erase value, CMD23 support
+    std::optional<SCR> readSCR();
+    /// get the 64 byte SD Status (ACMD13): speed class, allocation unit and erase timing
+    std::optional<SDStatus> readSDStatus();
     /// get the 64 byte card status register
     std::optional<CardStatus> readStatus() { return std::optional<CardStatus>(); }
 
+    /**
+     * Check or select a card function with CMD6 (SWITCH_FUNC). Function groups not named keep their current function.
+     * @param set [in] FALSE to only check whether the function can be selected, TRUE to switch to it
+     * @param group [in] function group, 1 to 6 (1 is the access mode: 0 default speed, 1 High-Speed)
+     * @param function [in] function to check or select in the group
+     * @return the switch function status, empty if the card did not answer
+     */
+    std::optional<SwitchStatus> switchFunction(bool set, uint8_t group, uint8_t function);
+
+    /// SPI clock begin() left the bus at, 0 if the shim can not change its clock (see detail::hasSetClock)
+    uint32_t clockHz() const { return m_clockHz; }
+    /// TRUE if begin() switched the card to High-Speed (50MHz)
+    bool highSpeed() const { return m_highSpeed; }
+
+    /// copy of the statistics recorded by StatsPolicy (empty for noStats)
+    typename StatsPolicy::Snapshot statsSnapshot() const { return StatsPolicy::statSnapshot(); }
+    /// clear the statistics recorded by StatsPolicy
+    void resetStats() { StatsPolicy::statReset(); }
+    /// the statistics policy itself, for policies with more to offer than a snapshot (e.g. SDTrace's buffer)
+    StatsPolicy& statsPolicy() { return *this; }
+    const StatsPolicy& statsPolicy() const { return *this; }
+    /// the timeout policy itself, for policies that learn (e.g. AdaptiveTimeouts' busy times)
+    TimeoutPolicy& timeoutPolicy() { return *this; }
+    const TimeoutPolicy& timeoutPolicy() const { return *this; }
+
+    /// registers and geometry captured by begin() or refreshInfo(). Reading it costs no bus traffic
+    const CardInfo& info() const { return m_info; }
+
+    /**
+     * Read the CID, CSD and OCR again, and the SCR and SD Status if the card has them, and decode them into info().
+     * begin() does this once, call it again only if the card may have changed without a new begin().
+     * @return FALSE if the CID, CSD or OCR could not be read, info() is then marked invalid
+     */
+    bool refreshInfo();
+
     /// Get the number of blocks in the SD card (each block is 512 Bytes)
-    std::optional<uint32_t> cardCapacity() {
-        const auto csd = readCSD();
-        return csd.has_value() ? std::optional<uint32_t>(csd->blockCount()) : std::optional<uint32_t>();
+    std::optional<uint32_t> cardCapacity() const {
+        return m_info.valid ? std::optional<uint32_t>(m_info.blockCount) : std::optional<uint32_t>();
     }
 
     /// Determine if card supports single block erase.
-    bool eraseSingleBlockEnable() const {
-        const auto csd = readCSD();
-        return csd.has_value() ? csd->eraseBlockEnabled() : false;
-    }
+    bool eraseSingleBlockEnable() const { return m_info.valid && m_info.csd.eraseBlockEnabled(); }
 
     /**
      * Read multiple 512 byte blocks from an SD card.
@@ -51,7 +246,20 @@ public:
      * @param LEN [out] number of blocks to read
      * @return The number of blocks read, or a value < 0 for an error
      */
-    ssize_t readBlocks(uint32_t LBA, uint8_t* buf, const size_t LEN);
+    ssize_t readBlocks(uint32_t LBA, uint8_t* buf, const size_t LEN) {
+        const BlockSpan span{ buf, LEN };
+        return readBlocks(LBA, &span, 1);
+    }
+
+    /**
+     * Read consecutive blocks into a list of buffers (scatter). The whole list is one multi-block read, so it costs
+     * one command and one stop no matter how many buffers the blocks are spread over.
+     * @param LBA [in] first block to read
+     * @param spans [in] buffers to fill in order, each with the number of blocks it takes
+     * @param count [in] number of spans
+     * @return The number of blocks read, or a value < 0 for an error
+     */
+    ssize_t readBlocks(uint32_t LBA, const BlockSpan* spans, size_t count);
 
     /**
      * Write multiple 512 byte blocks to an SD card.
@@ -61,84 +269,432 @@ public:
      * @return the number of blocks written, or a negative value.
      * @note if All blocks are not written the state of the remaining blocks are undefined
      */
-    ssize_t writeBlocks(uint32_t LBA, const uint8_t* src, size_t LEN);
+    ssize_t writeBlocks(uint32_t LBA, const uint8_t* src, size_t LEN) {
+        const ConstBlockSpan span{ src, LEN };
+        return writeBlocks(LBA, &span, 1);
+    }
+
+    /**
+     * Write consecutive blocks from a list of buffers (gather). The whole list is one multi-block write, so it costs
+     * one command and one stop token no matter how many buffers the blocks come from.
+     * @param LBA [in] first block to write
+     * @param spans [in] buffers to write in order, each with the number of blocks it holds
+     * @param count [in] number of spans
+     * @return the number of blocks written, or a negative value.
+     * @note if All blocks are not written the state of the remaining blocks are undefined
+     */
+    ssize_t writeBlocks(uint32_t LBA, const ConstBlockSpan* spans, size_t count);
+
+    /**
+     * Erase a range of blocks (CMD32/CMD33/CMD38), for example blocks a filesystem has freed (TRIM). Erased blocks
+     * read back as all 0s or all 1s depending on the card, and are written faster afterwards. Cards without single
+     * block erase (CSD ERASE_BLK_EN clear) can only erase whole sectors of CSD::sectorSize() blocks, so only the
+     * sectors that lie entirely inside the range are erased there.
+     * @param firstLBA [in] first block to erase
+     * @param lastLBA [in] last block to erase, inclusive
+     * @return TRUE if the range was erased, or is too small to hold a whole erase sector. FALSE on an error
+     */
+    bool eraseBlocks(uint32_t firstLBA, uint32_t lastLBA);
+
+    /**
+     * Open a multi-block read (CMD18) that stays open across calls, so sequential reads pay the command and stop
+     * overhead once. The card stays selected until streamClose(), which any other operation calls first.
+     * @param LBA [in] first block of the stream
+     * @return TRUE if the card accepted the read
+     */
+    bool readStreamOpen(uint32_t LBA);
+
+    /**
+     * Read the next blocks of an open read stream. The stream is closed on an error.
+     * @param buf [in] location to write the incoming blocks
+     * @param LEN [in] number of blocks to read
+     * @return The number of blocks read, or a value < 0 if no read stream is open
+     */
+    ssize_t readStreamNext(uint8_t* buf, size_t LEN);
+
+    /**
+     * Open a multi-block write (CMD25) that stays open across calls, so a logger appending a block at a time pays
+     * the command and stop overhead once. The stop token is only sent by streamClose().
+     * @param LBA [in] first block of the stream
+     * @param expected [in] number of blocks the stream will write if known, sent as the ACMD23 pre-erase hint
+     * @return TRUE if the card accepted the write
+     */
+    bool writeStreamOpen(uint32_t LBA, uint32_t expected = 0);
+
+    /**
+     * Append blocks to an open write stream. Each block is programmed before the call returns. The stream is closed
+     * on an error.
+     * @param src [in] the data to be written
+     * @param LEN [in] number of blocks to be written
+     * @return the number of blocks written, or a value < 0 if no write stream is open
+     */
+    ssize_t writeStreamAppend(const uint8_t* src, size_t LEN);
+
+    /// TRUE while a read stream is open
+    bool readStreaming() const { return m_stream.mode == StreamMode::READ; }
+    /// TRUE while a write stream is open
+    bool writeStreaming() const { return m_stream.mode == StreamMode::WRITE; }
+    /// the block the open stream transfers next
+    uint32_t streamLBA() const { return m_stream.lba; }
+    /// end an open stream and deselect the card. Returns FALSE if the stop sequence failed
+    bool streamClose();
+    /// close the open stream once it has been idle for TimeoutPolicy::streamTimeout. Returns TRUE if it was closed
+    bool closeIdleStream();
+
+    /// called from pollAsync() when an asynchronous transfer finishes, with the blocks transferred or < 0
+    using AsyncCallback = void (*)(void* context, ssize_t result);
+
+    /// handle to the transfer started by readBlocksAsync(), writeBlocksAsync() or waitNotBusyAsync()
+    class BlockFuture {
+    public:
+        explicit BlockFuture(SpiCard& card) : m_card(&card) {}
+        /// advance the transfer, TRUE once it has finished
+        bool ready() { return m_card->pollAsync(); }
+        /// drive the transfer to completion. Returns the number of blocks transferred, or a value < 0 for an error
+        ssize_t get() { m_card->completeAsync(); return m_card->asyncResult(); }
+    private:
+        SpiCard* m_card;
+    };
+
+    /**
+     * Start reading multiple blocks without blocking. The transfer advances on pollAsync(), which waits for each
+     * data token one byte per call. With an asynchronous shim (see isAsyncShim) each block is also clocked in the
+     * background while the CPU verifies the CRC of the previous one; other shims clock the block inside the poll.
+     * @param LBA [in] Logical block to be read.
+     * @param buf [in] location to write the incoming blocks, valid until the transfer finishes
+     * @param LEN [in] number of blocks to read
+     * @param cb [in] optional completion callback, called from pollAsync()
+     * @param context [in] passed to the callback
+     */
+    BlockFuture readBlocksAsync(uint32_t LBA, uint8_t* buf, size_t LEN, AsyncCallback cb = nullptr, void* context = nullptr);
+
+    /**
+     * Start writing multiple blocks without blocking. The card busy period after each block and after the stop
+     * token is polled one byte per pollAsync() call. With an asynchronous shim the CRC of the next block is also
+     * computed while the current one is clocked out.
+     * @param LBA [in] logical block to be written.
+     * @param src [in] the data to be written, valid until the transfer finishes
+     * @param LEN [in] number of blocks to be written.
+     * @param cb [in] optional completion callback, called from pollAsync()
+     * @param context [in] passed to the callback
+     */
+    BlockFuture writeBlocksAsync(uint32_t LBA, const uint8_t* src, size_t LEN, AsyncCallback cb = nullptr, void* context = nullptr);
+
+    /**
+     * Wait for the card to finish programming without blocking, polling one byte per pollAsync() call.
+     * The result is 0 once the card is ready, or < 0 if it stays busy for longer than the write timeout.
+     * @param cb [in] optional completion callback, called from pollAsync()
+     * @param context [in] passed to the callback
+     */
+    BlockFuture waitNotBusyAsync(AsyncCallback cb = nullptr, void* context = nullptr);
+
+    /// advance the asynchronous transfer without blocking. Returns TRUE once no transfer is in progress
+    bool pollAsync();
+    /// drive any asynchronous transfer to completion
+    void completeAsync() { while(!pollAsync()) {} }
+    /// result of the last asynchronous transfer: blocks transferred, or a value < 0 for an error
+    ssize_t asyncResult() const { return m_async.result; }
 
 private:
+    enum class StreamMode : uint8_t { NONE, READ, WRITE };
+
+    struct Stream {
+        StreamMode       mode = StreamMode::NONE;
+        uint32_t         lba  = 0;      //< next block of the stream
+        SDPolicyTimeType lastUse{};
+    };
+
+    /// record the data response of a written block
+    void statWriteResponse(const uint8_t status) {
+        if((status & DATA_RES_MASK) == DATA_RES_ACCEPTED) { StatsPolicy::statData(true, 512); }
+        else if((status & DATA_RES_MASK) == DATA_RES_CRC_ERROR) { StatsPolicy::statCrcError(); }
+    }
+
+    /// times an operation with StatsPolicy for the lifetime of the scope
+    class OpScope {
+    public:
+        OpScope(SpiCard& card, const Operation op) : m_card(card), m_op(op) { m_card.statOpBegin(m_op); }
+        ~OpScope() { m_card.statOpEnd(m_op); }
+        OpScope(const OpScope&) = delete;
+        OpScope& operator=(const OpScope&) = delete;
+    private:
+        SpiCard&        m_card;
+        const Operation m_op;
+    };
+
+    /// finish whatever is holding the bus (asynchronous transfer or open stream) before a new operation
+    void releaseBus() {
+        completeAsync();
+        streamClose();
+    }
+
+    enum class AsyncState : uint8_t { IDLE, READ_TOKEN, READ_DATA, WRITE_DATA, WRITE_BUSY, STOP_BUSY, CARD_BUSY };
+
+    struct AsyncOp {
+        AsyncState       state   = AsyncState::IDLE;
+        uint8_t*         dst     = nullptr;
+        const uint8_t*   src     = nullptr;
+        size_t           count   = 0;
+        size_t           index   = 0;       //< block currently on the bus
+        ssize_t          result  = 0;
+        uint16_t         crc     = 0;       //< read: CRC sent with the block awaiting verification. write: CRC of the current block
+        uint16_t         nextCrc = 0;       //< write: CRC of the next block, computed while the current one is sent
+        bool             verify  = false;   //< read: a received block still needs its CRC checked
+        uint32_t         polls   = 0;       //< busy polls of the current busy state
+        SDPolicyTimeType t0{};
+        AsyncCallback    callback = nullptr;
+        void*            context  = nullptr;
+    };
+
+    /// start a background transfer, or run it inline when the shim has no background transfers
+    void transferStart(uint8_t* dst, const uint8_t* src, const size_t LEN) {
+        // a read starts with whatever a bulk poll already clocked
+        const size_t have = dst ? rxTake(dst, LEN) : 0;
+        if(!dst) { rxDrop(); }
+        if constexpr (isAsyncShim<SPIShim>::value) {
+            if(dst) { if(have < LEN) { SPIShim::startRead(dst + have, LEN - have); } }
+            else    { SPIShim::startWrite(src, LEN); }
+        }
+        else {
+            if(dst) { if(have < LEN) { SPIShim::read(dst + have, LEN - have); } }
+            else    { SPIShim::write(src, LEN); }
+        }
+    }
+    bool transferDone() {
+        if constexpr (isAsyncShim<SPIShim>::value) { return SPIShim::transferDone(); }
+        else                                       { return true; }
+    }
+
+    /// start clocking out block m_async.index, and compute the next block's CRC while it is in flight
+    void asyncSendBlock();
+    /// enter one of the busy polling states
+    void asyncBusy(const AsyncState state) {
+        m_async.state = state;
+        m_async.polls = 0;
+        m_async.t0    = TimeoutPolicy::getTime();
+        StatsPolicy::statBusyBegin();
+    }
+    /// check the CRC of a received block against the one the card sent with it
+    bool asyncVerify(size_t block);
+    /// blocks of the running read that arrived intact: the previous block is only counted once its CRC checks out
+    size_t asyncBlocksRead() { return m_async.verify && !asyncVerify(m_async.index - 1) ? m_async.index - 1 : m_async.index; }
+    /// finish the asynchronous transfer: optional stop sequence, deselect and notify
+    bool asyncEnd(ssize_t result, bool stop);
+
+    /// read a register the card sends as a data block after cmd (CID, CSD, SCR, SD Status)
+    bool readRegister(SDCMD cmd, bool app, uint32_t arg, uint8_t* dst, size_t LEN);
+
+    /// raise the clock from the identification speed to TRAN_SPEED, or to 50MHz if the card switches to High-Speed
+    void negotiateClock();
+
+    /**
+     * Send CMD55 and an application command in one shim write. The R1 of CMD55 is not read: ACMD_GAP fill bytes
+     * cover the longest NCR and the byte the card needs before the next command, and an error shows in the R1 of
+     * the application command anyway.
+     */
     Response1 cardAcmd(SDCMD cmd, uint32_t arg) {
-        cardCommand(SDCMD::CMD55, 0);
-        return cardCommand(cmd, arg);
+        waitCommandReady();
+        uint8_t buf[6 + ACMD_GAP + 6];
+        std::memcpy(buf, detail::commandFrame<SDCMD::CMD55, 0>.data(), 6);
+        std::memset(buf + 6, 0xFF, ACMD_GAP);
+        commandFrame(buf + 6 + ACMD_GAP, cmd, arg);
+        StatsPolicy::statCommand(SDCMD::CMD55, false, 0);
+        StatsPolicy::statCommand(cmd, true, arg);
+        txWrite(buf, sizeof(buf));
+        return commandResponse(cmd, true);
     }
 
-    Response1 cardCommand(SDCMD cmd, uint32_t arg = 0)
+    Response1 cardCommand(SDCMD cmd, uint32_t arg = 0, const bool app = false)
     {
-        // wait if busy unless CMD0
-        if (cmd != SDCMD::CMD0) {
-            waitNotBusy(TimeoutPolicy::cmdTimeout::value);
-        }
+        uint8_t buf[6];
+        commandFrame(buf, cmd, arg);
+        return sendCommand(cmd, arg, app, buf);
+    }
+
+    /// send a command whose argument is known at compile time, from a frame the compiler built with its CRC7
+    template<SDCMD CMD, uint32_t ARG = 0>
+    Response1 cardCommand() { return sendCommand(CMD, ARG, false, detail::commandFrame<CMD, ARG>.data()); }
+
+    /// form a command frame. Without CRC checking the CRC is only right for CMD0 and CMD8 with arg 0x1AA
+    void commandFrame(uint8_t* buf, const SDCMD cmd, const uint32_t arg) {
+        buf[0] = (uint8_t)0x40U | static_cast<uint8_t>(cmd);
+        buf[1] = (uint8_t)(arg >> 24U);
+        buf[2] = (uint8_t)(arg >> 16U);
+        buf[3] = (uint8_t)(arg >> 8U);
+        buf[4] = (uint8_t)arg;
 
         if(SDPolicy::useCRC7) {
-            const uint8_t rawCmd = static_cast<uint8_t>(cmd);
-            // form message
-            uint8_t buf[6];
-            buf[0] = (uint8_t)0x40U | rawCmd;
-            buf[1] = (uint8_t)(arg >> 24U);
-            buf[2] = (uint8_t)(arg >> 16U);
-            buf[3] = (uint8_t)(arg >> 8U);
-            buf[4] = (uint8_t)arg;
-
-            // add CRC
             buf[5] = SDPolicy::getCRC7(buf, 5);
-
-            // send message
-            SPIShim::write(buf, 6);
         }
         else {
-            // send command
-            SPIShim::write( static_cast<uint8_t>(cmd) |  uint8_t(0x40) );
+            // CRC - correct for CMD0 with arg zero or CMD8 with arg 0X1AA
+            buf[5] = (cmd == SDCMD::CMD0) ? uint8_t(0x95) : uint8_t(0x87);
+        }
+    }
 
-            // send argument
-            uint8_t *pa = reinterpret_cast<uint8_t *>(&arg);
-            for (int8_t i = 3; i >= 0; i--) {
-                SPIShim::write(pa[i]);
-            }
-            // send CRC - correct for CMD0 with arg zero or CMD8 with arg 0X1AA
-            const uint8_t writeVal = ( (cmd == SDCMD::CMD0) ? uint8_t(0x95) : uint8_t(0x87) );
-            SPIShim::write(writeVal);
+    Response1 sendCommand(const SDCMD cmd, const uint32_t arg, const bool app, const uint8_t* frame)
+    {
+        // wait if busy unless CMD0
+        if (cmd != SDCMD::CMD0) {
+            waitCommandReady();
         }
 
+        StatsPolicy::statCommand(cmd, app, arg);
+
+        // sent with one shim call so batching shims can queue it with the response poll
+        txWrite(frame, 6);
+        return commandResponse(cmd, app);
+    }
+
+    /// wait until the card can take a command, it may still be busy from the last operation
+    void waitCommandReady() {
+        waitNotBusy(TimeoutPolicy::cmdTimeout::value, m_nextBusy);
+        m_nextBusy = BusyKind::COMMAND;
+    }
+
+    Response1 commandResponse(const SDCMD cmd, const bool app) {
         // there are 1-8 fill bytes before response.  fill bytes should be 0XFF.
         const Response1 r1( waitResponse(TimeoutPolicy::cmdTimeout::value) );
+        StatsPolicy::statResponse(cmd, app, r1.rawStatus);
         return r1;
     }
 
     /// wait for count while outputting SD fill character
     void spiWait(const uint8_t count) {
-        for (uint8_t i = 0; i < count; i++) {
-            SPIShim::write(0xFF);
+        static constexpr uint8_t fill[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+        for (uint8_t left = count; left > 0;) {
+            const uint8_t n = left < sizeof(fill) ? left : sizeof(fill);
+            txWrite(fill, n);
+            left -= n;
+        }
+    }
+
+    /// send a byte without reading what comes back, so batching shims can queue it
+    void sendByte(const uint8_t val) { txWrite(&val, 1); }
+    /// send a data block CRC
+    void sendCRC(const uint16_t crc) {
+        const uint8_t buf[2] = { static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc & 0xFF) };
+        txWrite(buf, 2);
+    }
+
+    /// send bytes. Anything a bulk poll left over was clocked before them and is dropped
+    void txWrite(const uint8_t* buf, const size_t LEN) {
+        rxDrop();
+        SPIShim::write(buf, LEN);
+    }
+    void rxDrop() {
+        if constexpr (BULK_POLL) { m_poll.pos = m_poll.count = 0; }
+    }
+    /// copy up to LEN bytes left over from a bulk poll. Returns the number copied
+    size_t rxTake(uint8_t* buf, const size_t LEN) {
+        if constexpr (BULK_POLL) {
+            const size_t n = std::min<size_t>(m_poll.count - m_poll.pos, LEN);
+            std::memcpy(buf, m_poll.data.data() + m_poll.pos, n);
+            m_poll.pos += n;
+            return n;
+        }
+        else {
+            return 0;
+        }
+    }
+    /// next byte from the card: left over from a bulk poll, or clocked now
+    uint8_t rxByte() {
+        if constexpr (BULK_POLL) {
+            if(m_poll.pos < m_poll.count) { return m_poll.data[m_poll.pos++]; }
         }
+        return SPIShim::read();
+    }
+    /// read LEN bytes from the card, starting with any bulk poll left over
+    void rxRead(uint8_t* buf, const size_t LEN) {
+        const size_t have = rxTake(buf, LEN);
+        if(have < LEN) { SPIShim::read(buf + have, LEN - have); }
     }
 
+    struct PollResult {
+        uint8_t  value;     //< the byte that matched, or the last one seen
+        bool     found;
+        uint32_t polls;     //< bytes seen before the match
+    };
+
+    /**
+     * Clock fill bytes until match(byte) is TRUE or the timeout passes. Shims with pollRead are polled in chunks
+     * sized from what recent waits of the same kind needed, and the bytes after the match are kept for the next
+     * read. Other shims are polled a byte at a time. Timeouts are checked once per shim call, after
+     * pause(attempt) had its chance to let the CPU go.
+     */
+    template<class Match, class Pause = detail::NoPause>
+    PollResult pollFor(Match match, detail::PollKind kind, uint32_t timeoutMS, Pause pause = Pause());
+
     /**
-     * Check for busy.  MISO low indicates the card is busy.
+     * Check for busy.  MISO low indicates the card is busy. A timeout policy with busy pacing is told what the
+     * card is busy with, and gets to sleep between polls. A shared bus goes to other devices between polls, always
+     * while the policy sleeps.
      * @return true once the card is not busy response is 0xFF). False if timeout occurs
      */
-    bool waitNotBusy(const uint16_t timeoutMS) {
-        auto t0 = TimeoutPolicy::getTime();
-        while (SPIShim::read() != 0XFF) {
-            if (TimeoutPolicy::isTimedOut(t0, timeoutMS)) {
-                return false;
-            }
+    bool waitNotBusy(const uint32_t timeoutMS, const BusyKind busy = BusyKind::COMMAND) {
+        StatsPolicy::statBusyBegin();
+        const auto notBusy = [](const uint8_t b) { return b == 0xFF; };
+        PollResult r{};
+        if constexpr (BUSY_PACING) {
+            TimeoutPolicy::busyBegin(busy);
+            r = pollFor(notBusy, detail::PollKind::BUSY, timeoutMS, [this, busy](const uint32_t attempt) {
+                if constexpr (BUS_YIELD) { SPIShim::suspend(true); }
+                TimeoutPolicy::busyPause(busy, attempt);
+                if constexpr (BUS_YIELD) { SPIShim::resume(); }
+            });
+            TimeoutPolicy::busyEnd(busy, r.found, r.polls);
         }
-        return true;
+        else if constexpr (BUS_YIELD) {
+            (void)busy;
+            r = pollFor(notBusy, detail::PollKind::BUSY, timeoutMS, [this](uint32_t) {
+                SPIShim::suspend(false);
+                SPIShim::resume();
+            });
+        }
+        else {
+            (void)busy;
+            r = pollFor(notBusy, detail::PollKind::BUSY, timeoutMS);
+        }
+        StatsPolicy::statBusyEnd(r.polls, r.found);
+        return r.found;
+    }
+
+    /**
+     * Busy timeout for erasing `blocks` blocks, and at least TimeoutPolicy::eraseTimeout. From the SD Status when the
+     * card reports its erase timing: ERASE_TIMEOUT seconds per ERASE_SIZE AUs, plus ERASE_OFFSET. Otherwise the SD
+     * specification's 250ms per AU. Without an SD Status the AU is taken as 4MB, the largest of an SDHC card, so cards
+     * with larger AUs get more time than they need.
+     */
+    uint32_t eraseTimeoutMS(const uint32_t blocks) const {
+        const uint64_t auBlocks = m_info.auBlocks ? m_info.auBlocks : 8192;
+        const uint64_t aus      = (uint64_t(blocks) + auBlocks - 1) / auBlocks;
+        uint64_t ms = aus * 250;
+        if(m_info.eraseSize != 0 && m_info.eraseTimeout != 0) {
+            ms = aus * m_info.eraseTimeout * 1000 / m_info.eraseSize + uint64_t(m_info.eraseOffset) * 1000;
+        }
+        ms = std::max<uint64_t>(ms, TimeoutPolicy::eraseTimeout::value);
+        return static_cast<uint32_t>(std::min<uint64_t>(ms, UINT32_MAX));
     }
 
+    /// wait for an R1 response (or anything that is not fill)
     uint8_t waitResponse(const uint16_t timeoutMS) {
-        uint8_t response;
-        auto t0 = TimeoutPolicy::getTime();
-        do {
-            response = SPIShim::write(0xFF);
-        } while(response == 0xFF && !TimeoutPolicy::isTimedOut(t0, timeoutMS) );
-        return response;
+        return pollFor([](const uint8_t b) { return b != 0xFF; }, detail::PollKind::RESPONSE, timeoutMS).value;
+    }
+    /// wait for a data token. Bytes clocked after it are the start of the data block
+    uint8_t waitToken(const uint16_t timeoutMS) {
+        return pollFor([](const uint8_t b) { return b != 0xFF; }, detail::PollKind::TOKEN, timeoutMS).value;
+    }
+
+    /// TRUE unless the shim checks its link and found a byte lost or corrupted since the last check
+    bool linkIntact() {
+        if constexpr (LINK_CHECK) {
+            if(!SPIShim::linkCheck()) {
+                SPISD_DEBUG("    Link CRC mismatch!\n");
+                StatsPolicy::statCrcError();
+                return false;
+            }
+        }
+        return true;
     }
 
     /// start a read operation
@@ -148,7 +704,7 @@ private:
     /// end a multi-block read sequence
     bool readStop();
     /// start a multi-block write with an erase command before starting
-    bool writeStart(uint32_t LBA, const uint32_t COUNT);
+    bool writeStart(uint32_t LBA, const uint32_t COUNT, bool preErase = true);
     /// write a single 512 block of data, with CRC and response check
     bool writeData(const uint8_t token, const uint8_t* src);
     /// Stop a write
@@ -159,26 +715,138 @@ private:
     static constexpr uint8_t WRITE_MULTIPLE_TOKEN = 0xFC;   //< start data token for write multiple blocks
     static constexpr uint8_t DATA_RES_MASK = 0x1F;          //< mask for data response tokens after a write block operation
     static constexpr uint8_t DATA_RES_ACCEPTED = 0x05;      //< write data accepted token
+    static constexpr uint8_t DATA_RES_CRC_ERROR = 0x0B;     //< write data rejected due to a CRC error
+    static constexpr uint8_t ACMD_GAP = 9;                  //< fill bytes between CMD55 and the command: NCR max + 1
+    static constexpr uint16_t CCC_ERASE = 1U << 5;          //< CSD command class 5: erase commands
+    static constexpr uint16_t CCC_APP_SPECIFIC = 1U << 8;   //< CSD command class 8: application commands (ACMD13, ACMD51)
+    static constexpr uint16_t CCC_SWITCH = 1U << 10;        //< CSD command class 10: switch function (CMD6)
+    static constexpr uint32_t INIT_CLOCK_HZ = 400000;       //< clock limit until the card has left the idle state
+    static constexpr uint32_t HIGH_SPEED_CLOCK_HZ = 50000000;   //< clock limit after switching to High-Speed
+
+    /// data blocks are moved and CRC'd in chunks of this size, so the CRC of one chunk can run while
+    /// the next one is on the bus (DMA or posted-write shims)
+    static constexpr size_t DATA_CHUNK = detail::shimChunkSize<SPIShim>::value;
+    static_assert(DATA_CHUNK > 0 && 512 % DATA_CHUNK == 0, "shim chunkSize must divide the 512 byte block");
+
+    /// shims with pollRead are polled in chunks of up to POLL_CHUNK_MAX bytes
+    static constexpr bool   BULK_POLL      = detail::hasPollRead<SPIShim>::value;
+    static constexpr size_t POLL_CHUNK_MAX = 64;
+    static_assert(POLL_CHUNK_MAX < 512, "a poll must not clock past the data block it waits for");
+    using Backlog = std::conditional_t<BULK_POLL, detail::PollBacklog<POLL_CHUNK_MAX>, detail::NoBacklog>;
+
+    /// the timeout policy paces busy waits (see detail::hasBusyPacing)
+    static constexpr bool BUSY_PACING = detail::hasBusyPacing<TimeoutPolicy>::value;
+
+    /// busy waits hand a shared bus to other devices (see detail::hasBusYield)
+    static constexpr bool BUS_YIELD = detail::hasBusYield<SPIShim>::value;
+
+    /// data block CRCs come from the shim's CRC unit, and block transfers are checked against the adapter's CRC
+    static constexpr bool CRC_UNIT   = detail::usesPeripheralCRC<SDPolicy>::value && detail::hasCRCUnit<SPIShim>::value;
+    static constexpr bool LINK_CHECK = detail::usesPeripheralCRC<SDPolicy>::value && detail::hasLinkCheck<SPIShim>::value;
 
     ErrorCode       m_errorCode;
     CardType        m_type;
+    CardInfo        m_info;
+    uint32_t        m_clockHz   = 0;
+    bool            m_highSpeed = false;
+    BusyKind        m_nextBusy  = BusyKind::COMMAND;    //< what the wait before the next command waits for
+    AsyncOp         m_async;
+    Stream          m_stream;
+    Backlog         m_poll;
 };
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+template<class Match, class Pause>
+typename SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::PollResult
+SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::pollFor(Match match, const detail::PollKind kind,
+                                                               const uint32_t timeoutMS, Pause pause)
 {
+    PollResult r{ 0xFF, false, 0 };
+
+    // bytes an earlier poll clocked come first
+    if constexpr (BULK_POLL) {
+        while(m_poll.pos < m_poll.count) {
+            r.value = m_poll.data[m_poll.pos++];
+            if(match(r.value)) {
+                r.found = true;
+                return r;
+            }
+            r.polls++;
+        }
+    }
+
+    auto t0 = TimeoutPolicy::getTime();
+    uint32_t clocked  = 0;
+    uint32_t attempts = 0;
+    for(;;) {
+        if constexpr (BULK_POLL) {
+            auto& adapt = m_poll.adapt[static_cast<size_t>(kind)];
+            const size_t n = adapt.chunk(POLL_CHUNK_MAX);
+            SPIShim::pollRead(m_poll.data.data(), n);
+            for(size_t i = 0; i < n; ++i) {
+                r.value = m_poll.data[i];
+                if(match(r.value)) {
+                    // keep the rest, for a token it is the start of the block
+                    m_poll.pos   = static_cast<uint16_t>(i + 1);
+                    m_poll.count = static_cast<uint16_t>(n);
+                    adapt.update(clocked + i + 1);
+                    r.found = true;
+                    return r;
+                }
+                r.polls++;
+            }
+            m_poll.pos = m_poll.count = 0;
+            clocked += n;
+        }
+        else {
+            (void)kind;
+            r.value = SPIShim::read();
+            if(match(r.value)) {
+                r.found = true;
+                return r;
+            }
+            r.polls++;
+        }
+        pause(attempts++);
+        if(TimeoutPolicy::isTimedOut(t0, timeoutMS)) {
+            if constexpr (BULK_POLL) { m_poll.adapt[static_cast<size_t>(kind)].update(clocked); }
+            return r;
+        }
+    }
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::begin()
+{
+    // end a transfer or stream still open from before, a write session's blocks are committed by its stop token
+    releaseBus();
+
+    OpScope scope(*this, Operation::INIT);
     m_errorCode = ErrorCode::NONE;
     m_type      = CardType::UNK;
+    m_info      = CardInfo();
+    m_clockHz   = 0;
+    m_highSpeed = false;
+    m_nextBusy  = BusyKind::COMMAND;
+    m_async     = AsyncOp();
+    m_stream    = Stream();
+    rxDrop();
     Response1 r1;
 
     SPIShim::begin();
+    if constexpr (detail::hasLinkCheck<SPIShim>::value) {
+        // the host's copy of the adapter's CRC costs a pass over every byte, keep it only if it gets checked
+        SPIShim::linkCheckEnable(LINK_CHECK);
+    }
+    if constexpr (detail::hasSetClock<SPIShim>::value) {
+        // a card (re)starting its identification may not be clocked faster
+        m_clockHz = SPIShim::setClock(INIT_CLOCK_HZ);
+    }
 
     // must supply min of 74 clock cycles with CS high.
     SPISD_DEBUG("Sending 80 clock cycles of 0xFF...\n");
     SPIShim::deSelect();
-    for(int i = 0; i < 10; i++) {
-        SPIShim::write(0xFF);
-    }
+    spiWait(10);
 
     // Set Idle state: If MCU is reset but SD card is not, it may ignore the first CMD0
     // TODO: better loop (without break) and more checks from other drivers
@@ -188,7 +856,7 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
 
         spiWait(4);
         SPIShim::select();
-        r1 = cardCommand( SDCMD::CMD0 );
+        r1 = cardCommand<SDCMD::CMD0>();
         SPIShim::deSelect();
         spiWait(2);
 
@@ -196,6 +864,7 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
             SPISD_DEBUG("    CMD0 Success!\n");
             break;
         }
+        StatsPolicy::statRetry();
 
         spiWait(1);
         SPIShim::select();
@@ -218,14 +887,14 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
     SPISD_DEBUG("Sending CMD8: check SD version...\n");
     spiWait(4);
     SPIShim::select();
-    r1 = cardCommand(SDCMD::CMD8, 0x1AA);
+    r1 = cardCommand<SDCMD::CMD8, 0x1AA>();
     if(r1.illegalCommand()) {
         SPISD_DEBUG("    CMD8 Invalid - SDv1\n");
         m_type = CardType::SD1;
     }
     else {
         uint8_t r7[4];
-        SPIShim::read(r7, 4);
+        rxRead(r7, 4);
 
         if (r7[3] == 0XAA) {
             SPISD_DEBUG("    SD Card Type: SD2\n");
@@ -239,10 +908,24 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
     SPIShim::deSelect();
     spiWait(2);
 
+    // a policy that sends a valid CRC7 with every command has the card check them, and the data CRC16 too
+    if constexpr (SDPolicy::useCRC7) {
+        SPISD_DEBUG("Sending CMD59: turn CRC checking on...\n");
+        SPIShim::select();
+        r1 = cardCommand<SDCMD::CMD59, 1>();
+        SPIShim::deSelect();
+        spiWait(2);
+        if(!r1) {
+            SPISD_DEBUG("    CMD59 Failed! (0x%02X)\n", r1.rawStatus);
+            return false;
+        }
+    }
+
     // initialize card and send host supports SDHC if SD2
     // TODO: check CMD1 for old cards if ACMD41 returns an error or no response
     const uint32_t arg = (m_type == CardType::SD2 ? 0X40000000 : 0);
     for(int i = 0; i < 3 && !r1.ready(); ++i ) {
+        if(i > 0) { StatsPolicy::statRetry(); }
         SPISD_DEBUG("Sending ACMD41: activate card init %s...\n", (arg == 0 ? "" : "and asserting SDHC capabilty" ) );
 
         SPIShim::select();
@@ -290,68 +973,172 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::begin()
         }
     }
 
+    if(!refreshInfo()) { return false; }
+    if constexpr (detail::hasSetClock<SPIShim>::value) { negotiateClock(); }
     return true;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-std::optional<CID> SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readCID()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+void SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::negotiateClock()
 {
-    CID cid;
-    bool success = false;
+    uint32_t hz = m_info.maxClockHz ? m_info.maxClockHz : INIT_CLOCK_HZ;
+
+    // High-Speed needs CMD6, which came with version 1.1 of the physical layer specification
+    if(m_info.hasSCR && m_info.scr.sdSpec() >= 1 && (m_info.ccc & CCC_SWITCH)) {
+        const auto check = switchFunction(false, 1, 1);
+        if(check.has_value() && check->highSpeedSupported() && check->accessMode() == 1) {
+            const auto sw = switchFunction(true, 1, 1);
+            if(sw.has_value() && sw->accessMode() == 1) {
+                SPISD_DEBUG("    Switched to High-Speed\n");
+                m_highSpeed = true;
+                hz = HIGH_SPEED_CLOCK_HZ;
+            }
+        }
+    }
 
-    SPIShim::select();
-    const auto r1 = cardCommand(SDCMD::CMD10, 0);
-    if(r1) {
-        const auto dt = waitResponse(TimeoutPolicy::cmdTimeout::value);
-        if(DATA_START_BLOCK == dt) {
-            success = SPIShim::read(cid.raw.data(), cid.raw.size());
+    m_clockHz = SPIShim::setClock(hz);
+    SPISD_DEBUG("SPI clock: %u Hz\n", m_clockHz);
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::refreshInfo()
+{
+    CardInfo info;
+    const auto cid = readCID();
+    const auto csd = readCSD();
+    const auto ocr = readOCR();
+    if(!cid.has_value() || !csd.has_value() || !ocr.has_value()) {
+        SPISD_DEBUG("Failed to read the card registers!\n");
+        m_info = info;
+        return false;
+    }
+    info.cid         = *cid;
+    info.csd         = *csd;
+    info.ocr         = *ocr;
+    info.blockCount  = csd->blockCount();
+    info.eraseBlocks = csd->eraseBlockEnabled() ? 1 : csd->sectorSize();
+    info.maxClockHz  = csd->maxClockHz();
+    info.ccc         = csd->ccc();
+    info.valid       = true;
+
+    // the SCR and SD Status are application specific commands (class 8), optional for old cards
+    if(info.ccc & CCC_APP_SPECIFIC) {
+        if(const auto scr = readSCR(); scr.has_value()) {
+            info.scr    = *scr;
+            info.hasSCR = true;
+        }
+        if(const auto status = readSDStatus(); status.has_value()) {
+            info.auBlocks      = status->auBlocks();
+            info.eraseSize     = status->eraseSize();
+            info.eraseTimeout  = status->eraseTimeout();
+            info.eraseOffset   = status->eraseOffset();
+            info.speedClass    = status->speedClass();
+            info.uhsSpeedGrade = status->uhsSpeedGrade();
+            info.hasStatus     = true;
         }
     }
-    SPIShim::deSelect();
-    spiWait(2);
-    return success ? std::optional<CID>(cid) : std::optional<CID>();
+    m_info = info;
+    return true;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-std::optional<CSD> SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readCSD()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readRegister(const SDCMD cmd, const bool app,
+                                                                         const uint32_t arg, uint8_t* dst, const size_t LEN)
 {
-    CSD csd;
+    releaseBus();
+    OpScope scope(*this, Operation::REGISTER);
     bool success = false;
 
     SPIShim::select();
-    const auto r1 = cardCommand(SDCMD::CMD9, 0);
+    const auto r1 = app ? cardAcmd(cmd, arg) : cardCommand(cmd, arg);
+    // ACMD13 answers with R2, its second byte follows R1
+    if(r1 && app && cmd == SDCMD::ACMD13) { rxByte(); }
     if(r1) {
-        const auto dt = waitResponse(TimeoutPolicy::cmdTimeout::value);
+        const auto dt = waitToken(TimeoutPolicy::cmdTimeout::value);
+        StatsPolicy::statDataToken(dt);
         if(DATA_START_BLOCK == dt) {
-            success = SPIShim::read(csd.raw.data(), csd.raw.size());
+            rxRead(dst, LEN);
+            success = true;
+            StatsPolicy::statData(false, LEN);
         }
     }
     SPIShim::deSelect();
     spiWait(2);
-    return success ? std::optional<CSD>(csd) : std::optional<CSD>();
+    return success;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<CID> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readCID()
+{
+    CID cid;
+    return readRegister(SDCMD::CMD10, false, 0, cid.raw.data(), cid.raw.size()) ? std::optional<CID>(cid) : std::optional<CID>();
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<CSD> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readCSD()
+{
+    CSD csd;
+    return readRegister(SDCMD::CMD9, false, 0, csd.raw.data(), csd.raw.size()) ? std::optional<CSD>(csd) : std::optional<CSD>();
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<SCR> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readSCR()
+{
+    SCR scr;
+    return readRegister(SDCMD::ACMD51, true, 0, scr.raw.data(), scr.raw.size()) ? std::optional<SCR>(scr) : std::optional<SCR>();
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-std::optional<OCR> SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readOCR()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<SwitchStatus> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::switchFunction(const bool set,
+                                                                                                  const uint8_t group,
+                                                                                                  const uint8_t function)
 {
+    if(group < 1 || group > 6 || function > 0x0F) { return std::optional<SwitchStatus>(); }
+    // every group is 0xF (keep the current function) except the one being checked or set
+    const uint32_t shift = 4U * (group - 1U);
+    const uint32_t arg   = (set ? 0x80000000UL : 0UL) | (0x00FFFFFFUL & ~(0x0FUL << shift)) | (uint32_t(function) << shift);
+    SwitchStatus status;
+    return readRegister(SDCMD::CMD6, false, arg, status.raw.data(), status.raw.size())
+        ? std::optional<SwitchStatus>(status) : std::optional<SwitchStatus>();
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<SDStatus> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readSDStatus()
+{
+    SDStatus status;
+    return readRegister(SDCMD::ACMD13, true, 0, status.raw.data(), status.raw.size())
+        ? std::optional<SDStatus>(status) : std::optional<SDStatus>();
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+std::optional<OCR> SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readOCR()
+{
+    releaseBus();
+    OpScope scope(*this, Operation::REGISTER);
     OCR ocr;  // return value OCR register
     bool success = false;
 
     SPIShim::select();
-    if(const auto r1 = cardCommand(SDCMD::CMD58, 0); r1) {
-        success = SPIShim::read(ocr.raw.data(), ocr.raw.size());
+    if(const auto r1 = cardCommand<SDCMD::CMD58>(); r1) {
+        rxRead(ocr.raw.data(), ocr.raw.size());
+        success = true;
+        StatsPolicy::statData(false, ocr.raw.size());
     }
     SPIShim::deSelect();
     spiWait(2);
     return success ? std::optional<OCR>(ocr) : std::optional<OCR>();
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readBlocks(uint32_t LBA, uint8_t* buf, const size_t LEN)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readBlocks(uint32_t LBA, const BlockSpan* spans, const size_t count)
 {
+    const size_t LEN = detail::spanBlocks(spans, count);
+    if(LEN == 0) { return 0; }
+    releaseBus();
+    OpScope scope(*this, Operation::READ);
     ssize_t readCount = 0;
 
-    SPISD_DEBUG("Reading %d blocks starting at block 0x%08X\n", LEN, LBA);
+    SPISD_DEBUG("Reading %d blocks in %d buffers starting at block 0x%08X\n", LEN, count, LBA);
     spiWait(1);
     SPIShim::select();
     if(!readStart(LBA, LEN)) {
@@ -360,13 +1147,17 @@ ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readBlocks(uint32_t LBA, uint
         return -1;
     }
 
-    for(readCount = 0; readCount < LEN; readCount++, buf += 512) {
-        SPISD_DEBUG("  Reading block %d!\n", readCount);
-        if(!readData(buf)) {
-            SPISD_DEBUG("    Read Data Failed!\n");
-            SPIShim::deSelect();
-            spiWait(2);
-            break;
+    bool ok = true;
+    for(size_t s = 0; ok && s < count; ++s) {
+        uint8_t* buf = spans[s].data;
+        for(size_t b = 0; b < spans[s].blocks; ++b, buf += 512) {
+            SPISD_DEBUG("  Reading block %d!\n", readCount);
+            if(!readData(buf)) {
+                SPISD_DEBUG("    Read Data Failed!\n");
+                ok = false;
+                break;
+            }
+            readCount++;
         }
     }
 
@@ -375,15 +1166,19 @@ ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readBlocks(uint32_t LBA, uint
     }
     SPIShim::deSelect();
     spiWait(2);
-    return readCount;
+    return linkIntact() ? readCount : -1;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeBlocks(uint32_t LBA, const uint8_t* src, const size_t LEN)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeBlocks(uint32_t LBA, const ConstBlockSpan* spans, const size_t count)
 {
+    const size_t LEN = detail::spanBlocks(spans, count);
+    if(LEN == 0) { return 0; }
+    releaseBus();
+    OpScope scope(*this, Operation::WRITE);
     ssize_t writeCount = 0;
 
-    SPISD_DEBUG("Writing %d blocks starting at block 0x%08X\n", LEN, LBA);
+    SPISD_DEBUG("Writing %d blocks from %d buffers starting at block 0x%08X\n", LEN, count, LBA);
     spiWait(1);
     SPIShim::select();
     if(!writeStart(LBA, LEN)) {
@@ -395,21 +1190,24 @@ ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeBlocks(uint32_t LBA, con
     spiWait(1);
 
     const uint8_t startToken = LEN > 1 ? WRITE_MULTIPLE_TOKEN : DATA_START_BLOCK;
-    for(writeCount = 0; writeCount < LEN; writeCount++, src += 512) {
-        SPISD_DEBUG("  Writing block %d!\n", writeCount);
-        if(!writeData(startToken, src)) {
-            if(LEN > 1) { writeStop(); }
-            SPIShim::deSelect();
-            spiWait(2);
-            SPISD_DEBUG("    Write Data Failed!\n");
-            break;
-        }
+    bool ok = true;
+    for(size_t s = 0; ok && s < count; ++s) {
+        const uint8_t* src = spans[s].data;
+        for(size_t b = 0; b < spans[s].blocks; ++b, src += 512) {
+            SPISD_DEBUG("  Writing block %d!\n", writeCount);
+            if(!writeData(startToken, src)) {
+                SPISD_DEBUG("    Write Data Failed!\n");
+                ok = false;
+                break;
+            }
 
-        if(!waitNotBusy(TimeoutPolicy::writeTimeout::value)) {
-            SPIShim::deSelect();
-            spiWait(2);
-            SPISD_DEBUG("    Post-Write timeout!\n");
-            return -1;
+            if(!waitNotBusy(TimeoutPolicy::writeTimeout::value, LEN > 1 ? BusyKind::PROGRAM : BusyKind::COMMIT)) {
+                SPIShim::deSelect();
+                spiWait(2);
+                SPISD_DEBUG("    Post-Write timeout!\n");
+                return -1;
+            }
+            writeCount++;
         }
     }
 
@@ -442,11 +1240,59 @@ ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeBlocks(uint32_t LBA, con
 
     SPIShim::deSelect();
     spiWait(2);
-    return writeCount;
+    return linkIntact() ? writeCount : -1;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::eraseBlocks(uint32_t firstLBA, uint32_t lastLBA)
+{
+    if(!m_info.valid || lastLBA < firstLBA || lastLBA >= m_info.blockCount) { return false; }
+    if(!(m_info.ccc & CCC_ERASE)) {
+        m_errorCode = ErrorCode::FUNCTION_NOT_SUPPORTED;
+        return false;
+    }
+
+    if(m_info.eraseBlocks > 1) {
+        // the card erases every sector the range touches, shrink it to the sectors it covers completely
+        const uint64_t sector = m_info.eraseBlocks;
+        const uint64_t first  = (firstLBA + sector - 1) / sector * sector;
+        const uint64_t end    = (uint64_t(lastLBA) + 1) / sector * sector;
+        if(end <= first) { return true; }
+        firstLBA = static_cast<uint32_t>(first);
+        lastLBA  = static_cast<uint32_t>(end - 1);
+    }
+
+    releaseBus();
+    OpScope scope(*this, Operation::ERASE);
+    SPISD_DEBUG("Erasing blocks 0x%08X to 0x%08X\n", firstLBA, lastLBA);
+    const uint32_t timeoutMS = eraseTimeoutMS(lastLBA - firstLBA + 1);
+
+    // Byte addressing for non-sdhc cards, so multiply address by 512
+    if(m_type != CardType::SDHC) {
+        firstLBA <<= 9;
+        lastLBA  <<= 9;
+    }
+
+    spiWait(1);
+    SPIShim::select();
+    bool success = cardCommand(SDCMD::CMD32, firstLBA).ready()
+                && cardCommand(SDCMD::CMD33, lastLBA).ready()
+                && cardCommand<SDCMD::CMD38>().ready();
+    if(!success) {
+        SPISD_DEBUG("    Erase sequence failed!\n");
+    }
+    else if(!waitNotBusy(timeoutMS, BusyKind::ERASE)) {
+        SPISD_DEBUG("    Erase timeout!\n");
+        m_errorCode = ErrorCode::ERASE_TIMEOUT;
+        success = false;
+    }
+    SPIShim::deSelect();
+    spiWait(2);
+    return success;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readStart(uint32_t LBA, const uint32_t COUNT)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readStart(uint32_t LBA, const uint32_t COUNT)
 {
     // Byte addressing for non-sdhc cards, so multiply address by 512
     if(m_type != CardType::SDHC) { LBA = LBA<<9; }
@@ -460,23 +1306,62 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readStart(uint32_t LBA, const ui
     return r1;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readData(uint8_t* buf)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readData(uint8_t* buf)
 {
-    const uint8_t dt = waitResponse(TimeoutPolicy::cmdTimeout::value);
+    const uint8_t dt = waitToken(TimeoutPolicy::cmdTimeout::value);
+    StatsPolicy::statDataToken(dt);
     if(DATA_START_BLOCK == dt) {
-        SPIShim::read(buf, 512);
-
-        const uint16_t crc = (SPIShim::read() << 8) | SPIShim::read();
+        uint16_t calcCrc = SDPolicy::CRC_CCITT_init();
+        uint8_t crcBytes[2];
+        if constexpr (CRC_UNIT) {
+            // the unit hashes the block and its CRC as they arrive, which leaves 0 for an intact block. The bytes a
+            // bulk poll clocked past the token came before it started, their CRC is computed here and folded in
+            const size_t have = rxTake(buf, 512);
+            SPIShim::crcStart();
+            if constexpr (detail::hasQueueRead<SPIShim>::value) { SPIShim::queueRead(buf + have, 512 - have); }
+            else                                                { SPIShim::read(buf + have, 512 - have); }
+            SPIShim::read(crcBytes, 2);
+            const uint16_t head = SDPolicy::useCRC16
+                ? SDPolicy::CRC_CCITT_final(SDPolicy::CRC_CCITT_update(SDPolicy::CRC_CCITT_init(), buf, have))
+                : tableBasedCRC::CRC_CCITT(buf, have);
+            if(detail::crc16Combine(head, SPIShim::crcRead(), 512 - have + 2) != 0) {
+                SPISD_DEBUG("    CRC check failed! (0x%04X)\n", (crcBytes[0] << 8) | crcBytes[1]);
+                StatsPolicy::statCrcError();
+                return false;
+            }
+            StatsPolicy::statData(false, 512);
+            return true;
+        }
+        else if constexpr (detail::hasQueueRead<SPIShim>::value) {
+            // block and CRC come back in one transaction, after whatever the token poll already clocked
+            const size_t have = rxTake(buf, 512);
+            SPIShim::queueRead(buf + have, 512 - have);
+            SPIShim::read(crcBytes, 2);
+            if(SDPolicy::useCRC16) { calcCrc = SDPolicy::CRC_CCITT_update(calcCrc, buf, 512); }
+        }
+        else {
+            // fold each chunk into the CRC as soon as it has arrived
+            for(size_t i = 0; i < 512; i += DATA_CHUNK) {
+                rxRead(buf + i, DATA_CHUNK);
+                if(SDPolicy::useCRC16) {
+                    calcCrc = SDPolicy::CRC_CCITT_update(calcCrc, buf + i, DATA_CHUNK);
+                }
+            }
+            rxRead(crcBytes, 2);
+        }
+        const uint16_t crc = (crcBytes[0] << 8) | crcBytes[1];
 
-        if( SDPolicy::useCRC16 && (crc != SDPolicy::CRC_CCITT(buf, 512)) ) {
+        if( SDPolicy::useCRC16 && (crc != SDPolicy::CRC_CCITT_final(calcCrc)) ) {
             SPISD_DEBUG("    CRC check failed! (0x%04X)\n", crc);
+            StatsPolicy::statCrcError();
             return false;
         }
+        StatsPolicy::statData(false, 512);
         return true;
     }
 
-    if(dt == 0xFF) { SPISD_DEBUG("    Timed Out with no response! (0x%02X)\n", dt); }
+    if(dt == 0xFF) { SPISD_DEBUG("    Timed Out with no response! (0x%02X)\n", dt); StatsPolicy::statTimeout(); }
     else if(dt & (1UL<<1)) { SPISD_DEBUG("    CC ERROR! (0x%02X)\n", dt); }
     else if(dt & (1UL<<2)) { SPISD_DEBUG("    CARD ECC FAILED! (0x%02X)\n", dt); }
     else if(dt & (1UL<<3)) { SPISD_DEBUG("    ADDRESS OUT OF RANGE! (0x%02X)\n", dt); }
@@ -484,18 +1369,18 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readData(uint8_t* buf)
     return false;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::readStop()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readStop()
 {
-    const auto r = cardCommand(SDCMD::CMD12);
+    const auto r = cardCommand<SDCMD::CMD12>();
     if(!r.ready()) {
         SPISD_DEBUG("CMD12 Error: Stopping Read (0x%02X)\n", r.rawStatus);
     }
     return r.ready();
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeStart(uint32_t LBA, const uint32_t COUNT)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeStart(uint32_t LBA, const uint32_t COUNT, const bool preErase)
 {
     // Byte addressing for non-sdhc cards, so multiply address by 512
     if(m_type != CardType::SDHC) { LBA = LBA<<9; }
@@ -504,10 +1389,12 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeStart(uint32_t LBA, const u
 
     // send pre-erase count for faster writing if we are writing multiple blocks
     if(COUNT > 1) {
-        r = cardAcmd(SDCMD::ACMD23, COUNT);
-        if (!r.ready()) {
-            SPISD_DEBUG("ACMD23 Error! (0x02X)\n", r.rawStatus);
-            return false;
+        if(preErase) {
+            r = cardAcmd(SDCMD::ACMD23, COUNT);
+            if (!r.ready()) {
+                SPISD_DEBUG("ACMD23 Error! (0x02X)\n", r.rawStatus);
+                return false;
+            }
         }
 
         r = cardCommand(SDCMD::CMD25, LBA);
@@ -520,32 +1407,401 @@ bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeStart(uint32_t LBA, const u
     return r;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeData(const uint8_t token, const uint8_t* src)
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeData(const uint8_t token, const uint8_t* src)
 {
-    const uint16_t crc = SDPolicy::CRC_CCITT(src, 512);
+    sendByte(token);
 
-    SPIShim::write(token);
-    SPIShim::write(src, 512);
-    SPIShim::write(crc >> 8);
-    SPIShim::write(crc & 0xFF);
+    if constexpr (CRC_UNIT) {
+        // the unit hashes the block on its way out
+        SPIShim::crcStart();
+        txWrite(src, 512);
+        sendCRC(SPIShim::crcRead());
+    }
+    else {
+        // hand each chunk to the shim first, then fold it into the CRC while it is being sent
+        uint16_t crc = SDPolicy::CRC_CCITT_init();
+        for(size_t i = 0; i < 512; i += DATA_CHUNK) {
+            txWrite(src + i, DATA_CHUNK);
+            crc = SDPolicy::CRC_CCITT_update(crc, src + i, DATA_CHUNK);
+        }
+        sendCRC(SDPolicy::CRC_CCITT_final(crc));
+    }
 
-    const uint8_t status = SPIShim::read();
+    const uint8_t status = rxByte();
     const bool success = (status & DATA_RES_MASK) == DATA_RES_ACCEPTED;
     if (!success) {
         SPISD_DEBUG("    BLOCK WRITE ERROR! (0x%02X)\n", status);
     }
+    statWriteResponse(status);
     return success;
 }
 
-template<class SPIShim, class SDPolicy, class TimeoutPolicy >
-bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy>::writeStop()
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeStop()
 {
     if (!waitNotBusy(TimeoutPolicy::writeTimeout::value)) {
         SPISD_DEBUG("    Write Stop: SD card timed out as busy!\n");
         return false;
     }
-    SPIShim::write(STOP_TRAN_TOKEN);
+    sendByte(STOP_TRAN_TOKEN);
+    // the card commits the transaction while the next command waits
+    m_nextBusy = BusyKind::COMMIT;
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readStreamOpen(const uint32_t LBA)
+{
+    releaseBus();
+
+    SPISD_DEBUG("Opening read stream at block 0x%08X\n", LBA);
+    spiWait(1);
+    SPIShim::select();
+    // a count above one selects CMD18, which runs until CMD12
+    if(!readStart(LBA, 2)) {
+        SPIShim::deSelect();
+        spiWait(2);
+        return false;
+    }
+
+    m_stream.mode    = StreamMode::READ;
+    m_stream.lba     = LBA;
+    m_stream.lastUse = TimeoutPolicy::getTime();
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readStreamNext(uint8_t* buf, const size_t LEN)
+{
+    if(m_stream.mode != StreamMode::READ) { return -1; }
+    OpScope scope(*this, Operation::READ_STREAM);
+
+    for(size_t i = 0; i < LEN; ++i, buf += 512) {
+        if(!readData(buf)) {
+            SPISD_DEBUG("    Stream read failed at block 0x%08X!\n", m_stream.lba);
+            streamClose();
+            return i;
+        }
+        m_stream.lba++;
+    }
+    if(!linkIntact()) {
+        streamClose();
+        return -1;
+    }
+    m_stream.lastUse = TimeoutPolicy::getTime();
+    return LEN;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeStreamOpen(const uint32_t LBA, const uint32_t expected)
+{
+    releaseBus();
+
+    SPISD_DEBUG("Opening write stream at block 0x%08X (%d expected)\n", LBA, expected);
+    spiWait(1);
+    SPIShim::select();
+    // CMD25 even for a single expected block, the hint is only sent when it is worth a pre-erase
+    if(!writeStart(LBA, expected > 1 ? expected : 2, expected > 1)) {
+        SPIShim::deSelect();
+        spiWait(2);
+        return false;
+    }
+    spiWait(1);
+
+    m_stream.mode    = StreamMode::WRITE;
+    m_stream.lba     = LBA;
+    m_stream.lastUse = TimeoutPolicy::getTime();
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+ssize_t SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeStreamAppend(const uint8_t* src, const size_t LEN)
+{
+    if(m_stream.mode != StreamMode::WRITE) { return -1; }
+    OpScope scope(*this, Operation::WRITE_STREAM);
+
+    for(size_t i = 0; i < LEN; ++i, src += 512) {
+        if(!writeData(WRITE_MULTIPLE_TOKEN, src) || !waitNotBusy(TimeoutPolicy::writeTimeout::value, BusyKind::PROGRAM)) {
+            SPISD_DEBUG("    Stream write failed at block 0x%08X!\n", m_stream.lba);
+            streamClose();
+            return i;
+        }
+        m_stream.lba++;
+    }
+    if(!linkIntact()) {
+        streamClose();
+        return -1;
+    }
+    m_stream.lastUse = TimeoutPolicy::getTime();
+    return LEN;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::streamClose()
+{
+    if(m_stream.mode == StreamMode::NONE) { return true; }
+
+    SPISD_DEBUG("Closing stream at block 0x%08X\n", m_stream.lba);
+    bool ok;
+    if(m_stream.mode == StreamMode::READ) {
+        ok = readStop();
+    }
+    else {
+        ok = writeStop();
+        spiWait(1);
+    }
+    SPIShim::deSelect();
+    spiWait(2);
+    m_stream.mode = StreamMode::NONE;
+    return ok;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::closeIdleStream()
+{
+    if(m_stream.mode == StreamMode::NONE) { return false; }
+    if(!TimeoutPolicy::isTimedOut(m_stream.lastUse, TimeoutPolicy::streamTimeout::value)) { return false; }
+    streamClose();
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+typename SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::BlockFuture
+SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::readBlocksAsync(uint32_t LBA, uint8_t* buf, const size_t LEN, AsyncCallback cb, void* context)
+{
+    releaseBus();
+
+    m_async = AsyncOp();
+    StatsPolicy::statOpBegin(Operation::READ);
+    m_async.dst      = buf;
+    m_async.count    = LEN;
+    m_async.callback = cb;
+    m_async.context  = context;
+
+    SPISD_DEBUG("Async reading %d blocks starting at block 0x%08X\n", LEN, LBA);
+    if(LEN == 0) {
+        asyncEnd(0, false);
+        return BlockFuture(*this);
+    }
+
+    spiWait(1);
+    SPIShim::select();
+    if(!readStart(LBA, LEN)) {
+        asyncEnd(-1, false);
+        return BlockFuture(*this);
+    }
+
+    m_async.state = AsyncState::READ_TOKEN;
+    m_async.t0    = TimeoutPolicy::getTime();
+    return BlockFuture(*this);
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+typename SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::BlockFuture
+SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::writeBlocksAsync(uint32_t LBA, const uint8_t* src, const size_t LEN, AsyncCallback cb, void* context)
+{
+    releaseBus();
+
+    m_async = AsyncOp();
+    StatsPolicy::statOpBegin(Operation::WRITE);
+    m_async.src      = src;
+    m_async.count    = LEN;
+    m_async.callback = cb;
+    m_async.context  = context;
+
+    SPISD_DEBUG("Async writing %d blocks starting at block 0x%08X\n", LEN, LBA);
+    if(LEN == 0) {
+        asyncEnd(0, false);
+        return BlockFuture(*this);
+    }
+
+    spiWait(1);
+    SPIShim::select();
+    if(!writeStart(LBA, LEN)) {
+        asyncEnd(-1, false);
+        return BlockFuture(*this);
+    }
+    spiWait(1);
+
+    m_async.crc = SDPolicy::CRC_CCITT(src, 512);
+    asyncSendBlock();
+    return BlockFuture(*this);
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+typename SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::BlockFuture
+SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::waitNotBusyAsync(AsyncCallback cb, void* context)
+{
+    releaseBus();
+
+    m_async = AsyncOp();
+    m_async.count    = 1;
+    m_async.callback = cb;
+    m_async.context  = context;
+
+    spiWait(1);
+    SPIShim::select();
+    asyncBusy(AsyncState::CARD_BUSY);
+    return BlockFuture(*this);
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::pollAsync()
+{
+    AsyncOp& op = m_async;
+    switch(op.state) {
+        case AsyncState::IDLE:
+            return true;
+
+        case AsyncState::READ_TOKEN: {
+            const uint8_t dt = rxByte();
+            if(dt == 0xFF) {
+                if(TimeoutPolicy::isTimedOut(op.t0, TimeoutPolicy::readTimeout::value)) {
+                    SPISD_DEBUG("    Async read timed out waiting for block %d\n", op.index);
+                    StatsPolicy::statTimeout();
+                    return asyncEnd(asyncBlocksRead(), true);
+                }
+                return false;
+            }
+            StatsPolicy::statDataToken(dt);
+            if(dt != DATA_START_BLOCK) {
+                SPISD_DEBUG("    Async read error token! (0x%02X)\n", dt);
+                return asyncEnd(asyncBlocksRead(), true);
+            }
+
+            transferStart(op.dst + op.index * 512, nullptr, 512);
+            op.state = AsyncState::READ_DATA;
+
+            // the previous block is checked while this one is on the bus
+            if(op.verify && !asyncVerify(op.index - 1)) {
+                return asyncEnd(op.index - 1, true);
+            }
+            return false;
+        }
+
+        case AsyncState::READ_DATA: {
+            if(!transferDone()) { return false; }
+            uint8_t crcBytes[2];
+            rxRead(crcBytes, 2);
+            op.crc    = (crcBytes[0] << 8) | crcBytes[1];
+            op.verify = SDPolicy::useCRC16;
+            StatsPolicy::statData(false, 512);
+
+            if(++op.index < op.count) {
+                op.state = AsyncState::READ_TOKEN;
+                op.t0    = TimeoutPolicy::getTime();
+                return false;
+            }
+            if(op.verify && !asyncVerify(op.index - 1)) {
+                return asyncEnd(op.index - 1, true);
+            }
+            return asyncEnd(op.count, true);
+        }
+
+        case AsyncState::WRITE_DATA: {
+            if(!transferDone()) { return false; }
+            sendCRC(op.crc);
+
+            const uint8_t status = rxByte();
+            statWriteResponse(status);
+            if((status & DATA_RES_MASK) != DATA_RES_ACCEPTED) {
+                SPISD_DEBUG("    BLOCK WRITE ERROR! (0x%02X)\n", status);
+                return asyncEnd(op.index, true);
+            }
+            asyncBusy(AsyncState::WRITE_BUSY);
+            return false;
+        }
+
+        case AsyncState::WRITE_BUSY: {
+            // one byte per poll: the CPU is free while the card programs the block
+            if(rxByte() != 0xFF) {
+                op.polls++;
+                if(TimeoutPolicy::isTimedOut(op.t0, TimeoutPolicy::writeTimeout::value)) {
+                    SPISD_DEBUG("    Post-Write timeout!\n");
+                    StatsPolicy::statBusyEnd(op.polls, false);
+                    return asyncEnd(-1, false);
+                }
+                return false;
+            }
+            StatsPolicy::statBusyEnd(op.polls, true);
+            if(++op.index < op.count) {
+                op.crc = op.nextCrc;
+                asyncSendBlock();
+                return false;
+            }
+            if(op.count > 1) {
+                // the card is busy again after the stop token, keep polling instead of spinning
+                sendByte(STOP_TRAN_TOKEN);
+                spiWait(1);
+                asyncBusy(AsyncState::STOP_BUSY);
+                return false;
+            }
+            return asyncEnd(op.count, false);
+        }
+
+        case AsyncState::STOP_BUSY:
+        case AsyncState::CARD_BUSY: {
+            if(rxByte() != 0xFF) {
+                op.polls++;
+                if(TimeoutPolicy::isTimedOut(op.t0, TimeoutPolicy::writeTimeout::value)) {
+                    SPISD_DEBUG("    Card busy timeout!\n");
+                    StatsPolicy::statBusyEnd(op.polls, false);
+                    return asyncEnd(-1, false);
+                }
+                return false;
+            }
+            StatsPolicy::statBusyEnd(op.polls, true);
+            return asyncEnd(op.state == AsyncState::STOP_BUSY ? ssize_t(op.count) : 0, false);
+        }
+    }
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+void SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::asyncSendBlock()
+{
+    AsyncOp& op = m_async;
+    sendByte(op.count > 1 ? WRITE_MULTIPLE_TOKEN : DATA_START_BLOCK);
+    transferStart(nullptr, op.src + op.index * 512, 512);
+    op.state = AsyncState::WRITE_DATA;
+
+    if(op.index + 1 < op.count) {
+        op.nextCrc = SDPolicy::CRC_CCITT(op.src + (op.index + 1) * 512, 512);
+    }
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::asyncVerify(const size_t block)
+{
+    m_async.verify = false;
+    if(m_async.crc != SDPolicy::CRC_CCITT(m_async.dst + block * 512, 512)) {
+        SPISD_DEBUG("    CRC check failed! (0x%04X)\n", m_async.crc);
+        StatsPolicy::statCrcError();
+        return false;
+    }
+    return true;
+}
+
+template<class SPIShim, class SDPolicy, class TimeoutPolicy, class StatsPolicy >
+bool SpiCard<SPIShim, SDPolicy, TimeoutPolicy, StatsPolicy>::asyncEnd(const ssize_t result, const bool stop)
+{
+    AsyncOp& op = m_async;
+    if(op.count > 0) {
+        while(!transferDone()) {}
+        if(stop && op.count > 1) {
+            if(op.dst) { readStop(); }
+            else       { writeStop(); spiWait(1); }
+        }
+        SPIShim::deSelect();
+        spiWait(2);
+    }
+
+    if(op.dst)      { StatsPolicy::statOpEnd(Operation::READ); }
+    else if(op.src) { StatsPolicy::statOpEnd(Operation::WRITE); }
+    op.state  = AsyncState::IDLE;
+    op.result = result;
+    if(op.callback) { op.callback(op.context, result); }
     return true;
 }
 
@@ -24,6 +24,7 @@
 #ifndef SDCARD_INFO_H
 #define SDCARD_INFO_H
 #include <cstdint>
+#include <array>
 
 namespace sd {
 
@@ -86,6 +87,7 @@ enum class SDCMD : uint8_t {
     ACMD22 = 0x16,    //< SEND_NUM_WR_BLOCKS - Send the number of the written (without errors) write blocks.
     ACMD23 = 0x17,    //< SET_WR_BLK_ERASE_COUNT - Set the number of write blocks to be pre-erased before writing
     ACMD41 = 0x29,    //< SD_SEND_OP_COMD - Sends host capacity support information and activates the card's initialization process
+    ACMD51 = 0x33,    //< SEND_SCR - Reads the SD Configuration Register (SCR).
 };
 
 struct CardStatus {
@@ -265,6 +267,12 @@ struct CSD {
     constexpr uint8_t nsac() const { return raw[2]; }
     /// defines the max transfer rate for one data line according to table in the specification
     constexpr uint8_t transferSpeed() const { return raw[3]; }
+    /// the max transfer rate decoded from transferSpeed() as a clock in Hz (25MHz for default speed, 50MHz for high speed)
+    constexpr uint32_t maxClockHz() const {
+        constexpr uint8_t  value[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };  // times 10
+        constexpr uint32_t unit[4]   = { 10000, 100000, 1000000, 10000000 };                            // per 10
+        return (raw[3] & 0x04) ? 0 : unit[raw[3] & 0x03] * value[(raw[3] >> 3) & 0x0F];
+    }
     /// defines the compatable SD classes. Each bit represents a class. see the specification.
     constexpr uint_least16_t ccc() const { return (((uint16_t)raw[4])<<4) | ((raw[5]&0xF0)>>4); }
 
@@ -344,6 +352,96 @@ struct CSD {
 };
 static_assert(sizeof(CSD) == 16, "CSD response must be 16 bytes!");
 
+struct SCR {
+    /// version of the SCR structure (0 for all current cards)
+    constexpr uint8_t scrStructure() const { return raw[0]>>4; }
+    /// physical layer specification version, with sdSpec3() and sdSpec4(): 0 = 1.0, 1 = 1.1, 2 = 2.0 or later
+    constexpr uint8_t sdSpec() const { return raw[0]&0x0F; }
+    /// the value erased blocks read back as, 0 or 1
+    constexpr uint8_t dataStatAfterErase() const { return raw[1]>>7; }
+    /// supported security (CPRM) version
+    constexpr uint8_t security() const { return (raw[1]&0x70)>>4; }
+    /// supported data bus widths, bit 0: 1 bit, bit 2: 4 bit
+    constexpr uint8_t busWidths() const { return raw[1]&0x0F; }
+    /// TRUE for physical layer specification 3.0 or later
+    constexpr bool sdSpec3() const { return raw[2]&0x80; }
+    /// TRUE for physical layer specification 4.0 or later
+    constexpr bool sdSpec4() const { return raw[2]&0x04; }
+    /// TRUE if the card supports CMD23 (SET_BLOCK_COUNT)
+    constexpr bool cmd23Supported() const { return raw[3]&0x02; }
+    /// TRUE if the card supports CMD20 (SPEED_CLASS_CONTROL)
+    constexpr bool cmd20Supported() const { return raw[3]&0x01; }
+
+    std::array<uint8_t, 8> raw;     //< raw data of the SCR register
+};
+static_assert(sizeof(SCR) == 8, "SCR must be 8 bytes!");
+
+struct SDStatus {
+    /// speed class in MB/s: 0, 2, 4, 6 or 10
+    constexpr uint8_t speedClass() const {
+        return raw[8] == 4 ? 10 : (raw[8] < 4 ? raw[8] * 2 : 0);
+    }
+    /// minimum sequential write speed of the performance move in MB/s, 0 if not defined
+    constexpr uint8_t performanceMove() const { return raw[9]; }
+    /// size of an allocation unit (AU) in 512 byte blocks, 0 if not defined
+    constexpr uint32_t auBlocks() const {
+        constexpr uint32_t large[] = { 16384, 24576, 32768, 49152, 65536, 131072 };
+        const uint8_t au = raw[10]>>4;
+        return au == 0 ? 0 : (au < 0x0A ? 32UL << (au - 1) : large[au - 0x0A]);
+    }
+    /// number of AUs erased at once in the ERASE_TIMEOUT, 0 if no timeout calculation is supported
+    constexpr uint16_t eraseSize() const { return (((uint16_t)raw[11])<<8) | raw[12]; }
+    /// time in seconds to erase eraseSize() AUs
+    constexpr uint8_t eraseTimeout() const { return raw[13]>>2; }
+    /// fixed erase time in seconds added to every erase
+    constexpr uint8_t eraseOffset() const { return raw[13]&0x03; }
+    /// UHS speed grade in MB/s: 0, 10 or 30
+    constexpr uint8_t uhsSpeedGrade() const { return (raw[14]>>4) == 3 ? 30 : (raw[14]>>4) * 10; }
+    /// video speed class in MB/s (V6 to V90), 0 if not supported
+    constexpr uint8_t videoSpeedClass() const { return raw[15]; }
+
+    std::array<uint8_t, 64> raw;    //< raw data of the SD Status (ACMD13)
+};
+static_assert(sizeof(SDStatus) == 64, "SD Status must be 64 bytes!");
+
+struct SwitchStatus {
+    /// maximum current consumption of the selected functions in mA, 0 if the selection failed
+    constexpr uint16_t maxCurrent() const { return (((uint16_t)raw[0])<<8) | raw[1]; }
+    /// functions of group 1 (access mode) the card supports, one bit per function
+    constexpr uint16_t accessModes() const { return (((uint16_t)raw[12])<<8) | raw[13]; }
+    /// TRUE if the card supports High-Speed (function 1 of group 1)
+    constexpr bool highSpeedSupported() const { return raw[13]&0x02; }
+    /// function of group 1 that is (check) or was (switch) selected, 0xF if the requested one can not be selected
+    constexpr uint8_t accessMode() const { return raw[16]&0x0F; }
+
+    std::array<uint8_t, 64> raw;    //< raw data of the switch function status (CMD6)
+};
+static_assert(sizeof(SwitchStatus) == 64, "Switch function status must be 64 bytes!");
+
+/**
+ * Registers read by SpiCard::begin() and the geometry decoded from them once, so capacity and erase queries cost
+ * a member read instead of a register read on the bus. The SD Status is not kept, only the fields decoded from it.
+ */
+struct CardInfo {
+    CID      cid{};
+    CSD      csd{};
+    OCR      ocr{};
+    SCR      scr{};
+    uint32_t blockCount    = 0;         //< capacity in 512 byte blocks
+    uint32_t eraseBlocks   = 0;         //< smallest erasable unit in blocks: 1 with ERASE_BLK_EN, the CSD sector otherwise
+    uint32_t auBlocks      = 0;         //< allocation unit in blocks from the SD Status, 0 if unknown
+    uint32_t maxClockHz    = 0;         //< clock allowed by the CSD TRAN_SPEED
+    uint16_t ccc           = 0;         //< command classes, one bit per class
+    uint16_t eraseSize     = 0;         //< AUs erased in eraseTimeout seconds, 0 if unknown
+    uint8_t  eraseTimeout  = 0;         //< seconds per eraseSize AUs
+    uint8_t  eraseOffset   = 0;         //< seconds added to every erase
+    uint8_t  speedClass    = 0;         //< speed class in MB/s, 0 if unknown
+    uint8_t  uhsSpeedGrade = 0;         //< UHS speed grade in MB/s, 0 if unknown or not UHS
+    bool     valid         = false;     //< CID, CSD and OCR were read
+    bool     hasSCR        = false;     //< the card answered ACMD51
+    bool     hasStatus     = false;     //< the card answered ACMD13, the SD Status fields are set
+};
+
 }   // namespace sd
 
 #endif  // Header guard
@@ -0,0 +1,291 @@
+#ifndef SDCARD_SDCOROUTINE_H
+#define SDCARD_SDCOROUTINE_H
+
+/**
+ * C++20 coroutine front-end for sd::SpiCard.
+ *
+ * co_readBlocks/co_writeBlocks/co_waitNotBusy return awaitables built on the card's non-blocking transfer API
+ * (readBlocksAsync, writeBlocksAsync, waitNotBusyAsync). A task awaiting one of them is suspended while the card
+ * sends a token or programs flash, and sd::co::Scheduler polls the card between resuming the other tasks:
+ *
+ *     sd::co::Task<> logger(Card& card) {
+ *         ssize_t n = co_await sd::co::co_writeBlocks(card, lba, buf, 8);
+ *         ...
+ *     }
+ *
+ *     sd::co::Scheduler sched;
+ *     sched.spawn(logger(card));
+ *     sched.spawn(ui());
+ *     sched.run();
+ *
+ * A card runs one transfer at a time. Tasks sharing a card queue on it in the order they were suspended.
+ * Exceptions are not used: an exception escaping a task terminates.
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+namespace sd { namespace co {
+
+class Scheduler;
+
+namespace detail {
+    struct PromiseBase {
+        Scheduler*              scheduler    = nullptr;
+        std::coroutine_handle<> continuation = nullptr;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template<class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+                // resume whoever awaited this task, root tasks return to the scheduler
+                const auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+    };
+
+    template<class T>
+    struct Promise : PromiseBase {
+        T value{};
+        void return_value(T v) { value = std::move(v); }
+        T result() { return std::move(value); }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase {
+        void return_void() {}
+        void result() {}
+    };
+}   // detail namespace
+
+/**
+ * Lazily started coroutine. Awaiting a Task runs it on the awaiting task's scheduler and yields its co_return
+ * value. Top level tasks are handed to Scheduler::spawn().
+ */
+template<class T = void>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : detail::Promise<T> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            if(m_handle) { m_handle.destroy(); }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { if(m_handle) { m_handle.destroy(); } }
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    template<class Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> caller) noexcept {
+        m_handle.promise().scheduler    = caller.promise().scheduler;
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    friend class Scheduler;
+    explicit Task(handle_type h) : m_handle(h) {}
+    handle_type release() { return std::exchange(m_handle, nullptr); }
+
+    handle_type m_handle;
+};
+
+/**
+ * Round-robin scheduler. Ready tasks are resumed in order; suspended tasks register a poll function which is
+ * called once per pass and makes them ready again when it returns TRUE. run() returns when every spawned task
+ * has finished. Firmware with its own main loop can call runOnce() from it instead.
+ */
+class Scheduler {
+public:
+    using PollFn = bool (*)(void* context);
+
+    Scheduler() = default;
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    /// destroy the unfinished tasks. A task suspended on a card transfer waits for the transfer to end first
+    ~Scheduler() {
+        for(auto h : m_roots) { h.destroy(); }
+    }
+
+    /// take ownership of a top level task and queue it to start on the next pass
+    void spawn(Task<>&& task) {
+        auto h = task.release();
+        if(!h) { return; }
+        h.promise().scheduler = this;
+        m_roots.push_back(h);
+        m_ready.push_back(h);
+    }
+
+    /// resume every ready task once and poll every suspended one. Returns TRUE while any task is unfinished
+    bool runOnce() {
+        std::vector<std::coroutine_handle<>> ready;
+        ready.swap(m_ready);
+        for(auto h : ready) { h.resume(); }
+
+        for(size_t i = 0; i < m_waiting.size();) {
+            if(m_waiting[i].poll(m_waiting[i].context)) {
+                m_ready.push_back(m_waiting[i].handle);
+                m_waiting.erase(m_waiting.begin() + i);
+            }
+            else {
+                ++i;
+            }
+        }
+
+        for(size_t i = 0; i < m_roots.size();) {
+            if(m_roots[i].done()) {
+                m_roots[i].destroy();
+                m_roots.erase(m_roots.begin() + i);
+            }
+            else {
+                ++i;
+            }
+        }
+        return !m_roots.empty();
+    }
+
+    /// run until every spawned task has finished
+    void run() { while(runOnce()) {} }
+
+    /// suspend h until poll(context) returns TRUE
+    void suspend(std::coroutine_handle<> h, PollFn poll, void* context) {
+        m_waiting.push_back(Waiter{ h, poll, context });
+    }
+
+    /// awaitable that lets the other tasks run for one pass
+    struct YieldAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template<class Promise>
+        void await_suspend(std::coroutine_handle<Promise> h) noexcept { h.promise().scheduler->m_ready.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+
+private:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        PollFn                  poll;
+        void*                   context;
+    };
+
+    std::vector<std::coroutine_handle<Task<>::promise_type>> m_roots;
+    std::vector<std::coroutine_handle<>>                     m_ready;
+    std::vector<Waiter>                                      m_waiting;
+};
+
+/// co_await sd::co::yield() to give the other tasks a turn
+inline Scheduler::YieldAwaiter yield() { return {}; }
+
+namespace detail {
+    /**
+     * Awaitable for one card transfer. The transfer is started once the card is idle, then the card is polled
+     * until the completion callback fires. The result of the transfer is delivered by the callback so a task
+     * queued on the same card cannot overwrite it.
+     */
+    template<class Card, class Start>
+    class CardAwaiter {
+    public:
+        CardAwaiter(Card& card, Start start) : m_card(&card), m_start(start) {}
+        CardAwaiter(const CardAwaiter&) = delete;
+        CardAwaiter& operator=(const CardAwaiter&) = delete;
+        /// a task destroyed while suspended (its Scheduler went away) drains its transfer, the card holds a callback
+        /// into this awaiter until the transfer ends
+        ~CardAwaiter() {
+            if(m_started && !m_done) { m_card->completeAsync(); }
+        }
+
+        bool await_ready() const noexcept { return false; }
+        template<class Promise>
+        void await_suspend(std::coroutine_handle<Promise> h) {
+            h.promise().scheduler->suspend(h, &CardAwaiter::poll, this);
+        }
+        ssize_t await_resume() const noexcept { return m_result; }
+
+    private:
+        static bool poll(void* context) {
+            auto* self = static_cast<CardAwaiter*>(context);
+            if(!self->m_started) {
+                if(!self->m_card->pollAsync()) { return false; }
+                self->m_started = true;
+                self->m_start(*self->m_card, &CardAwaiter::done, self);
+            }
+            if(!self->m_done) { self->m_card->pollAsync(); }
+            return self->m_done;
+        }
+        static void done(void* context, const ssize_t result) {
+            auto* self = static_cast<CardAwaiter*>(context);
+            self->m_result = result;
+            self->m_done   = true;
+        }
+
+        Card*   m_card;
+        Start   m_start;
+        ssize_t m_result  = -1;
+        bool    m_started = false;
+        bool    m_done    = false;
+    };
+
+    template<class Card, class Start>
+    CardAwaiter<Card, Start> makeCardAwaiter(Card& card, Start start) { return CardAwaiter<Card, Start>(card, start); }
+}   // detail namespace
+
+/**
+ * Read blocks from a coroutine. The awaiting task is suspended until the transfer is done.
+ * @return the number of blocks read, or a value < 0 for an error
+ */
+template<class Card>
+auto co_readBlocks(Card& card, const uint32_t LBA, uint8_t* buf, const size_t LEN) {
+    return detail::makeCardAwaiter(card, [=](Card& c, typename Card::AsyncCallback cb, void* ctx) {
+        c.readBlocksAsync(LBA, buf, LEN, cb, ctx);
+    });
+}
+
+/**
+ * Write blocks from a coroutine. The awaiting task is suspended while the data is sent and while the card
+ * programs each block.
+ * @return the number of blocks written, or a value < 0 for an error
+ */
+template<class Card>
+auto co_writeBlocks(Card& card, const uint32_t LBA, const uint8_t* src, const size_t LEN) {
+    return detail::makeCardAwaiter(card, [=](Card& c, typename Card::AsyncCallback cb, void* ctx) {
+        c.writeBlocksAsync(LBA, src, LEN, cb, ctx);
+    });
+}
+
+/**
+ * Suspend until the card has finished programming.
+ * @return 0 once the card is ready, or a value < 0 if it stayed busy past the write timeout
+ */
+template<class Card>
+auto co_waitNotBusy(Card& card) {
+    return detail::makeCardAwaiter(card, [](Card& c, typename Card::AsyncCallback cb, void* ctx) {
+        c.waitNotBusyAsync(cb, ctx);
+    });
+}
+
+}}  // namespace sd::co
+
+#endif  // coroutine support
+#endif  // SDCARD_SDCOROUTINE_H
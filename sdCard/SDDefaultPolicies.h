@@ -5,15 +5,80 @@
 #ifndef SDCARD_SDDEFAULTPOLICIES_H
 #define SDCARD_SDDEFAULTPOLICIES_H
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "SDCard_info.h"
 
 namespace sd {
 
+    namespace detail {
+        /// CRC7 (x^7 + x^3 + 1) register after folding in each byte value, kept left aligned so a whole byte is
+        /// folded in with one lookup
+        constexpr std::array<uint8_t, 256> makeCRC7Table() {
+            std::array<uint8_t, 256> t{};
+            for(unsigned i = 0; i < 256; ++i) {
+                uint8_t c = static_cast<uint8_t>(i);
+                for(int j = 0; j < 8; ++j) { c = static_cast<uint8_t>((c & 0x80) ? (c << 1) ^ 0x12 : (c << 1)); }
+                t[i] = c;
+            }
+            return t;
+        }
+        inline constexpr std::array<uint8_t, 256> CRC7_TABLE = makeCRC7Table();
+
+        /// CRC7 as it ends a command frame: the CRC in bits 7..1 and the end bit set
+        constexpr uint8_t crc7(const uint8_t* data, const size_t n) {
+            uint8_t crc = 0;
+            for(size_t i = 0; i < n; ++i) { crc = CRC7_TABLE[crc ^ data[i]]; }
+            return crc | uint8_t(1);
+        }
+
+        /// GF(2) matrix of a CRC16 (x^16 + x^12 + x^5 + 1) step: column i is where register bit i ends up
+        using CRC16Matrix = std::array<uint16_t, 16>;
+        constexpr uint16_t crc16Apply(const CRC16Matrix& m, uint16_t crc) {
+            uint16_t r = 0;
+            for(size_t i = 0; crc != 0; ++i, crc >>= 1) { if(crc & 1U) { r ^= m[i]; } }
+            return r;
+        }
+        /// the register after 2^k zero bytes, for k = 0..15
+        constexpr std::array<CRC16Matrix, 16> makeCRC16Shifts() {
+            std::array<CRC16Matrix, 16> t{};
+            for(size_t i = 0; i < 16; ++i) {
+                uint16_t c = static_cast<uint16_t>(1U << i);
+                for(int j = 0; j < 8; ++j) { c = static_cast<uint16_t>((c & 0x8000) ? (c << 1) ^ 0x1021 : (c << 1)); }
+                t[0][i] = c;
+            }
+            for(size_t k = 1; k < 16; ++k) {
+                for(size_t i = 0; i < 16; ++i) { t[k][i] = crc16Apply(t[k - 1], t[k - 1][i]); }
+            }
+            return t;
+        }
+        inline constexpr std::array<CRC16Matrix, 16> CRC16_SHIFTS = makeCRC16Shifts();
+
+        /// CRC16 register after `bytes` (< 64K) more zero bytes, one matrix step per bit set in bytes
+        constexpr uint16_t crc16Shift(uint16_t crc, size_t bytes) {
+            for(size_t k = 0; bytes != 0 && k < 16; ++k, bytes >>= 1) {
+                if(bytes & 1U) { crc = crc16Apply(CRC16_SHIFTS[k], crc); }
+            }
+            return crc;
+        }
+        /// CRC16 of A followed by B from the CRC of each: the data CRC is linear, so the bytes are not needed again
+        constexpr uint16_t crc16Combine(const uint16_t crcA, const uint16_t crcB, const size_t lenB) {
+            return static_cast<uint16_t>(crc16Shift(crcA, lenB) ^ crcB);
+        }
+    }   // detail namespace
+
     struct noCRC {
         static constexpr bool useCRC7  = false;
         static constexpr bool useCRC16 = false;
         uint8_t getCRC7(const uint8_t *data, const uint8_t n) { return 0xFF; }
         uint16_t CRC_CCITT(const uint8_t* data, const size_t n) { return 0xFFFF; }
+
+        uint16_t CRC_CCITT_init() { return 0xFFFF; }
+        uint16_t CRC_CCITT_update(const uint16_t crc, const uint8_t* data, const size_t n) { return crc; }
+        uint16_t CRC_CCITT_final(const uint16_t crc) { return crc; }
     };
 
     struct ShiftedCRC {
@@ -36,7 +101,12 @@ namespace sd {
         }
 
         uint16_t CRC_CCITT(const uint8_t* data, const size_t n) {
-            uint16_t crc = 0;
+            return CRC_CCITT_final(CRC_CCITT_update(CRC_CCITT_init(), data, n));
+        }
+
+        /// incremental form: init, then update over each chunk in order, then final
+        uint16_t CRC_CCITT_init() { return 0; }
+        uint16_t CRC_CCITT_update(uint16_t crc, const uint8_t* data, const size_t n) {
             for (size_t i = 0; i < n; i++) {
                 crc = (uint8_t)(crc >> 8) | (crc << 8);
                 crc ^= data[i];
@@ -46,13 +116,14 @@ namespace sd {
             }
             return crc;
         }
+        uint16_t CRC_CCITT_final(const uint16_t crc) { return crc; }
     };
 
     struct tableBasedCRC {
         static constexpr bool useCRC7  = false;
         static constexpr bool useCRC16 = true;
 
-        static constexpr getCRC7(const uint8_t *data, const uint8_t n) { return 0xFF; }
+        static constexpr uint8_t getCRC7(const uint8_t *data, const uint8_t n) { return detail::crc7(data, n); }
 
         static constexpr uint16_t crctab[] = {
                 0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
@@ -90,12 +161,44 @@ namespace sd {
         };
 
         static constexpr uint16_t CRC_CCITT(const uint8_t* data, const size_t n) {
-            uint16_t crc = 0;
+            return CRC_CCITT_final(CRC_CCITT_update(CRC_CCITT_init(), data, n));
+        }
+
+        static constexpr uint16_t CRC_CCITT_init() { return 0; }
+        static constexpr uint16_t CRC_CCITT_update(uint16_t crc, const uint8_t* data, const size_t n) {
             for (size_t i = 0; i < n; i++) {
                 crc = crctab[(crc >> 8 ^ data[i]) & 0XFF] ^ (crc << 8);
             }
             return crc;
         }
+        static constexpr uint16_t CRC_CCITT_final(const uint16_t crc) { return crc; }
+    };
+
+    /**
+     * Turns on CRC checking in the card (CMD59 during begin()) on top of a CRC16 policy. Every command then needs
+     * a valid CRC7: commands with a fixed argument are sent from frames built at compile time, the others take one
+     * table lookup per byte. The card also rejects data blocks with a bad CRC16, so Base must compute it.
+     */
+    template<class Base = tableBasedCRC>
+    struct CRCChecked : Base {
+        static_assert(Base::useCRC16, "a card checking CRCs rejects every data block without a valid CRC16");
+        static constexpr bool useCRC7 = true;
+        static constexpr uint8_t getCRC7(const uint8_t* data, const uint8_t n) { return detail::crc7(data, n); }
+    };
+
+    /**
+     * Leaves data block CRC16s to the peripheral where the shim can do it (see SDCard.hpp):
+     *  - a shim with a CRC unit (detail::hasCRCUnit) hashes every block as it is clocked. Received blocks are checked
+     *    and sent ones get their CRC without the host reading the data again.
+     *  - a shim whose adapter keeps a CRC of its traffic (detail::hasLinkCheck, the SPIDriver) has each block transfer
+     *    checked with one status query at the end, and keeps its host copy of that CRC only while this policy is used.
+     * Base computes whatever the shim can not, including the CRCs of the asynchronous API.
+     *
+     *     sd::SpiCard<SPIShim, sd::PeripheralCRC<sd::noCRC>> card;     // SPIDriver: link checked, no host CRC16
+     */
+    template<class Base = tableBasedCRC>
+    struct PeripheralCRC : Base {
+        static constexpr bool peripheralCRC = true;
     };
 
     struct defaultTimeouts {
@@ -115,6 +218,7 @@ namespace sd {
         using eraseTimeout = std::integral_constant<uint32_t, 10000>;
         using readTimeout  = std::integral_constant<uint32_t, 1000>;
         using writeTimeout = std::integral_constant<uint32_t, 2000>;
+        using streamTimeout = std::integral_constant<uint32_t, 50>;     //< idle time before an open stream is closed
     };
 
     struct CountBasedTimouts {
@@ -131,6 +235,56 @@ namespace sd {
         using eraseTimeout = std::integral_constant<uint32_t, 1000>;
         using readTimeout  = std::integral_constant<uint32_t, 100>;
         using writeTimeout = std::integral_constant<uint32_t, 200>;
+        using streamTimeout = std::integral_constant<uint32_t, 50>;     //< idle polls before an open stream is closed
+    };
+
+    /// driver operations timed by the statistics policy
+    enum class Operation : uint8_t {
+        INIT,           //< begin()
+        READ,           //< readBlocks()
+        WRITE,          //< writeBlocks()
+        READ_STREAM,    //< readStreamNext()
+        WRITE_STREAM,   //< writeStreamAppend()
+        REGISTER,       //< CID/CSD/OCR reads
+        ERASE,          //< eraseBlocks()
+        COUNT
+    };
+
+    /**
+     * what the card is busy with while the driver waits for it. Timeout policies with busyBegin/busyPause/busyEnd
+     * (see SDAdaptiveTimeouts.h) pace and learn each kind separately
+     */
+    enum class BusyKind : uint8_t {
+        COMMAND,        //< before a command, the card is usually ready already
+        PROGRAM,        //< after a block of a multi-block write
+        COMMIT,         //< after a single block write, or the stop token of a multi-block write
+        ERASE,          //< after CMD38
+        COUNT
+    };
+
+    /**
+     * Statistics policy that records nothing. Every hook is an empty inline function, so a SpiCard built with it
+     * compiles to the same code as one without instrumentation. See SDStats.h for the recording policy.
+     */
+    struct noStats {
+        static constexpr bool enabled = false;
+
+        struct Snapshot {};
+
+        void statCommand(SDCMD, bool /*app*/, uint32_t /*arg*/) {}
+        void statResponse(SDCMD, bool /*app*/, uint8_t /*r1*/) {}
+        void statDataToken(uint8_t /*token*/) {}
+        void statData(bool /*write*/, size_t /*bytes*/) {}
+        void statBusyBegin() {}
+        void statBusyEnd(uint32_t /*polls*/, bool /*ready*/) {}
+        void statCrcError() {}
+        void statRetry() {}
+        void statTimeout() {}
+        void statOpBegin(Operation) {}
+        void statOpEnd(Operation) {}
+
+        Snapshot statSnapshot() const { return {}; }
+        void statReset() {}
     };
 
 } // sd namespace
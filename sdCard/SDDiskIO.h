@@ -0,0 +1,169 @@
+#ifndef SDCARD_SDDISKIO_H
+#define SDCARD_SDDISKIO_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <sys/types.h>
+#include "SDBlockSpan.h"
+
+namespace sd {
+
+namespace detail {
+    /// TRUE for block devices with `bool begin()`
+    template<class Device, class = void>
+    struct hasBegin : std::false_type {};
+    template<class Device>
+    struct hasBegin<Device, std::void_t<decltype(bool(std::declval<Device&>().begin()))>> : std::true_type {};
+
+    /// TRUE for block devices that report their capacity, `std::optional<uint32_t> cardCapacity()`
+    template<class Device, class = void>
+    struct hasCapacity : std::false_type {};
+    template<class Device>
+    struct hasCapacity<Device, std::void_t<decltype(std::optional<uint32_t>(std::declval<Device&>().cardCapacity()))>>
+        : std::true_type {};
+
+    /// TRUE for block devices with card registers, `info()` returning an sd::CardInfo
+    template<class Device, class = void>
+    struct hasCardInfo : std::false_type {};
+    template<class Device>
+    struct hasCardInfo<Device, std::void_t<decltype(std::declval<Device&>().info().auBlocks),
+                                           decltype(std::declval<Device&>().info().eraseBlocks)>> : std::true_type {};
+
+    /// TRUE for block devices that can erase, `bool eraseBlocks(uint32_t first, uint32_t last)`
+    template<class Device, class = void>
+    struct hasErase : std::false_type {};
+    template<class Device>
+    struct hasErase<Device, std::void_t<decltype(bool(std::declval<Device&>().eraseBlocks(uint32_t(), uint32_t())))>>
+        : std::true_type {};
+}
+
+/**
+ * Physical drive table for a filesystem's disk I/O layer (FatFs disk_read and friends): drive number i is a Devices[i]
+ * (a card, a BlockCache in front of one, a RamDisk, a FileDisk, a StripedCard...). The types are fixed at compile
+ * time and each call is dispatched with a chain of compile-time branches on the drive number, so there is no virtual
+ * call, and a table of one drive compiles to a range check and a direct call. Which object sits in a slot is chosen
+ * at run time with attach(), so a slot can stay empty until a card is inserted.
+ *
+ *     sd::DiskRegistry<decltype(cache), sd::RamDisk> disks(&cache, &ram);
+ *     DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+ *         return disks.read(pdrv, sector, buff, count) ? RES_OK : RES_ERROR;
+ *     }
+ *
+ * A call only touches its own drive, so drives can be used from different threads at the same time (FatFs is
+ * re-entrant across volumes on different drives). The optional parts of the device interface (begin, flush,
+ * cardCapacity, info, eraseBlocks) are used where the device has them.
+ *
+ * @tparam Devices block device type of each drive, in drive number order
+ */
+template<class... Devices>
+class DiskRegistry {
+    static_assert(sizeof...(Devices) > 0, "a drive table needs at least one drive");
+
+public:
+    static constexpr uint8_t DRIVES = sizeof...(Devices);
+
+    template<size_t I>
+    using Device = std::tuple_element_t<I, std::tuple<Devices...>>;
+
+    DiskRegistry() = default;
+    explicit DiskRegistry(Devices*... devices) : m_devices(devices...) {}
+
+    /// put a device in slot I, or empty it with nullptr. The drive has to be initialized again
+    template<size_t I>
+    void attach(Device<I>* device) {
+        std::get<I>(m_devices) = device;
+        m_ready[I] = false;
+    }
+
+    /// initialize the drive. TRUE if it is ready for I/O
+    bool begin(const uint8_t pdrv) {
+        const bool ok = visit(pdrv, [](auto& d) {
+            if constexpr (detail::hasBegin<std::decay_t<decltype(d)>>::value) { return d.begin(); }
+            else { return true; }
+        }, false);
+        if(pdrv < DRIVES) { m_ready[pdrv] = ok; }
+        return ok;
+    }
+    /// TRUE if a device sits in the slot
+    bool present(const uint8_t pdrv) { return visit(pdrv, [](auto&) { return true; }, false); }
+    /// TRUE once begin() succeeded for the device in the slot
+    bool ready(const uint8_t pdrv) const { return pdrv < DRIVES && m_ready[pdrv]; }
+
+    /// read LEN blocks. TRUE if all of them were read
+    bool read(const uint8_t pdrv, const uint32_t LBA, uint8_t* buf, const size_t LEN) {
+        return ready(pdrv) && visit(pdrv, [&](auto& d) { return d.readBlocks(LBA, buf, LEN) == static_cast<ssize_t>(LEN); }, false);
+    }
+    /// write LEN blocks. TRUE if all of them were written
+    bool write(const uint8_t pdrv, const uint32_t LBA, const uint8_t* src, const size_t LEN) {
+        return ready(pdrv) && visit(pdrv, [&](auto& d) { return d.writeBlocks(LBA, src, LEN) == static_cast<ssize_t>(LEN); }, false);
+    }
+    /// write back whatever the drive holds (CTRL_SYNC)
+    bool sync(const uint8_t pdrv) {
+        return ready(pdrv) && visit(pdrv, [](auto& d) {
+            if constexpr (detail::hasFlush<std::decay_t<decltype(d)>>::value) { return d.flush(); }
+            else { return true; }
+        }, false);
+    }
+    /// blocks on the drive (GET_SECTOR_COUNT), empty if unknown
+    std::optional<uint32_t> blockCount(const uint8_t pdrv) {
+        if(!ready(pdrv)) { return std::nullopt; }
+        return visit(pdrv, [](auto& d) {
+            if constexpr (detail::hasCapacity<std::decay_t<decltype(d)>>::value) { return std::optional<uint32_t>(d.cardCapacity()); }
+            else { return std::optional<uint32_t>(); }
+        }, std::optional<uint32_t>());
+    }
+    /// erase unit in blocks (GET_BLOCK_SIZE): the card's allocation unit or erase sector, 1 if unknown or not ready
+    uint32_t eraseUnit(const uint8_t pdrv) {
+        if(!ready(pdrv)) { return 1; }
+        return visit(pdrv, [](auto& d) -> uint32_t {
+            if constexpr (detail::hasCardInfo<std::decay_t<decltype(d)>>::value) {
+                const auto& info = d.info();
+                return info.auBlocks ? info.auBlocks : (info.eraseBlocks ? info.eraseBlocks : 1);
+            }
+            else { return 1; }
+        }, uint32_t(1));
+    }
+    /// erase blocks first..last (CTRL_TRIM). FALSE for a drive that is not ready, devices that can not erase ignore it
+    bool trim(const uint8_t pdrv, const uint32_t firstLBA, const uint32_t lastLBA) {
+        return ready(pdrv) && visit(pdrv, [&](auto& d) {
+            if constexpr (detail::hasErase<std::decay_t<decltype(d)>>::value) { return d.eraseBlocks(firstLBA, lastLBA); }
+            else { return true; }
+        }, false);
+    }
+
+    /**
+     * Call f(device) for the device in slot pdrv, with its own type.
+     * @return what f returned, or `fallback` for an empty slot or a drive number past the table
+     */
+    template<class F, class R>
+    R visit(const uint8_t pdrv, F&& f, R fallback) { return visitFrom<0>(pdrv, f, fallback); }
+
+    template<size_t I>
+    Device<I>* device() { return std::get<I>(m_devices); }
+
+private:
+    template<size_t I, class F, class R>
+    R visitFrom(const uint8_t pdrv, F& f, R& fallback) {
+        if constexpr (I == DRIVES) {
+            (void)pdrv; (void)f;
+            return fallback;
+        }
+        else {
+            if(pdrv != I) { return visitFrom<I + 1>(pdrv, f, fallback); }
+            Device<I>* const d = std::get<I>(m_devices);
+            return d ? static_cast<R>(f(*d)) : fallback;
+        }
+    }
+
+    std::tuple<Devices*...>     m_devices{};
+    std::array<bool, DRIVES>    m_ready{};
+};
+
+}   // namespace sd
+
+#endif //SDCARD_SDDISKIO_H
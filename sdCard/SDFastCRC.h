@@ -0,0 +1,135 @@
+#ifndef SDCARD_SDFASTCRC_H
+#define SDCARD_SDFASTCRC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "SDDefaultPolicies.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SDCARD_CRC_CLMUL 1
+#include <immintrin.h>
+#endif
+
+namespace sd {
+
+    namespace detail {
+        constexpr uint32_t CCITT_POLY = 0x11021;
+
+        /// x^n mod P for the CCITT polynomial, used as folding constants
+        constexpr uint64_t xPowMod(const unsigned n) {
+            uint32_t r = 1;
+            for (unsigned i = 0; i < n; ++i) {
+                r <<= 1;
+                if (r & 0x10000) { r ^= CCITT_POLY; }
+            }
+            return r;
+        }
+
+        /// slicing-by-8 tables. table[k][b] is the CRC contribution of byte b followed by k zero bytes
+        constexpr std::array<std::array<uint16_t, 256>, 8> makeSliceTables() {
+            std::array<std::array<uint16_t, 256>, 8> t{};
+            for (unsigned i = 0; i < 256; ++i) {
+                uint16_t c = static_cast<uint16_t>(i << 8);
+                for (int j = 0; j < 8; ++j) {
+                    c = static_cast<uint16_t>((c & 0x8000) ? (c << 1) ^ 0x1021 : (c << 1));
+                }
+                t[0][i] = c;
+            }
+            for (unsigned k = 1; k < 8; ++k) {
+                for (unsigned i = 0; i < 256; ++i) {
+                    const uint16_t prev = t[k - 1][i];
+                    t[k][i] = static_cast<uint16_t>((prev << 8) ^ t[0][prev >> 8]);
+                }
+            }
+            return t;
+        }
+
+        inline constexpr auto crcSliceTables = makeSliceTables();
+
+        inline uint16_t crc16Sliced(uint16_t crc, const uint8_t* data, size_t n) {
+            const auto& t = crcSliceTables;
+            while (n >= 8) {
+                crc = t[7][(crc >> 8) ^ data[0]] ^ t[6][(crc & 0xFF) ^ data[1]] ^
+                      t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+                      t[1][data[6]] ^ t[0][data[7]];
+                data += 8;
+                n    -= 8;
+            }
+            while (n--) {
+                crc = static_cast<uint16_t>(t[0][(crc >> 8) ^ *data++] ^ (crc << 8));
+            }
+            return crc;
+        }
+
+#if defined(SDCARD_CRC_CLMUL)
+        /**
+         * Carry-less multiply kernel. Folds the message 16 bytes at a time into a 128 bit remainder that
+         * is congruent to the message mod P, then reduces that remainder with the sliced tables.
+         * Processes the largest multiple of 16 bytes of data, n must be at least 16.
+         */
+        __attribute__((target("pclmul,ssse3")))
+        inline uint16_t crc16Clmul(const uint16_t crc, const uint8_t* data, const size_t n) {
+            const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+            const __m128i k     = _mm_set_epi64x(static_cast<long long>(xPowMod(192)), static_cast<long long>(xPowMod(128)));
+
+            // the running CRC folds into the first two message bytes
+            __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), bswap);
+            acc = _mm_xor_si128(acc, _mm_set_epi64x(static_cast<long long>(uint64_t(crc) << 48), 0));
+
+            for (size_t i = 16; i + 16 <= n; i += 16) {
+                const __m128i hi   = _mm_clmulepi64_si128(acc, k, 0x11);
+                const __m128i lo   = _mm_clmulepi64_si128(acc, k, 0x00);
+                const __m128i next = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), bswap);
+                acc = _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+            }
+
+            uint8_t rem[16];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rem), _mm_shuffle_epi8(acc, bswap));
+            return crc16Sliced(0, rem, sizeof(rem));
+        }
+
+        inline bool haveClmul() {
+#if defined(__PCLMUL__) && defined(__SSSE3__)
+            return true;
+#else
+            static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+            return supported;
+#endif
+        }
+#endif
+    }   // detail namespace
+
+    /**
+     * CRC policy for hosts: slicing-by-8 tables (4KB) for the CRC16 of data blocks, and on x86 a
+     * PCLMULQDQ folding kernel selected at runtime when the CPU supports it. CRC7 uses the shared table, wrap it
+     * in CRCChecked to turn on CRC checking in the card.
+     */
+    struct SlicedCRC {
+        static constexpr bool useCRC7  = false;
+        static constexpr bool useCRC16 = true;
+
+        static constexpr uint8_t getCRC7(const uint8_t* data, const uint8_t n) { return detail::crc7(data, n); }
+
+        static uint16_t CRC_CCITT(const uint8_t* data, const size_t n) {
+            return CRC_CCITT_update(0, data, n);
+        }
+
+        static constexpr uint16_t CRC_CCITT_init() { return 0; }
+        static constexpr uint16_t CRC_CCITT_final(const uint16_t crc) { return crc; }
+
+        static uint16_t CRC_CCITT_update(const uint16_t crc, const uint8_t* data, const size_t n) {
+#if defined(SDCARD_CRC_CLMUL)
+            if (n >= 32 && detail::haveClmul()) {
+                const size_t folded = n & ~size_t(15);
+                return detail::crc16Sliced(detail::crc16Clmul(crc, data, folded), data + folded, n - folded);
+            }
+#endif
+            return detail::crc16Sliced(crc, data, n);
+        }
+    };
+
+} // sd namespace
+
+#endif //SDCARD_SDFASTCRC_H
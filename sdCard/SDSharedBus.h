@@ -0,0 +1,276 @@
+#ifndef SDCARD_SDSHAREDBUS_H
+#define SDCARD_SDSHAREDBUS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include "SDCard.hpp"
+
+namespace sd {
+
+/// what a device on a SharedBus needs from the controller while it holds the bus
+struct BusDevice {
+    uint32_t clockHz      = 0;      //< SPI clock the device runs at, 0 keeps whatever the bus is at
+    uint8_t  mode         = 0;      //< SPI mode (CPOL << 1 | CPHA). Only switched on controllers with setMode
+    uint8_t  priority     = 0;      //< waiting transactions of higher priority get the bus first
+    uint8_t  releaseBytes = 1;      //< fill bytes clocked after CS goes high, SD cards let go of MISO on a clock edge
+};
+
+/// counters of a SharedBus
+struct SharedBusStats {
+    uint32_t transactions = 0;      //< times the bus was taken
+    uint32_t contended    = 0;      //< of those, times a device had to wait for it
+    uint32_t clockChanges = 0;      //< calls to the controller's setClock
+    uint32_t modeChanges  = 0;      //< calls to the controller's setMode
+    uint32_t yields       = 0;      //< busy waits that let other devices use the bus (BusHandle::suspend)
+};
+
+namespace detail {
+    /// TRUE for SPI controllers that can change the SPI mode, `void setMode(uint8_t mode)`
+    template<class Ctrl, class = void>
+    struct hasSetMode : std::false_type {};
+    template<class Ctrl>
+    struct hasSetMode<Ctrl, std::void_t<decltype(std::declval<Ctrl&>().setMode(uint8_t()))>> : std::true_type {};
+}
+
+/**
+ * One SPI controller shared by several devices (cards, sensors, displays), each with a chip select of its own. A
+ * device takes the bus for one transaction, from CS low to CS high, and gives it back; devices that want it in the
+ * meantime queue up by priority, first come first served within a priority. The controller is only reclocked or
+ * switched to another SPI mode when the device taking the bus needs something different from the one before it.
+ *
+ * Devices talk to the bus through a BusHandle, which is a shim:
+ *
+ *     sd::SharedBus<Controller> bus(...);
+ *     using Handle = sd::BusHandle<decltype(bus)>;
+ *     sd::SpiCard<Handle, sd::SlicedCRC> card0(bus, 0), card1(bus, 1);
+ *     Handle sensor(bus, 2, sd::BusDevice{ 8000000, 3, 1, 0 });
+ *
+ * Each card can then be driven from a thread of its own. Only transactions on the same bus wait for each other.
+ *
+ * @tparam Ctrl the SPI controller: the shim contract with `select(uint8_t cs)`/`deSelect(uint8_t cs)`, plus
+ *         optionally pollRead, queueRead, setClock and setMode
+ */
+template<class Ctrl>
+class SharedBus {
+public:
+    using Controller = Ctrl;
+
+    template<class... Args>
+    explicit SharedBus(Args&&... args) : m_ctrl(std::forward<Args>(args)...) {}
+    SharedBus(const SharedBus&) = delete;
+    SharedBus& operator=(const SharedBus&) = delete;
+
+    bool active() { return m_ctrl.active(); }
+    /// bring up the controller, once for all devices
+    bool begin() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ctrl.active() || m_ctrl.begin();
+    }
+
+    /// wait for the bus. Returns with it held by the caller
+    void acquire(const uint8_t priority) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stats.transactions++;
+        if(!m_held) {
+            m_held = true;
+            return;
+        }
+        m_stats.contended++;
+        const uint64_t ticket = m_nextTicket++;
+        m_pending.push(Pending{ priority, ticket });
+        m_waiting.store(static_cast<uint32_t>(m_pending.size()), std::memory_order_relaxed);
+        m_granted.wait(lock, [this, ticket] { return m_grant == ticket; });
+    }
+    /// hand the bus to the first waiting transaction, or free it
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_pending.empty()) {
+                m_held = false;
+                return;
+            }
+            m_grant = m_pending.top().ticket;
+            m_pending.pop();
+            m_waiting.store(static_cast<uint32_t>(m_pending.size()), std::memory_order_relaxed);
+        }
+        m_granted.notify_all();
+    }
+    /// TRUE if a transaction is waiting for the bus. Only a hint, it is not read under the lock
+    bool contended() const { return m_waiting.load(std::memory_order_relaxed) != 0; }
+
+    /**
+     * Set the controller up for a device, skipping whatever is unchanged since the last device. Call with the bus held.
+     * @return the clock the bus runs at, 0 if unknown
+     */
+    uint32_t configure(const BusDevice& device) {
+        if constexpr (detail::hasSetMode<Controller>::value) {
+            if(device.mode != m_mode) {
+                m_ctrl.setMode(device.mode);
+                m_mode = device.mode;
+                m_stats.modeChanges++;
+            }
+        }
+        if constexpr (detail::hasSetClock<Controller>::value) {
+            if(device.clockHz != 0 && device.clockHz != m_requestedHz) {
+                m_clockHz     = m_ctrl.setClock(device.clockHz);
+                m_requestedHz = device.clockHz;
+                m_stats.clockChanges++;
+            }
+        }
+        return m_clockHz;
+    }
+
+    /// the controller, only to be used with the bus held
+    Controller& controller() { return m_ctrl; }
+    void noteYield() { m_stats.yields++; }
+
+    /// counters, only consistent while no device is using the bus
+    const SharedBusStats& stats() const { return m_stats; }
+    void resetStats() { m_stats = SharedBusStats(); }
+
+private:
+    struct Pending {
+        uint8_t  priority;
+        uint64_t ticket;
+        /// std::priority_queue puts the largest first: higher priority, then the older ticket
+        bool operator<(const Pending& o) const {
+            return priority != o.priority ? priority < o.priority : ticket > o.ticket;
+        }
+    };
+
+    Controller              m_ctrl;
+    std::mutex              m_mutex;
+    std::condition_variable m_granted;
+    std::priority_queue<Pending, std::vector<Pending>> m_pending;
+    std::atomic<uint32_t>   m_waiting{0};
+    uint64_t                m_nextTicket  = 1;
+    uint64_t                m_grant       = 0;
+    bool                    m_held        = false;
+    uint32_t                m_requestedHz = 0;
+    uint32_t                m_clockHz     = 0;
+    uint8_t                 m_mode        = 0;      //< controllers come up in mode 0
+    SharedBusStats          m_stats;
+};
+
+/**
+ * A device's shim on a SharedBus. select() waits for the bus, sets the controller up for this device and asserts its
+ * CS. deSelect() raises CS, clocks releaseBytes fill bytes and hands the bus on. Bytes clocked with CS high (the
+ * fill bytes sd::SpiCard sends between transactions) take the bus for just that call.
+ *
+ * pollRead, queueRead and setClock exist when the controller has them, so sd::SpiCard picks the same features it
+ * would on the bare controller. setClock records the device's clock and applies it, later transactions of the device
+ * only reclock the controller if another device changed it. suspend()/resume() let sd::SpiCard give the bus away
+ * while a card is busy programming, CS can go high during busy. Open read streams and asynchronous transfers keep CS
+ * low across calls and hold the bus until they end.
+ */
+template<class Bus>
+class BusHandle {
+    using Controller = typename Bus::Controller;
+
+public:
+    BusHandle(Bus& bus, const uint8_t cs, const BusDevice& device = BusDevice())
+        : m_bus(&bus), m_cs(cs), m_device(device) {}
+    BusHandle(const BusHandle&) = delete;
+    BusHandle& operator=(const BusHandle&) = delete;
+
+    bool active() { return m_bus->active(); }
+    bool begin() { return m_bus->begin(); }
+
+    void select() {
+        if(!m_held) { take(); }
+        ctrl().select(m_cs);
+        m_selected = true;
+    }
+    void deSelect() {
+        if(!m_held) { take(); }
+        ctrl().deSelect(m_cs);
+        for(uint8_t i = 0; i < m_device.releaseBytes; ++i) { ctrl().read(0xFF); }
+        m_selected = false;
+        give();
+    }
+
+    ssize_t write(const uint8_t* buf, const size_t LEN) { return held([&] { return ctrl().write(buf, LEN); }); }
+    uint8_t write(uint8_t val) { return read(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) { return held([&] { return ctrl().read(buf, LEN); }); }
+    uint8_t read(uint8_t val = 0xFF) { return held([&] { return ctrl().read(val); }); }
+
+    template<class C = typename Bus::Controller>
+    auto pollRead(uint8_t* buf, const size_t LEN) -> decltype(std::declval<C&>().pollRead(buf, LEN)) {
+        return held([&] { return ctrl().pollRead(buf, LEN); });
+    }
+    template<class C = typename Bus::Controller>
+    auto queueRead(uint8_t* buf, const size_t LEN) -> decltype(std::declval<C&>().queueRead(buf, LEN)) {
+        return held([&] { return ctrl().queueRead(buf, LEN); });
+    }
+    /// the clock this device runs at from now on. Returns the clock the controller gives it
+    template<class C = typename Bus::Controller>
+    auto setClock(const uint32_t hz) -> decltype(uint32_t(std::declval<C&>().setClock(hz))) {
+        m_device.clockHz = hz;
+        return held([this] { return m_bus->configure(m_device); });
+    }
+
+    /**
+     * Raise CS and give the bus away for the pause of a busy wait: if a transaction is waiting for it, or always with
+     * `always` (the pause is going to sleep). resume() takes it back and lowers CS again.
+     */
+    void suspend(const bool always) {
+        if(!m_selected || !(always || m_bus->contended())) { return; }
+        m_bus->noteYield();
+        deSelect();
+        m_suspended = true;
+    }
+    void resume() {
+        if(!m_suspended) { return; }
+        m_suspended = false;
+        select();
+    }
+
+    const BusDevice& device() const { return m_device; }
+
+private:
+    Controller& ctrl() { return m_bus->controller(); }
+
+    void take() {
+        m_bus->acquire(m_device.priority);
+        m_bus->configure(m_device);
+        m_held = true;
+    }
+    void give() {
+        m_held = false;
+        m_bus->release();
+    }
+    /// run f with the bus held, taking it for just this call if it is not held already
+    template<class F>
+    auto held(F f) {
+        if(m_held) { return f(); }
+        take();
+        if constexpr (std::is_void_v<decltype(f())>) {
+            f();
+            give();
+        }
+        else {
+            const auto r = f();
+            give();
+            return r;
+        }
+    }
+
+    Bus*      m_bus;
+    uint8_t   m_cs;
+    BusDevice m_device;
+    bool      m_held      = false;
+    bool      m_selected  = false;
+    bool      m_suspended = false;
+};
+
+}   // namespace sd
+
+#endif //SDCARD_SDSHAREDBUS_H
@@ -0,0 +1,142 @@
+#ifndef SDCARD_SDSTATS_H
+#define SDCARD_SDSTATS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "SDDefaultPolicies.h"
+
+namespace sd {
+
+/// counters recorded by SDStats, returned by SpiCard::statsSnapshot()
+struct CardStatistics {
+    static constexpr size_t HISTOGRAM_BUCKETS = 24;
+    static constexpr size_t OPERATIONS        = static_cast<size_t>(Operation::COUNT);
+
+    struct OpLatency {
+        uint32_t count   = 0;
+        uint64_t totalUs = 0;
+        uint32_t maxUs   = 0;
+        /// bucket 0 counts calls under 1us, bucket i counts calls from 2^(i-1) up to 2^i us. The last bucket is open
+        std::array<uint32_t, HISTOGRAM_BUCKETS> histogram{};
+
+        uint32_t meanUs() const { return count ? static_cast<uint32_t>(totalUs / count) : 0; }
+        /// upper bound of the bucket holding the given fraction of calls (0.5 for the median, 0.99 for p99)
+        uint32_t percentileUs(const float p) const {
+            const uint32_t target = static_cast<uint32_t>(p * count + 0.5f);
+            uint32_t seen = 0;
+            for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+                seen += histogram[i];
+                if(seen >= target && seen > 0) { return i == 0 ? 1 : (1U << i); }
+            }
+            return maxUs;
+        }
+    };
+
+    std::array<uint32_t, 64> commands{};        //< commands sent, indexed by SDCMD
+    std::array<uint32_t, 64> appCommands{};     //< application commands (ACMDn) sent, indexed by SDCMD
+    std::array<uint32_t, 64> errorResponses{};  //< R1 responses with an error bit, indexed by SDCMD
+    uint64_t bytesRead      = 0;                //< payload bytes received (data blocks and registers)
+    uint64_t bytesWritten   = 0;                //< payload bytes sent
+    uint32_t busyWaits      = 0;                //< waits where the card was busy or timed out
+    uint64_t busyPolls      = 0;                //< bytes polled while the card was busy
+    uint64_t busyUs         = 0;                //< time spent waiting on busy
+    uint32_t maxBusyUs      = 0;
+    uint32_t crcErrors      = 0;                //< data CRC mismatches, in either direction
+    uint32_t errorTokens    = 0;                //< data error tokens sent by the card
+    uint32_t retries        = 0;                //< repeated commands during initialization
+    uint32_t timeouts       = 0;                //< busy and response waits that timed out
+    std::array<OpLatency, OPERATIONS> ops{};    //< latency of each driver operation, indexed by Operation
+
+    uint32_t commandCount(const SDCMD cmd) const { return commands[static_cast<uint8_t>(cmd) & 0x3F]; }
+    uint32_t appCommandCount(const SDCMD cmd) const { return appCommands[static_cast<uint8_t>(cmd) & 0x3F]; }
+    const OpLatency& op(const Operation o) const { return ops[static_cast<size_t>(o)]; }
+};
+
+/**
+ * Statistics policy that records CardStatistics. Pass it as the fourth SpiCard parameter:
+ *
+ *     sd::SpiCard<Shim, sd::SlicedCRC, sd::defaultTimeouts, sd::SDStats<>> card;
+ *     ...
+ *     const auto s = card.statsSnapshot();
+ *
+ * Hooks only touch counters. Time is taken from Clock at the start and end of each operation and busy wait, so
+ * Clock should be cheap: a cycle counter or systick based clock on a microcontroller.
+ * @tparam Clock a std::chrono style clock
+ */
+template<class Clock = std::chrono::steady_clock>
+class SDStats {
+public:
+    static constexpr bool enabled = true;
+
+    using Snapshot = CardStatistics;
+
+    void statCommand(const SDCMD cmd, const bool app, uint32_t) {
+        auto& table = app ? m_stats.appCommands : m_stats.commands;
+        table[static_cast<uint8_t>(cmd) & 0x3F]++;
+    }
+    void statResponse(const SDCMD cmd, bool, const uint8_t r1) {
+        // bit 0 is the idle flag, everything else is an error (0xFF: no response)
+        if(r1 & 0xFE) { m_stats.errorResponses[static_cast<uint8_t>(cmd) & 0x3F]++; }
+        if(r1 == 0xFF) { m_stats.timeouts++; }
+    }
+    void statDataToken(const uint8_t token) {
+        if(token != 0xFE && token != 0xFF) { m_stats.errorTokens++; }
+    }
+    void statData(const bool write, const size_t bytes) {
+        (write ? m_stats.bytesWritten : m_stats.bytesRead) += bytes;
+    }
+    void statBusyBegin() { m_busyStart = Clock::now(); }
+    void statBusyEnd(const uint32_t polls, const bool ready) {
+        // the driver checks busy before every command, only count waits where the card actually was busy
+        if(polls == 0 && ready) { return; }
+        const uint32_t us = elapsedUs(m_busyStart);
+        m_stats.busyWaits++;
+        m_stats.busyPolls += polls;
+        m_stats.busyUs    += us;
+        if(us > m_stats.maxBusyUs) { m_stats.maxBusyUs = us; }
+        if(!ready) { m_stats.timeouts++; }
+    }
+    void statCrcError() { m_stats.crcErrors++; }
+    void statRetry()    { m_stats.retries++; }
+    void statTimeout()  { m_stats.timeouts++; }
+
+    void statOpBegin(const Operation op) { m_opStart[static_cast<size_t>(op)] = Clock::now(); }
+    void statOpEnd(const Operation op) {
+        const uint32_t us = elapsedUs(m_opStart[static_cast<size_t>(op)]);
+        auto& o = m_stats.ops[static_cast<size_t>(op)];
+        o.count++;
+        o.totalUs += us;
+        if(us > o.maxUs) { o.maxUs = us; }
+        o.histogram[bucket(us)]++;
+    }
+
+    /// copy of the counters, safe to hand to a monitoring task
+    Snapshot statSnapshot() const { return m_stats; }
+    void statReset() { m_stats = CardStatistics(); }
+
+private:
+    using TimePoint = typename Clock::time_point;
+
+    static uint32_t elapsedUs(const TimePoint t0) {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        return us < 0 ? 0 : static_cast<uint32_t>(us);
+    }
+    static size_t bucket(uint32_t us) {
+        size_t b = 0;
+        while(us && b + 1 < CardStatistics::HISTOGRAM_BUCKETS) {
+            us >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    CardStatistics                                   m_stats;
+    TimePoint                                        m_busyStart{};
+    std::array<TimePoint, CardStatistics::OPERATIONS> m_opStart{};
+};
+
+}   // sd namespace
+
+#endif //SDCARD_SDSTATS_H
@@ -0,0 +1,306 @@
+#ifndef SDCARD_SDSTREAMING_H
+#define SDCARD_SDSTREAMING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <sys/types.h>
+#include "SDBlockSpan.h"
+#include "SDCard_info.h"
+
+namespace sd {
+
+/// statistics kept by StreamingCard
+struct StreamStats {
+    uint32_t streamOpens   = 0;     //< CMD18 streams opened
+    uint32_t streamedReads = 0;     //< blocks read from an open stream
+    uint32_t prefetched    = 0;     //< blocks read ahead into the ring
+    uint32_t ringHits      = 0;     //< blocks served from the ring
+    uint32_t directReads   = 0;     //< blocks read with a plain readBlocks (non-sequential)
+    uint32_t writeSessions  = 0;    //< CMD25 write streams opened
+    uint32_t streamedWrites = 0;    //< blocks appended to an open write stream
+    uint32_t directWrites   = 0;    //< blocks written with a plain writeBlocks (non-sequential)
+};
+
+/**
+ * Sequential streaming in front of a SpiCard.
+ *
+ * Reads: a read that continues where the previous one ended is served from an open-ended CMD18 stream instead of a
+ * new CMD18/CMD12 pair, so reading a file cluster by cluster pays the command overhead once. Blocks can also be read
+ * ahead of the application into a ring of Depth blocks with prefetch(), for example from an idle loop or a scheduler
+ * task.
+ *
+ * Writes: a write that continues where the previous one ended is appended to an open CMD25 session, so a logger
+ * writing a block at a time pays ACMD23/CMD25 and the stop token once. beginWriteSession() opens a session up front
+ * and passes its length to the card as the ACMD23 pre-erase hint.
+ *
+ * A stream is closed by a non-sequential request, by any other card operation, by flush(), or by poll() once it has
+ * been idle for the card's streamTimeout. Writes must go through this wrapper (not the card directly) so the ring
+ * never returns stale data.
+ *
+ * @tparam Card an sd::SpiCard
+ * @tparam Depth blocks held in the read-ahead ring, 0 disables prefetching
+ */
+template<class Card, size_t Depth = 8>
+class StreamingCard {
+public:
+    explicit StreamingCard(Card& card) : m_card(&card) {}
+
+    /**
+     * Read blocks, streaming when the request continues the previous one
+     * @return The number of blocks read, or a value < 0 for an error
+     */
+    ssize_t readBlocks(uint32_t LBA, uint8_t* buf, size_t LEN);
+
+    /**
+     * Write blocks, appending to the write session when the request continues the previous one. The session stays
+     * open after the call, with CS low, and its blocks are only durable once it is closed: by flush(), by poll()
+     * after streamTimeout of idling, or by the next non-sequential request. Call poll() from the idle loop.
+     * @return the number of blocks written, or a negative value.
+     */
+    ssize_t writeBlocks(uint32_t LBA, const uint8_t* src, size_t LEN);
+
+    /**
+     * Scatter read. Continues the stream when the request continues the previous one, and is a single multi-block
+     * read on the card otherwise
+     * @return The number of blocks read, or a value < 0 for an error
+     */
+    ssize_t readBlocks(uint32_t LBA, const BlockSpan* spans, size_t count);
+
+    /**
+     * Gather write. Appends to the write session when the request continues the previous one, and is a single
+     * multi-block write on the card otherwise
+     * @return the number of blocks written, or a negative value.
+     */
+    ssize_t writeBlocks(uint32_t LBA, const ConstBlockSpan* spans, size_t count);
+
+    /**
+     * Open a write session at LBA now, with the number of blocks it will write as the pre-erase hint.
+     * Following writeBlocks calls starting at LBA are appended to it.
+     * @return TRUE if the card accepted the write
+     */
+    bool beginWriteSession(uint32_t LBA, uint32_t expected);
+
+    /// end an open write session (STOP_TRAN) so every block is committed. Returns FALSE if the stop failed
+    bool flush() {
+        if(!m_card->writeStreaming()) { return true; }
+        return m_card->streamClose();
+    }
+
+    /**
+     * Read up to max blocks ahead of the application into the ring, if a sequential stream is open.
+     * @return number of blocks prefetched
+     */
+    size_t prefetch(size_t max = Depth);
+
+    /// erase blocks on the card (TRIM). Open streams are ended and read-ahead blocks dropped first
+    bool eraseBlocks(const uint32_t firstLBA, const uint32_t lastLBA) {
+        m_haveNext  = false;
+        m_haveWrite = false;
+        return close() && m_card->eraseBlocks(firstLBA, lastLBA);
+    }
+
+    /// close the stream once it has been idle too long. Call periodically from idle code
+    void poll() { m_card->closeIdleStream(); }
+
+    /// close the stream and drop the ring
+    bool close() {
+        dropRing();
+        return m_card->streamClose();
+    }
+
+    /// drop the ring and sessions and initialize the card
+    bool begin() {
+        dropRing();
+        m_haveNext  = false;
+        m_haveWrite = false;
+        return m_card->begin();
+    }
+    std::optional<uint32_t> cardCapacity() const { return m_card->cardCapacity(); }
+    const CardInfo& info() const { return m_card->info(); }
+
+    const StreamStats& stats() const { return m_stats; }
+    void resetStats() { m_stats = StreamStats(); }
+
+    Card& card() { return *m_card; }
+
+private:
+    void dropRing() {
+        m_ringHead  = 0;
+        m_ringCount = 0;
+        m_haveNext  = false;
+    }
+
+    bool openWrite(const uint32_t LBA, const uint32_t expected) {
+        if(!m_card->writeStreamOpen(LBA, expected)) { return false; }
+        m_stats.writeSessions++;
+        return true;
+    }
+
+    /// the stream must continue at LBA, open (or reopen) it if it does not
+    bool streamAt(const uint32_t LBA) {
+        if(m_card->readStreaming() && m_card->streamLBA() == LBA) { return true; }
+        if(!m_card->readStreamOpen(LBA)) { return false; }
+        m_stats.streamOpens++;
+        return true;
+    }
+
+    Card*                                       m_card;
+    std::array<std::array<uint8_t, 512>, Depth> m_ring{};
+    size_t                                      m_ringHead  = 0;
+    size_t                                      m_ringCount = 0;
+    uint32_t                                    m_next      = 0;        //< block after the last one returned, first block in the ring
+    bool                                        m_haveNext  = false;
+    uint32_t                                    m_writeNext = 0;        //< block after the last one written
+    bool                                        m_haveWrite = false;
+    StreamStats                                 m_stats;
+};
+
+template<class Card, size_t Depth>
+ssize_t StreamingCard<Card, Depth>::readBlocks(uint32_t LBA, uint8_t* buf, const size_t LEN)
+{
+    if(!m_haveNext || LBA != m_next) {
+        // non-sequential: plain read, but remember where it ended so the next request can stream
+        close();
+        const ssize_t n = m_card->readBlocks(LBA, buf, LEN);
+        if(n > 0) {
+            m_stats.directReads += n;
+            m_next     = LBA + static_cast<uint32_t>(n);
+            m_haveNext = true;
+        }
+        return n;
+    }
+
+    size_t done = 0;
+    if constexpr (Depth > 0) {
+        while(done < LEN && m_ringCount > 0) {
+            std::memcpy(buf + done * 512, m_ring[m_ringHead].data(), 512);
+            m_ringHead = (m_ringHead + 1) % Depth;
+            m_ringCount--;
+            done++;
+        }
+        m_stats.ringHits += done;
+    }
+
+    if(done < LEN) {
+        if(!streamAt(LBA + done)) {
+            m_haveNext = false;
+            return done ? static_cast<ssize_t>(done) : -1;
+        }
+        const size_t want = LEN - done;
+        const ssize_t n = m_card->readStreamNext(buf + done * 512, want);
+        if(n > 0) {
+            m_stats.streamedReads += n;
+            done += n;
+        }
+        if(n != static_cast<ssize_t>(want)) {
+            // the stream failed part way, the next request starts over
+            dropRing();
+            return done ? static_cast<ssize_t>(done) : -1;
+        }
+    }
+
+    m_next = LBA + static_cast<uint32_t>(LEN);
+    return LEN;
+}
+
+template<class Card, size_t Depth>
+ssize_t StreamingCard<Card, Depth>::writeBlocks(const uint32_t LBA, const uint8_t* src, const size_t LEN)
+{
+    dropRing();
+
+    const bool append = m_card->writeStreaming() && m_card->streamLBA() == LBA;
+    if(!append && !(m_haveWrite && LBA == m_writeNext)) {
+        // non-sequential: plain write, but remember where it ended so the next request can stream
+        m_haveWrite = false;
+        const ssize_t n = m_card->writeBlocks(LBA, src, LEN);
+        if(n > 0) {
+            m_stats.directWrites += n;
+            m_writeNext = LBA + static_cast<uint32_t>(n);
+            m_haveWrite = true;
+        }
+        return n;
+    }
+
+    if(!append && !openWrite(LBA, 0)) {
+        m_haveWrite = false;
+        return -1;
+    }
+    const ssize_t n = m_card->writeStreamAppend(src, LEN);
+    if(n > 0) { m_stats.streamedWrites += n; }
+    m_haveWrite = n == static_cast<ssize_t>(LEN);
+    m_writeNext = LBA + static_cast<uint32_t>(LEN);
+    return n;
+}
+
+template<class Card, size_t Depth>
+ssize_t StreamingCard<Card, Depth>::readBlocks(const uint32_t LBA, const BlockSpan* spans, const size_t count)
+{
+    if(m_haveNext && LBA == m_next) {
+        return detail::eachSpan(LBA, spans, count,
+                                [this](const uint32_t lba, uint8_t* buf, const size_t len) { return readBlocks(lba, buf, len); });
+    }
+
+    close();
+    const ssize_t n = m_card->readBlocks(LBA, spans, count);
+    if(n > 0) {
+        m_stats.directReads += n;
+        m_next     = LBA + static_cast<uint32_t>(n);
+        m_haveNext = true;
+    }
+    return n;
+}
+
+template<class Card, size_t Depth>
+ssize_t StreamingCard<Card, Depth>::writeBlocks(const uint32_t LBA, const ConstBlockSpan* spans, const size_t count)
+{
+    if((m_card->writeStreaming() && m_card->streamLBA() == LBA) || (m_haveWrite && LBA == m_writeNext)) {
+        return detail::eachSpan(LBA, spans, count,
+                                [this](const uint32_t lba, const uint8_t* src, const size_t len) { return writeBlocks(lba, src, len); });
+    }
+
+    dropRing();
+    m_haveWrite = false;
+    const ssize_t n = m_card->writeBlocks(LBA, spans, count);
+    if(n > 0) {
+        m_stats.directWrites += n;
+        m_writeNext = LBA + static_cast<uint32_t>(n);
+        m_haveWrite = true;
+    }
+    return n;
+}
+
+template<class Card, size_t Depth>
+bool StreamingCard<Card, Depth>::beginWriteSession(const uint32_t LBA, const uint32_t expected)
+{
+    dropRing();
+    m_haveWrite = openWrite(LBA, expected);
+    m_writeNext = LBA;
+    return m_haveWrite;
+}
+
+template<class Card, size_t Depth>
+size_t StreamingCard<Card, Depth>::prefetch(const size_t max)
+{
+    size_t fetched = 0;
+    if constexpr (Depth > 0) {
+        if(!m_haveNext) { return 0; }
+
+        while(fetched < max && m_ringCount < Depth) {
+            const uint32_t lba = m_next + static_cast<uint32_t>(m_ringCount);
+            if(!streamAt(lba)) { break; }
+            auto& slot = m_ring[(m_ringHead + m_ringCount) % Depth];
+            if(m_card->readStreamNext(slot.data(), 1) != 1) { break; }
+            m_ringCount++;
+            fetched++;
+        }
+        m_stats.prefetched += fetched;
+    }
+    return fetched;
+}
+
+}   // sd namespace
+
+#endif //SDCARD_SDSTREAMING_H
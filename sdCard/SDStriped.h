@@ -0,0 +1,355 @@
+#ifndef SDCARD_SDSTRIPED_H
+#define SDCARD_SDSTRIPED_H
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <sys/types.h>
+#include "SDBlockSpan.h"
+
+namespace sd {
+
+/// runs the per-card transfers of a StripedCard one after the other on the calling thread, for systems without threads
+struct SerialBuses {
+    template<class Job>
+    void run(const size_t lanes, Job&& job) {
+        for(size_t i = 0; i < lanes; ++i) { job(i); }
+    }
+};
+
+/**
+ * Runs the per-card transfers of a StripedCard at the same time: lane 0 on the calling thread and every other lane on
+ * a worker thread of its own, so each card is driven from its own bus. The workers sleep between requests.
+ * @tparam N number of lanes (cards)
+ */
+template<size_t N>
+class ThreadBuses {
+public:
+    ThreadBuses() {
+        for(size_t i = 1; i < N; ++i) { m_workers[i - 1] = std::thread([this, i] { work(i); }); }
+    }
+    ~ThreadBuses() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for(auto& t : m_workers) { t.join(); }
+    }
+    ThreadBuses(const ThreadBuses&) = delete;
+    ThreadBuses& operator=(const ThreadBuses&) = delete;
+
+    /// call job(i) for every lane i < lanes (at most N) and return once all of them have. The workers of higher
+    /// lanes sleep on
+    template<class Job>
+    void run(size_t lanes, Job&& job) {
+        using J = std::remove_reference_t<Job>;
+        lanes = std::min(lanes, N);
+        if(lanes == 0) { return; }
+        if constexpr (N > 1) {
+            if(lanes > 1) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_job       = const_cast<void*>(static_cast<const void*>(&job));
+                    m_call      = [](void* j, const size_t lane) { (*static_cast<J*>(j))(lane); };
+                    m_lanes     = lanes;
+                    m_remaining = lanes - 1;
+                    m_round++;
+                }
+                m_wake.notify_all();
+            }
+        }
+        job(0);
+        if constexpr (N > 1) {
+            if(lanes > 1) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this] { return m_remaining == 0; });
+            }
+        }
+    }
+
+private:
+    void work(const size_t lane) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            // a round for fewer lanes leaves this worker asleep, it takes part in the next round that includes it
+            m_wake.wait(lock, [this, seen, lane] { return m_quit || (m_round != seen && lane < m_lanes); });
+            if(m_quit) { return; }
+            seen = m_round;
+            void* const job  = m_job;
+            const auto  call = m_call;
+            lock.unlock();
+            call(job, lane);
+            lock.lock();
+            if(--m_remaining == 0) { m_done.notify_one(); }
+        }
+    }
+
+    std::mutex              m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    void*                   m_job  = nullptr;
+    void                    (*m_call)(void*, size_t) = nullptr;
+    uint64_t                m_round     = 0;
+    size_t                  m_lanes     = 0;
+    size_t                  m_remaining = 0;
+    bool                    m_quit      = false;
+    std::array<std::thread, N - 1> m_workers;   //< started last, once the state above exists
+};
+
+/**
+ * RAID-0 over N cards on independent buses, presented as one block device with N times the capacity of the smallest
+ * card. Stripe s (stripeBlocks consecutive blocks) lives on card s % N, so a sequential transfer spreads evenly over
+ * the cards. A request becomes at most one multi-block transfer per card: the stripes a card holds are consecutive
+ * on the card, so they go out as one scatter-gather readBlocks/writeBlocks, and Buses runs those transfers at the
+ * same time. Sequential throughput grows with the number of cards until the host runs out of cores or memory bandwidth.
+ *
+ *     sd::SpiCard<Shim, sd::SlicedCRC> a(bus0), b(bus1);
+ *     sd::StripedCard<decltype(a), 2> volume({ &a, &b }, 16);
+ *     volume.begin();
+ *
+ * The cards should not be used directly while they are part of the volume. Losing one card loses the whole volume.
+ *
+ * @tparam Device an sd::SpiCard, or anything with begin(), cardCapacity(), scatter-gather readBlocks/writeBlocks and
+ *         eraseBlocks
+ * @tparam N number of cards
+ * @tparam Buses runs the per-card transfers, ThreadBuses<N> (a worker per bus) or SerialBuses
+ * @tparam MaxSpans stripes a card takes in one transfer. Longer requests are split into rounds
+ */
+template<class Device, size_t N, class Buses = ThreadBuses<N>, size_t MaxSpans = 16>
+class StripedCard {
+    static_assert(N > 0, "a striped volume needs at least one card");
+    static_assert(MaxSpans > 0, "a card must take at least one stripe per transfer");
+
+public:
+    /**
+     * @param devices [in] the cards, in stripe order. The order must stay the same for the data to be found again
+     * @param stripeBlocks [in] blocks per stripe, a power of two: begin() fails for any other value. Should divide the
+     *        filesystem's cluster size or be a multiple of it, so clusters are not split unevenly
+     */
+    StripedCard(const std::array<Device*, N>& devices, const uint32_t stripeBlocks = 16)
+        : m_devices(devices), m_stripe(stripeBlocks) {
+        while((1UL << m_shift) < m_stripe) { m_shift++; }
+    }
+    StripedCard(const StripedCard&) = delete;
+    StripedCard& operator=(const StripedCard&) = delete;
+
+    /// initialize every card, all at once. TRUE if all of them are ready
+    bool begin();
+
+    /// blocks in the volume: N times the smallest card, rounded down to whole stripes. Empty before begin()
+    std::optional<uint32_t> cardCapacity() const {
+        return m_blocks ? std::optional<uint32_t>(m_blocks) : std::optional<uint32_t>();
+    }
+
+    /// blocks per stripe
+    uint32_t stripeBlocks() const { return m_stripe; }
+
+    /// card i of the volume
+    Device& device(const size_t i) { return *m_devices[i]; }
+
+    /**
+     * Read blocks, each card's share as one multi-block read, all cards at once
+     * @return The number of blocks read, or a value < 0 for an error or a range past the volume. A short count
+     *         only covers whole rounds
+     */
+    ssize_t readBlocks(const uint32_t LBA, uint8_t* buf, const size_t LEN) {
+        const BlockSpan span{ buf, LEN };
+        return transfer(LBA, &span, 1);
+    }
+    ssize_t readBlocks(const uint32_t LBA, const BlockSpan* spans, const size_t count) {
+        return transfer(LBA, spans, count);
+    }
+
+    /**
+     * Write blocks, each card's share as one multi-block write, all cards at once
+     * @return the number of blocks written, or a negative value, also for a range past the volume. A short count
+     *         only covers whole rounds
+     */
+    ssize_t writeBlocks(const uint32_t LBA, const uint8_t* src, const size_t LEN) {
+        const ConstBlockSpan span{ src, LEN };
+        return transfer(LBA, &span, 1);
+    }
+    ssize_t writeBlocks(const uint32_t LBA, const ConstBlockSpan* spans, const size_t count) {
+        return transfer(LBA, spans, count);
+    }
+
+    /// erase a range of blocks (TRIM). The blocks a card holds in the range are one range on that card. FALSE for a
+    /// range past the volume
+    bool eraseBlocks(uint32_t firstLBA, uint32_t lastLBA);
+
+private:
+    /// the card holding volume block LBA
+    size_t cardOf(const uint32_t LBA) const { return (LBA >> m_shift) % N; }
+    /// where volume block LBA is on its card
+    uint32_t cardLBA(const uint32_t LBA) const {
+        return static_cast<uint32_t>(((LBA >> m_shift) / N) << m_shift) | (LBA & (m_stripe - 1));
+    }
+
+    template<class Span>
+    struct Lane {
+        uint32_t lba    = 0;
+        size_t   count  = 0;
+        size_t   blocks = 0;
+        ssize_t  result = 0;
+        std::array<Span, MaxSpans> spans{};
+    };
+
+    template<class Span>
+    ssize_t transfer(uint32_t LBA, const Span* spans, size_t count);
+
+    /// run every lane's transfer and reset the lanes. TRUE if all of them completed
+    template<class Span>
+    bool runRound(std::array<Lane<Span>, N>& lanes);
+
+    std::array<Device*, N> m_devices;
+    uint32_t               m_stripe;
+    uint32_t               m_shift  = 0;
+    uint32_t               m_blocks = 0;
+    Buses                  m_buses;
+};
+
+template<class Device, size_t N, class Buses, size_t MaxSpans>
+bool StripedCard<Device, N, Buses, MaxSpans>::begin()
+{
+    if(m_stripe == 0 || (m_stripe & (m_stripe - 1)) != 0) { return false; }
+
+    // card initialization is mostly waiting for ACMD41, so the cards wait together
+    std::array<bool, N> ok{};
+    m_buses.run(N, [this, &ok](const size_t i) { ok[i] = m_devices[i]->begin(); });
+
+    uint32_t smallest = UINT32_MAX;
+    for(size_t i = 0; i < N; ++i) {
+        const auto cap = m_devices[i]->cardCapacity();
+        if(!ok[i] || !cap.has_value()) {
+            m_blocks = 0;
+            return false;
+        }
+        smallest = *cap < smallest ? *cap : smallest;
+    }
+    const uint64_t blocks = uint64_t(smallest >> m_shift << m_shift) * N;
+    m_blocks = blocks > UINT32_MAX ? (UINT32_MAX >> m_shift << m_shift) : static_cast<uint32_t>(blocks);
+    return true;
+}
+
+template<class Device, size_t N, class Buses, size_t MaxSpans>
+template<class Span>
+ssize_t StripedCard<Device, N, Buses, MaxSpans>::transfer(uint32_t LBA, const Span* spans, const size_t count)
+{
+    // nothing past the volume, the larger cards have room there that belongs to no stripe
+    uint64_t total = 0;
+    for(size_t s = 0; s < count; ++s) { total += spans[s].blocks; }
+    if(LBA >= m_blocks || total > m_blocks - LBA) { return -1; }
+
+    std::array<Lane<Span>, N> lanes{};
+    size_t done = 0;        //< blocks of the rounds already run
+    size_t queued = 0;      //< blocks in the lanes
+
+    for(size_t s = 0; s < count; ++s) {
+        auto data = spans[s].data;
+        size_t left = spans[s].blocks;
+        while(left > 0) {
+            const size_t n = std::min<size_t>(left, m_stripe - (LBA & (m_stripe - 1)));
+            Lane<Span>& lane = lanes[cardOf(LBA)];
+            if(lane.count == MaxSpans) {
+                if(!runRound(lanes)) { return done ? static_cast<ssize_t>(done) : -1; }
+                done  += queued;
+                queued = 0;
+            }
+            if(lane.count == 0) { lane.lba = cardLBA(LBA); }
+            Span& last = lane.spans[lane.count > 0 ? lane.count - 1 : 0];
+            if(lane.count > 0 && last.data + last.blocks * 512 == data) {
+                // one card, or the caller's buffers happen to line up
+                last.blocks += n;
+            }
+            else {
+                lane.spans[lane.count++] = Span{ data, n };
+            }
+            lane.blocks += n;
+            queued      += n;
+            data        += n * 512;
+            left        -= n;
+            LBA         += static_cast<uint32_t>(n);
+        }
+    }
+    if(queued > 0) {
+        if(!runRound(lanes)) { return done ? static_cast<ssize_t>(done) : -1; }
+        done += queued;
+    }
+    return static_cast<ssize_t>(done);
+}
+
+template<class Device, size_t N, class Buses, size_t MaxSpans>
+template<class Span>
+bool StripedCard<Device, N, Buses, MaxSpans>::runRound(std::array<Lane<Span>, N>& lanes)
+{
+    // lanes past the last card with work stay asleep
+    size_t busy = 0;
+    for(size_t i = 0; i < N; ++i) { if(lanes[i].count > 0) { busy = i + 1; } }
+
+    m_buses.run(busy, [this, &lanes](const size_t i) {
+        Lane<Span>& lane = lanes[i];
+        if(lane.count == 0) { return; }
+        if constexpr (std::is_same_v<Span, BlockSpan>) {
+            lane.result = m_devices[i]->readBlocks(lane.lba, lane.spans.data(), lane.count);
+        }
+        else {
+            lane.result = m_devices[i]->writeBlocks(lane.lba, lane.spans.data(), lane.count);
+        }
+    });
+
+    bool ok = true;
+    for(auto& lane : lanes) {
+        if(lane.count > 0 && lane.result != static_cast<ssize_t>(lane.blocks)) { ok = false; }
+        lane = Lane<Span>();
+    }
+    return ok;
+}
+
+template<class Device, size_t N, class Buses, size_t MaxSpans>
+bool StripedCard<Device, N, Buses, MaxSpans>::eraseBlocks(const uint32_t firstLBA, const uint32_t lastLBA)
+{
+    if(lastLBA < firstLBA) { return true; }
+    if(lastLBA >= m_blocks) { return false; }
+
+    // card i holds the part of the range from the first of its blocks in it to the last
+    std::array<uint32_t, N> first{};
+    std::array<uint32_t, N> last{};
+    std::array<bool, N>     used{};
+    const uint64_t end = uint64_t(lastLBA) + 1;
+    for(size_t k = 0; k < N; ++k) {
+        // the stripe starting at or containing LBA first + k stripes, clipped to the range
+        const uint64_t stripeStart = (uint64_t(firstLBA) >> m_shift << m_shift) + (uint64_t(k) << m_shift);
+        const uint64_t from = stripeStart > firstLBA ? stripeStart : firstLBA;
+        if(from >= end) { continue; }
+        const size_t i = cardOf(static_cast<uint32_t>(from));
+        // the last stripe of card i that starts before the end of the range
+        const uint64_t lastStripe = ((end - 1) >> m_shift);
+        const uint64_t back = (lastStripe + N - i) % N;
+        const uint64_t mine = lastStripe - back;
+        const uint64_t to   = std::min<uint64_t>(end - 1, ((mine + 1) << m_shift) - 1);
+        used[i]  = true;
+        first[i] = cardLBA(static_cast<uint32_t>(from));
+        last[i]  = cardLBA(static_cast<uint32_t>(to));
+    }
+
+    size_t busy = 0;
+    for(size_t i = 0; i < N; ++i) { if(used[i]) { busy = i + 1; } }
+
+    std::array<bool, N> ok{};
+    ok.fill(true);
+    m_buses.run(busy, [&](const size_t i) { ok[i] = !used[i] || m_devices[i]->eraseBlocks(first[i], last[i]); });
+    for(const bool o : ok) { if(!o) { return false; } }
+    return true;
+}
+
+}   // sd namespace
+
+#endif //SDCARD_SDSTRIPED_H
@@ -0,0 +1,251 @@
+#ifndef SDCARD_SDTRACE_H
+#define SDCARD_SDTRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "SDDefaultPolicies.h"
+
+namespace sd {
+
+/// kind of a recorded TraceEvent
+enum class TraceType : uint8_t {
+    COMMAND,        //< code: command index, arg: command argument
+    RESPONSE,       //< code: command index, value: R1
+    DATA_TOKEN,     //< value: start or error token
+    DATA,           //< arg: payload bytes moved
+    BUSY,           //< arg: ticks the card was busy (only waits where it was)
+    CRC_ERROR,
+    RETRY,
+    TIMEOUT,
+    OP_BEGIN,       //< code: Operation
+    OP_END,         //< code: Operation
+    LOST,           //< arg: events overwritten before they were drained. Inserted by TraceBuffer::drain
+};
+
+/// flag bits of TraceEvent::flags
+enum TraceFlags : uint8_t {
+    TRACE_APP    = 0x01,    //< application command (ACMDn)
+    TRACE_WRITE  = 0x02,    //< data sent to the card
+    TRACE_FAILED = 0x04,    //< busy wait timed out
+};
+
+/// one recorded event, 12 bytes
+struct TraceEvent {
+    uint32_t time;      //< tick count, truncated to 32 bits
+    uint32_t arg;
+    uint8_t  type;      //< TraceType
+    uint8_t  code;
+    uint8_t  value;
+    uint8_t  flags;     //< TraceFlags
+};
+static_assert(sizeof(TraceEvent) == 12, "trace events are written to files as is");
+
+/// header of a trace file. It is followed by TraceEvents until the end of the file
+struct TraceFileHeader {
+    char     magic[4]  = { 'S', 'D', 'T', 'R' };
+    uint16_t version   = 1;
+    uint16_t eventSize = sizeof(TraceEvent);
+    uint32_t tickNum   = 1;         //< one tick is tickNum / tickDen seconds
+    uint32_t tickDen   = 1000000;
+};
+static_assert(sizeof(TraceFileHeader) == 16, "trace file header is written as is");
+
+/**
+ * Fixed size ring of TraceEvents. Single producer, the card; when full the oldest events are overwritten so
+ * recording never blocks or fails. The consumer may run on another thread or from an interrupt: drain() copies
+ * what is there and discards anything the producer overwrote while it was copying. The oldest of N undrained events
+ * shares its slot with the next one recorded, so drain() returns at most N - 1 of them.
+ * @tparam N events held, a power of two
+ */
+template<size_t N>
+class TraceBuffer {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "trace buffer size must be a power of two");
+
+public:
+    static constexpr size_t CAPACITY = N;
+
+    void record(const TraceEvent& e) {
+        const uint32_t h = m_head.load(std::memory_order_relaxed);
+        m_events[h & (N - 1)] = e;
+        m_head.store(h + 1, std::memory_order_release);
+    }
+
+    /**
+     * Copy events recorded since the last drain into out, oldest first. If events were overwritten before they
+     * could be copied a LOST event saying how many is put in their place.
+     * @return number of events written to out
+     */
+    size_t drain(TraceEvent* out, size_t max);
+
+    /// events recorded and not yet drained (including any that were overwritten)
+    uint32_t pending() const { return m_head.load(std::memory_order_acquire) - m_tail; }
+    /// total events recorded since construction or clear()
+    uint32_t recorded() const { return m_head.load(std::memory_order_acquire); }
+    /// total events overwritten before drain() got to them
+    uint32_t lost() const { return m_lost; }
+
+    /// drop everything. Not safe while the producer is recording
+    void clear() {
+        m_head.store(0, std::memory_order_release);
+        m_tail = 0;
+        m_lost = 0;
+    }
+
+private:
+    std::array<TraceEvent, N> m_events{};
+    std::atomic<uint32_t>     m_head{0};        //< events recorded, only ever written by the producer
+    uint32_t                  m_tail = 0;       //< events drained, only touched by the consumer
+    uint32_t                  m_lost = 0;
+};
+
+template<size_t N>
+size_t TraceBuffer<N>::drain(TraceEvent* out, const size_t max)
+{
+    if(max == 0) { return 0; }
+
+    // if the producer lapped us everything before the last N events is gone, keep a slot for the LOST marker
+    const uint32_t head    = m_head.load(std::memory_order_acquire);
+    const uint32_t from    = head - m_tail > N ? head - N : m_tail;
+    const size_t   reserve = from != m_tail ? 1 : 0;
+    uint32_t count = head - from;
+    if(count > max - reserve) { count = static_cast<uint32_t>(max - reserve); }
+    for(uint32_t k = 0; k < count; ++k) { out[reserve + k] = m_events[(from + k) & (N - 1)]; }
+
+    // events the producer overwrote while we copied are torn, drop them. Event after - N is one of them: its slot is
+    // where the producer may be writing event `after` right now
+    const uint32_t after = m_head.load(std::memory_order_acquire);
+    uint32_t first = from;
+    if(after - from >= N) { first = after - N + 1 - from < count ? after - N + 1 : from + count; }
+
+    // a marker takes the place of the last dropped slot, then the survivors move to the front
+    size_t pos = reserve + (first - from);
+    const uint32_t skipped = first - m_tail;
+    if(skipped) {
+        out[--pos] = TraceEvent{ 0, skipped, static_cast<uint8_t>(TraceType::LOST), 0, 0, 0 };
+        m_lost += skipped;
+    }
+    const size_t n = reserve + count - pos;
+    for(size_t i = 0; i < n && pos > 0; ++i) { out[i] = out[pos + i]; }
+
+    m_tail = from + count;
+    return n;
+}
+
+/**
+ * Write everything the buffer holds to a trace file for SDTraceDecode.
+ * @return FALSE if a write failed
+ */
+template<class Buffer>
+bool writeTrace(std::FILE* file, Buffer& buffer, const TraceFileHeader& header)
+{
+    if(std::fwrite(&header, sizeof(header), 1, file) != 1) { return false; }
+    std::array<TraceEvent, 64> chunk;
+    for(size_t n; (n = buffer.drain(chunk.data(), chunk.size())) > 0;) {
+        if(std::fwrite(chunk.data(), sizeof(TraceEvent), n, file) != n) { return false; }
+    }
+    return true;
+}
+
+/**
+ * Statistics policy that records a binary trace of the card traffic. Every hook stores one 12 byte event in a
+ * TraceBuffer (a clock read and a copy, no formatting or I/O), so it is cheap enough to leave enabled in a
+ * production build and drain the buffer when something goes wrong. Hooks are forwarded to Stats first, so the
+ * trace can sit on top of SDStats:
+ *
+ *     sd::SpiCard<Shim, sd::SlicedCRC, sd::defaultTimeouts, sd::SDTrace<1024, sd::SDStats<>>> card;
+ *     ...
+ *     sd::writeTrace(file, card.statsPolicy().traceBuffer(), card.statsPolicy().traceHeader());
+ *
+ * The recorded events can be turned into a timeline with the SDTraceDecode tool.
+ * @tparam N events held in the ring, a power of two
+ * @tparam Stats statistics policy the hooks are forwarded to
+ * @tparam Clock a std::chrono style clock
+ * @tparam Tick duration of one recorded tick. 32 bit microseconds wrap after 71 minutes
+ */
+template<size_t N = 512, class Stats = noStats, class Clock = std::chrono::steady_clock,
+         class Tick = std::chrono::microseconds>
+class SDTrace : private Stats {
+public:
+    static constexpr bool enabled = true;
+
+    using Snapshot = typename Stats::Snapshot;
+    using Buffer   = TraceBuffer<N>;
+
+    void statCommand(const SDCMD cmd, const bool app, const uint32_t arg) {
+        Stats::statCommand(cmd, app, arg);
+        record(TraceType::COMMAND, arg, static_cast<uint8_t>(cmd), 0, app ? TRACE_APP : 0);
+    }
+    void statResponse(const SDCMD cmd, const bool app, const uint8_t r1) {
+        Stats::statResponse(cmd, app, r1);
+        record(TraceType::RESPONSE, 0, static_cast<uint8_t>(cmd), r1, app ? TRACE_APP : 0);
+    }
+    void statDataToken(const uint8_t token) {
+        Stats::statDataToken(token);
+        record(TraceType::DATA_TOKEN, 0, 0, token, 0);
+    }
+    void statData(const bool write, const size_t bytes) {
+        Stats::statData(write, bytes);
+        record(TraceType::DATA, static_cast<uint32_t>(bytes), 0, 0, write ? TRACE_WRITE : 0);
+    }
+    void statBusyBegin() {
+        Stats::statBusyBegin();
+        m_busyStart = now();
+    }
+    void statBusyEnd(const uint32_t polls, const bool ready) {
+        Stats::statBusyEnd(polls, ready);
+        // the driver checks busy before every command, only record waits where the card actually was busy
+        if(polls == 0 && ready) { return; }
+        const uint32_t t = now();
+        m_buffer.record(TraceEvent{ t, t - m_busyStart, static_cast<uint8_t>(TraceType::BUSY), 0, 0,
+                                    static_cast<uint8_t>(ready ? 0 : TRACE_FAILED) });
+    }
+    void statCrcError() { Stats::statCrcError(); record(TraceType::CRC_ERROR, 0, 0, 0, 0); }
+    void statRetry()    { Stats::statRetry();    record(TraceType::RETRY, 0, 0, 0, 0); }
+    void statTimeout()  { Stats::statTimeout();  record(TraceType::TIMEOUT, 0, 0, 0, 0); }
+
+    void statOpBegin(const Operation op) {
+        Stats::statOpBegin(op);
+        record(TraceType::OP_BEGIN, 0, static_cast<uint8_t>(op), 0, 0);
+    }
+    void statOpEnd(const Operation op) {
+        Stats::statOpEnd(op);
+        record(TraceType::OP_END, 0, static_cast<uint8_t>(op), 0, 0);
+    }
+
+    Snapshot statSnapshot() const { return Stats::statSnapshot(); }
+    /// resets the forwarded statistics and empties the trace
+    void statReset() {
+        Stats::statReset();
+        m_buffer.clear();
+    }
+
+    Buffer& traceBuffer() { return m_buffer; }
+    const Buffer& traceBuffer() const { return m_buffer; }
+
+    /// file header describing this trace's tick
+    static TraceFileHeader traceHeader() {
+        TraceFileHeader h;
+        h.tickNum = static_cast<uint32_t>(Tick::period::num);
+        h.tickDen = static_cast<uint32_t>(Tick::period::den);
+        return h;
+    }
+
+private:
+    static uint32_t now() {
+        return static_cast<uint32_t>(std::chrono::duration_cast<Tick>(Clock::now().time_since_epoch()).count());
+    }
+    void record(const TraceType type, const uint32_t arg, const uint8_t code, const uint8_t value, const uint8_t flags) {
+        m_buffer.record(TraceEvent{ now(), arg, static_cast<uint8_t>(type), code, value, flags });
+    }
+
+    Buffer   m_buffer;
+    uint32_t m_busyStart = 0;
+};
+
+}   // sd namespace
+
+#endif //SDCARD_SDTRACE_H
@@ -0,0 +1,637 @@
+#ifndef SDCARD_SDSIMCARD_H
+#define SDCARD_SDSIMCARD_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace sd { namespace sim {
+
+/// Backing store for a simulated card. Either a zero filled RAM buffer or a raw image file on disk.
+class Image {
+public:
+    static constexpr size_t BLOCK_SIZE = 512;
+
+    /// RAM backed image of the given number of blocks
+    explicit Image(const uint32_t blocks) : m_blocks(blocks), m_ram(size_t(blocks) * BLOCK_SIZE, 0) {}
+
+    /**
+     * File backed image. The file is created if it does not exist.
+     * @param path [in] path to the raw image file
+     * @param blocks [in] size of the image in blocks, or 0 to use the current size of the file
+     */
+    explicit Image(const char* path, uint32_t blocks = 0) : m_blocks(0) {
+        m_file = std::fopen(path, "r+b");
+        if(!m_file) { m_file = std::fopen(path, "w+b"); }
+        if(!m_file) { return; }
+
+        if(blocks == 0) {
+            std::fseek(m_file, 0, SEEK_END);
+            blocks = static_cast<uint32_t>(std::ftell(m_file) / BLOCK_SIZE);
+        }
+        else {
+            // extend the file so every block in the image can be read back
+            std::fseek(m_file, 0, SEEK_END);
+            const long want = static_cast<long>(blocks) * BLOCK_SIZE;
+            if(std::ftell(m_file) < want) {
+                std::fseek(m_file, want - 1, SEEK_SET);
+                std::fputc(0, m_file);
+            }
+        }
+        m_blocks = blocks;
+    }
+
+    ~Image() { if(m_file) { std::fclose(m_file); } }
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+
+    /// TRUE if the image has storage behind it
+    bool valid() const { return m_blocks > 0; }
+    /// number of 512 byte blocks in the image
+    uint32_t blockCount() const { return m_blocks; }
+
+    bool read(const uint32_t lba, uint8_t* dst) {
+        if(lba >= m_blocks) { return false; }
+        if(!m_file) {
+            std::memcpy(dst, &m_ram[size_t(lba) * BLOCK_SIZE], BLOCK_SIZE);
+            return true;
+        }
+        std::fseek(m_file, static_cast<long>(lba) * BLOCK_SIZE, SEEK_SET);
+        return std::fread(dst, 1, BLOCK_SIZE, m_file) == BLOCK_SIZE;
+    }
+
+    bool write(const uint32_t lba, const uint8_t* src) {
+        if(lba >= m_blocks) { return false; }
+        if(!m_file) {
+            std::memcpy(&m_ram[size_t(lba) * BLOCK_SIZE], src, BLOCK_SIZE);
+            return true;
+        }
+        std::fseek(m_file, static_cast<long>(lba) * BLOCK_SIZE, SEEK_SET);
+        return std::fwrite(src, 1, BLOCK_SIZE, m_file) == BLOCK_SIZE;
+    }
+
+private:
+    uint32_t             m_blocks;
+    std::vector<uint8_t> m_ram;
+    std::FILE*           m_file = nullptr;
+};
+
+/// Timing and identity of the simulated card. Times are in nanoseconds of simulated bus time.
+struct CardConfig {
+    uint32_t clockHz       = 25000000;  //< SPI clock, used to convert clocked bytes into bus time
+    uint8_t  ncr           = 1;         //< fill bytes (NCR) between the end of a command and its R1
+    uint32_t readAccessNs  = 100000;    //< access time (NAC) before the data token of the first block
+    uint32_t blockGapNs    = 10000;     //< access time between blocks of a CMD18 stream
+    uint32_t programNs     = 250000;    //< busy period after each written block
+    uint32_t stopBusyNs    = 250000;    //< commit of a write transaction: after STOP_TRAN_TOKEN, and after a CMD24 block
+    uint32_t eraseNs       = 250000;    //< busy period after CMD38
+    uint8_t  initPolls     = 1;         //< number of ACMD41 calls answered with "idle" before the card is ready
+    bool     highCapacity  = true;      //< SDHC (block addressing) when TRUE, SDv2 standard capacity otherwise
+    bool     eraseBlocks   = true;      //< CSD ERASE_BLK_EN. When FALSE CMD38 erases whole 128 block sectors
+    bool     highSpeed     = true;      //< CMD6 can switch the card to High-Speed, raising TRAN_SPEED from 25 to 50MHz
+};
+
+/// Counters of what the driver made the simulated card do. Bus time is kept in picoseconds.
+struct BusStats {
+    uint64_t bytesClocked  = 0;     //< every byte clocked on the bus, selected or not
+    uint64_t busyBytes     = 0;     //< bytes clocked while the card held MISO low
+    uint64_t busPs         = 0;     //< simulated bus time
+    uint32_t commands      = 0;     //< complete command frames received
+    uint32_t blocksRead    = 0;     //< data blocks sent to the host
+    uint32_t blocksWritten = 0;     //< data blocks accepted from the host
+    uint32_t blocksErased  = 0;     //< blocks cleared by CMD38
+    uint32_t crcErrors     = 0;     //< command or data frames rejected for a bad CRC
+    uint64_t overclocked   = 0;     //< bytes clocked to the selected card faster than its TRAN_SPEED allows
+};
+
+/// simulated bus time against host wall time since the last BusStats reset
+struct BusReport {
+    double busSeconds;
+    double wallSeconds;
+    /// fraction of the wall time the bus would have been busy. Below 1.0 the host code is the limit.
+    double busUtilization() const { return wallSeconds > 0 ? busSeconds / wallSeconds : 0; }
+};
+
+/**
+ * Byte level model of an SD card in SPI mode. Every call to exchange() is one byte clocked on the
+ * bus: the returned value is what the card drives on MISO while it receives the MOSI byte. The model
+ * implements the CMD0/CMD8/ACMD41/CMD58 identification sequence, CMD9/CMD10/ACMD13/ACMD51 register reads, single
+ * and multi block reads (CMD17/CMD18/CMD12), writes (CMD24/CMD25/ACMD23), erases (CMD32/CMD33/CMD38) and the
+ * CMD6 High-Speed switch with the NCR fill bytes, access times and busy periods from CardConfig, all counted in
+ * simulated bus time at the clock set with setClockHz().
+ */
+class CardModel {
+public:
+    explicit CardModel(Image& image, const CardConfig& config = CardConfig()) : m_image(image), m_cfg(config) {
+        setClockHz(config.clockHz);
+        buildRegisters();
+        powerCycle();
+    }
+
+    /// put the card back into its power-on state (not initialized, CRC checking off)
+    void powerCycle() {
+        m_selected  = false;
+        m_idle      = true;
+        m_appCmd    = false;
+        m_crcOn     = false;
+        m_initPolls = m_cfg.initPolls;
+        m_eraseSet  = 0;
+        setHighSpeed(false);
+        m_state     = State::IDLE;
+        m_cmdLen    = 0;
+        m_out.clear();
+    }
+
+    void select()   { m_selected = true; }
+    void deSelect() {
+        // the card stops driving MISO: anything it had not sent yet is lost
+        m_selected = false;
+        m_cmdLen   = 0;
+        m_out.clear();
+    }
+    bool selected() const { return m_selected; }
+
+    /// change the SPI clock the bus time is counted against
+    void setClockHz(const uint32_t hz) {
+        m_cfg.clockHz = hz;
+        m_bytePs = 8000000000000ULL / hz;
+    }
+    uint32_t clockHz() const { return m_cfg.clockHz; }
+    /// TRUE once CMD6 switched the card to High-Speed
+    bool highSpeed() const { return m_highSpeed; }
+    const CardConfig& config() const { return m_cfg; }
+
+    /// clock one byte on the bus
+    uint8_t exchange(const uint8_t mosi) {
+        m_stats.bytesClocked++;
+        m_stats.busPs += m_bytePs;
+        m_nowPs       += m_bytePs;
+        if(!m_selected) { return 0xFF; }
+        if(m_cfg.clockHz > m_maxClockHz) { m_stats.overclocked++; }
+
+        // MISO is already on the wire before the MOSI byte is complete
+        const uint8_t miso = nextOut();
+        receive(mosi);
+        return miso;
+    }
+
+    /// let simulated time pass without clocking the bus, while the host is away (a USB adapter turning around)
+    void elapse(const uint64_t ps) { m_nowPs += ps; }
+
+    /// TRUE while the card is programming and would hold MISO low when selected
+    bool busy() const { return m_nowPs < m_busyUntilPs; }
+    /// simulated time since construction in picoseconds
+    uint64_t nowPs() const { return m_nowPs; }
+
+    const BusStats& stats() const { return m_stats; }
+    void resetStats() {
+        m_stats     = BusStats();
+        m_wallStart = std::chrono::steady_clock::now();
+    }
+    BusReport report() const {
+        const auto wall = std::chrono::steady_clock::now() - m_wallStart;
+        return BusReport{ m_stats.busPs * 1e-12, std::chrono::duration<double>(wall).count() };
+    }
+
+    Image& image() { return m_image; }
+    const std::array<uint8_t, 16>& cid() const { return m_cid; }
+    const std::array<uint8_t, 16>& csd() const { return m_csd; }
+
+    /// CRC7 of a command frame or register, as sent by the card (shifted, with end bit)
+    static uint8_t crc7(const uint8_t* data, const size_t n) {
+        uint8_t crc = 0;
+        for(size_t i = 0; i < n; ++i) {
+            uint8_t d = data[i];
+            for(int j = 0; j < 8; ++j) {
+                crc <<= 1;
+                if((d ^ crc) & 0x80) { crc ^= 0x09; }
+                d <<= 1;
+            }
+        }
+        return uint8_t(crc << 1) | 1U;
+    }
+
+    /// CRC16-CCITT (XMODEM) used on data blocks
+    static uint16_t crc16(const uint8_t* data, const size_t n, uint16_t crc = 0) {
+        static const auto table = [] {
+            std::array<uint16_t, 256> t{};
+            for(unsigned i = 0; i < 256; ++i) {
+                uint16_t c = uint16_t(i << 8);
+                for(int j = 0; j < 8; ++j) { c = uint16_t((c & 0x8000) ? (c << 1) ^ 0x1021 : (c << 1)); }
+                t[i] = c;
+            }
+            return t;
+        }();
+        for(size_t i = 0; i < n; ++i) { crc = uint16_t(table[((crc >> 8) ^ data[i]) & 0xFF] ^ (crc << 8)); }
+        return crc;
+    }
+
+private:
+    enum class State : uint8_t {
+        IDLE,           //< waiting for a command
+        READ_SINGLE,    //< CMD17 accepted, one block to send
+        READ_MULTI,     //< CMD18 accepted, send blocks until CMD12
+        READ_REG,       //< register read accepted, register block to send
+        WRITE_TOKEN,    //< CMD24/CMD25 accepted, waiting for a start token
+        WRITE_DATA,     //< receiving a data block
+    };
+
+    static constexpr uint32_t ERASE_SECTOR  = 128;     //< SECTOR_SIZE in the CSD, in blocks
+
+    static constexpr uint8_t R1_IDLE        = 0x01;
+    static constexpr uint8_t R1_ILLEGAL     = 0x04;
+    static constexpr uint8_t R1_CRC_ERROR   = 0x08;
+    static constexpr uint8_t R1_ERASE_SEQ   = 0x10;
+    static constexpr uint8_t R1_ADDR_ERROR  = 0x20;
+    static constexpr uint8_t R1_PARAM_ERROR = 0x40;
+
+    uint64_t nsToPs(const uint32_t ns) const { return uint64_t(ns) * 1000; }
+
+    uint8_t nextOut() {
+        if(!m_out.empty()) {
+            const uint8_t b = m_out.front();
+            m_out.pop_front();
+            if(m_out.empty() && m_state == State::READ_MULTI) {
+                m_readyPs = m_nowPs + nsToPs(m_cfg.blockGapNs);
+            }
+            return b;
+        }
+        if(busy()) {
+            m_stats.busyBytes++;
+            return 0x00;
+        }
+        if(isReading() && m_nowPs >= m_readyPs) {
+            queueReadBlock();
+            return nextOut();
+        }
+        return 0xFF;
+    }
+
+    bool isReading() const {
+        return m_state == State::READ_SINGLE || m_state == State::READ_MULTI || m_state == State::READ_REG;
+    }
+
+    void queueReadBlock() {
+        if(m_state == State::READ_REG) {
+            queueData(m_reg, m_regLen);
+            m_state = State::IDLE;
+            return;
+        }
+
+        uint8_t block[Image::BLOCK_SIZE];
+        if(!m_image.read(m_lba, block)) {
+            m_out.push_back(0x08);      // data error token: out of range
+            m_state = State::IDLE;
+            return;
+        }
+        m_stats.blocksRead++;
+        m_lba++;
+        queueData(block, sizeof(block));
+        if(m_state == State::READ_SINGLE) { m_state = State::IDLE; }
+    }
+
+    void queueData(const uint8_t* data, const size_t n) {
+        const uint16_t crc = crc16(data, n);
+        m_out.push_back(0xFE);
+        m_out.insert(m_out.end(), data, data + n);
+        m_out.push_back(uint8_t(crc >> 8));
+        m_out.push_back(uint8_t(crc & 0xFF));
+    }
+
+    void receive(const uint8_t mosi) {
+        if(m_state == State::WRITE_DATA) {
+            m_rx[m_rxLen++] = mosi;
+            if(m_rxLen == m_rx.size()) { finishWriteBlock(); }
+            return;
+        }
+
+        if(m_cmdLen > 0 || (mosi & 0xC0) == 0x40) {
+            m_cmd[m_cmdLen++] = mosi;
+            if(m_cmdLen == m_cmd.size()) {
+                m_cmdLen = 0;
+                command();
+            }
+            return;
+        }
+
+        if(m_state == State::WRITE_TOKEN) {
+            if(mosi == 0xFE || (m_multiWrite && mosi == 0xFC)) {
+                m_state = State::WRITE_DATA;
+                m_rxLen = 0;
+            }
+            else if(m_multiWrite && mosi == 0xFD) {
+                m_state       = State::IDLE;
+                m_busyUntilPs = m_nowPs + m_bytePs + nsToPs(m_cfg.stopBusyNs);
+            }
+        }
+    }
+
+    void finishWriteBlock() {
+        const uint16_t crc = uint16_t((m_rx[512] << 8) | m_rx[513]);
+        uint8_t response = 0x05;        // data accepted
+        if(m_crcOn && crc != crc16(m_rx.data(), 512)) {
+            m_stats.crcErrors++;
+            response = 0x0B;            // data rejected: CRC error
+        }
+        else if(!m_image.write(m_lba, m_rx.data())) {
+            response = 0x0D;            // data rejected: write error
+        }
+        else {
+            m_stats.blocksWritten++;
+            m_lba++;
+        }
+
+        m_out.push_back(uint8_t(0xE0 | response));
+        // a single block write is a whole transaction, so it also pays the commit a stop token would
+        const uint32_t busyNs = m_cfg.programNs + (m_multiWrite ? 0 : m_cfg.stopBusyNs);
+        m_busyUntilPs = m_nowPs + m_bytePs + nsToPs(busyNs);
+        m_state = (m_multiWrite && response == 0x05) ? State::WRITE_TOKEN : State::IDLE;
+    }
+
+    /// CMD38: clear the selected range to zeros, whole erase sectors unless single block erase is enabled
+    void erase() {
+        uint32_t first = m_eraseFirst;
+        uint32_t last  = m_eraseLast;
+        if(!m_cfg.eraseBlocks) {
+            first = first / ERASE_SECTOR * ERASE_SECTOR;
+            last  = last / ERASE_SECTOR * ERASE_SECTOR + ERASE_SECTOR - 1;
+            if(last >= m_image.blockCount()) { last = m_image.blockCount() - 1; }
+        }
+        const uint8_t zeros[Image::BLOCK_SIZE] = {};
+        for(uint32_t lba = first; lba <= last; ++lba) {
+            if(m_image.write(lba, zeros)) { m_stats.blocksErased++; }
+        }
+    }
+
+    void respond(const uint8_t r1) {
+        m_out.insert(m_out.end(), m_cfg.ncr, uint8_t(0xFF));
+        m_out.push_back(r1);
+    }
+
+    /// send a register as a data block once the response is out
+    void respondRegister(const uint8_t* reg, const size_t n) {
+        m_reg     = reg;
+        m_regLen  = n;
+        m_state   = State::READ_REG;
+        m_readyPs = m_nowPs + (m_cfg.ncr + 1U) * m_bytePs;
+    }
+
+    /// leave or enter High-Speed: the CSD TRAN_SPEED follows the access mode
+    void setHighSpeed(const bool on) {
+        m_highSpeed  = on;
+        m_maxClockHz = on ? 50000000 : 25000000;
+        m_csd[3]     = on ? 0x5A : 0x32;
+        m_csd[15]    = crc7(m_csd.data(), 15);
+    }
+
+    /// CMD6: report the access modes (function group 1) and check or switch to the requested one
+    void switchFunction(const uint32_t arg) {
+        const uint8_t want    = arg & 0x0F;
+        const bool    support = want == 0 || (want == 1 && m_cfg.highSpeed);
+        uint8_t       mode    = m_highSpeed ? 1 : 0;
+        if(want != 0x0F) {
+            mode = support ? want : 0x0F;
+            if(support && (arg & 0x80000000UL)) { setHighSpeed(want == 1); }
+        }
+        m_switch.fill(0);
+        m_switch[1]  = 100;                                 // max current: 100mA
+        m_switch[12] = 0x80;                                // every group supports function 0
+        m_switch[13] = m_cfg.highSpeed ? 0x03 : 0x01;
+        m_switch[16] = mode;                                // group 1 result, the others stay at function 0
+        m_switch[17] = 0x01;                                // data structure version 1
+        respondRegister(m_switch.data(), m_switch.size());
+    }
+
+    /// translate a command argument into a block address. FALSE if the address is not usable
+    bool toBlockAddress(const uint32_t arg, uint8_t& error) {
+        if(!m_cfg.highCapacity && (arg & 0x1FF)) { error = R1_ADDR_ERROR; return false; }
+        m_lba = m_cfg.highCapacity ? arg : (arg >> 9);
+        if(m_lba >= m_image.blockCount()) { error = R1_PARAM_ERROR; return false; }
+        return true;
+    }
+
+    void command() {
+        m_stats.commands++;
+        const uint8_t  idx = m_cmd[0] & 0x3F;
+        const uint32_t arg = (uint32_t(m_cmd[1]) << 24) | (uint32_t(m_cmd[2]) << 16) | (uint32_t(m_cmd[3]) << 8) | m_cmd[4];
+        const bool     app = m_appCmd;
+        m_appCmd = false;
+
+        // CMD0 and CMD8 are always CRC checked, everything else only after CMD59
+        if((m_crcOn || idx == 0 || idx == 8) && crc7(m_cmd.data(), 5) != m_cmd[5]) {
+            m_stats.crcErrors++;
+            respond(uint8_t(R1_CRC_ERROR | (m_idle ? R1_IDLE : 0)));
+            return;
+        }
+
+        if(idx == 12) {
+            // stop transmission: drop the rest of the block, send a stuff byte and R1b
+            m_out.clear();
+            m_state = State::IDLE;
+            m_out.push_back(0xFF);
+            m_out.push_back(0x00);
+            return;
+        }
+
+        const uint8_t r1 = m_idle ? R1_IDLE : 0x00;
+        if(m_idle && !(idx == 0 || idx == 8 || idx == 55 || idx == 58 || idx == 59 || (app && idx == 41))) {
+            respond(r1 | R1_ILLEGAL);
+            return;
+        }
+
+        uint8_t error = 0;
+        if(app) {
+            switch(idx) {
+                case 41:        // ACMD41: SD_SEND_OP_COND
+                    if(m_initPolls > 0) { --m_initPolls; }
+                    else { m_idle = false; }
+                    respond(m_idle ? R1_IDLE : 0x00);
+                    return;
+                case 23:        // ACMD23: pre-erase count, a hint only
+                    respond(r1);
+                    return;
+                case 13:        // ACMD13: SD_STATUS (R2 and a data block)
+                    respond(r1);
+                    m_out.push_back(0x00);
+                    respondRegister(m_status.data(), m_status.size());
+                    return;
+                case 51:        // ACMD51: SEND_SCR
+                    respond(r1);
+                    respondRegister(m_scr.data(), m_scr.size());
+                    return;
+                default:
+                    break;      // unsupported ACMDs fall through to the standard command set
+            }
+        }
+
+        switch(idx) {
+            case 0:             // GO_IDLE_STATE
+                powerCycle();
+                m_selected = true;
+                respond(R1_IDLE);
+                break;
+            case 6:             // SWITCH_FUNC (R1 and a data block)
+                respond(r1);
+                switchFunction(arg);
+                break;
+            case 8: {           // SEND_IF_COND: echo voltage and check pattern
+                respond(r1);
+                const uint8_t r7[4] = { 0x00, 0x00, uint8_t(arg >> 8 & 0x0F), uint8_t(arg & 0xFF) };
+                m_out.insert(m_out.end(), r7, r7 + 4);
+                break;
+            }
+            case 9:             // SEND_CSD
+            case 10:            // SEND_CID
+                respond(r1);
+                respondRegister(idx == 9 ? m_csd.data() : m_cid.data(), 16);
+                break;
+            case 13:            // SEND_STATUS (R2)
+                respond(r1);
+                m_out.push_back(0x00);
+                break;
+            case 16:            // SET_BLOCKLEN
+                respond(arg == 512 ? r1 : uint8_t(r1 | R1_PARAM_ERROR));
+                break;
+            case 17:            // READ_SINGLE_BLOCK
+            case 18:            // READ_MULTIPLE_BLOCK
+                if(!toBlockAddress(arg, error)) { respond(r1 | error); break; }
+                respond(r1);
+                m_state   = (idx == 17) ? State::READ_SINGLE : State::READ_MULTI;
+                m_readyPs = m_nowPs + (m_cfg.ncr + 1U) * m_bytePs + nsToPs(m_cfg.readAccessNs);
+                break;
+            case 24:            // WRITE_BLOCK
+            case 25:            // WRITE_MULTIPLE_BLOCK
+                if(!toBlockAddress(arg, error)) { respond(r1 | error); break; }
+                respond(r1);
+                m_state      = State::WRITE_TOKEN;
+                m_multiWrite = (idx == 25);
+                break;
+            case 32:            // ERASE_WR_BLK_START
+            case 33:            // ERASE_WR_BLK_END
+                if(!toBlockAddress(arg, error)) { respond(r1 | error); break; }
+                respond(r1);
+                (idx == 32 ? m_eraseFirst : m_eraseLast) = m_lba;
+                m_eraseSet |= (idx == 32) ? 1 : 2;
+                break;
+            case 38:            // ERASE (R1b)
+                if(m_eraseSet != 3 || m_eraseLast < m_eraseFirst) {
+                    m_eraseSet = 0;
+                    respond(r1 | R1_ERASE_SEQ);
+                    break;
+                }
+                respond(r1);
+                erase();
+                m_eraseSet    = 0;
+                m_busyUntilPs = m_nowPs + (m_cfg.ncr + 2U) * m_bytePs + nsToPs(m_cfg.eraseNs);
+                break;
+            case 55:            // APP_CMD
+                m_appCmd = true;
+                respond(r1);
+                break;
+            case 58: {          // READ_OCR
+                respond(r1);
+                const uint8_t ocr[4] = { uint8_t((m_idle ? 0x00 : 0x80) | (m_cfg.highCapacity ? 0x40 : 0x00)), 0xFF, 0x80, 0x00 };
+                m_out.insert(m_out.end(), ocr, ocr + 4);
+                break;
+            }
+            case 59:            // CRC_ON_OFF
+                m_crcOn = arg & 1U;
+                respond(r1);
+                break;
+            default:
+                respond(r1 | R1_ILLEGAL);
+                break;
+        }
+    }
+
+    void buildRegisters() {
+        // CID: manufacturer 0x03, OEM "SD", product "SIMSD" rev 1.0, 2019-04
+        m_cid = { 0x03, 'S', 'D', 'S', 'I', 'M', 'S', 'D', 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x34, 0x00 };
+        m_cid[15] = crc7(m_cid.data(), 15);
+
+        m_csd.fill(0);
+        const uint32_t blocks = m_image.blockCount();
+        if(m_cfg.highCapacity) {
+            // CSD v2: capacity is (C_SIZE + 1) * 512KB
+            const uint32_t cSize = (blocks >> 10) > 0 ? (blocks >> 10) - 1 : 0;
+            m_csd[0] = 0x40;
+            m_csd[7] = uint8_t((cSize >> 16) & 0x3F);
+            m_csd[8] = uint8_t(cSize >> 8);
+            m_csd[9] = uint8_t(cSize);
+        }
+        else {
+            // CSD v1 with C_SIZE_MULT = 7: capacity is (C_SIZE + 1) * 512 blocks
+            const uint32_t cSize = (blocks >> 9) > 0 ? (blocks >> 9) - 1 : 0;
+            m_csd[6]  = uint8_t((cSize >> 10) & 0x03);
+            m_csd[7]  = uint8_t(cSize >> 2);
+            m_csd[8]  = uint8_t((cSize & 0x03) << 6);
+            m_csd[9]  = 0x03;
+            m_csd[10] = 0x80;
+        }
+        m_csd[1]  = 0x0E;           // TAAC: 1ms
+        m_csd[3]  = m_highSpeed ? 0x5A : 0x32;    // TRAN_SPEED: 25MHz, 50MHz in High-Speed
+        m_csd[4]  = 0x5B;           // CCC: classes 0, 2, 4, 5, 7, 8, 10
+        m_csd[5]  = 0x59;           // READ_BL_LEN: 512
+        m_csd[10] |= (m_cfg.eraseBlocks ? 0x40 : 0x00) | 0x3F;    // ERASE_BLK_EN, SECTOR_SIZE: 128 blocks
+        m_csd[11] = 0x80;
+        m_csd[12] = 0x0A;           // R2W_FACTOR: 4, WRITE_BL_LEN: 512
+        m_csd[13] = 0x40;
+        m_csd[15] = crc7(m_csd.data(), 15);
+
+        // SCR: spec 3.0, 1 and 4 bit bus, erased blocks read as 0, CMD23 supported
+        m_scr = { 0x02, 0x05, 0x80, 0x02, 0x00, 0x00, 0x00, 0x00 };
+
+        // SD Status: speed class 10, UHS grade 1, 4MB AU, 1 AU per second with a 1 second offset
+        m_status.fill(0);
+        m_status[8]  = 0x04;        // SPEED_CLASS: class 10
+        m_status[10] = 0x90;        // AU_SIZE: 4MB
+        m_status[12] = 0x01;        // ERASE_SIZE: 1 AU
+        m_status[13] = 0x05;        // ERASE_TIMEOUT: 1s, ERASE_OFFSET: 1s
+        m_status[14] = 0x19;        // UHS_SPEED_GRADE: 10MB/s, UHS_AU_SIZE: 4MB
+    }
+
+    Image&      m_image;
+    CardConfig  m_cfg;
+    BusStats    m_stats;
+    std::chrono::steady_clock::time_point m_wallStart = std::chrono::steady_clock::now();
+
+    uint64_t    m_bytePs      = 0;
+    uint64_t    m_nowPs       = 0;
+    uint64_t    m_busyUntilPs = 0;
+    uint64_t    m_readyPs     = 0;
+
+    bool        m_selected    = false;
+    bool        m_idle        = true;
+    bool        m_appCmd      = false;
+    bool        m_crcOn       = false;
+    bool        m_multiWrite  = false;
+    bool        m_highSpeed   = false;
+    uint32_t    m_maxClockHz  = 25000000;
+    uint8_t     m_initPolls   = 0;
+    State       m_state       = State::IDLE;
+    uint32_t    m_lba         = 0;
+    uint32_t    m_eraseFirst  = 0;
+    uint32_t    m_eraseLast   = 0;
+    uint8_t     m_eraseSet    = 0;          //< bit 0: CMD32 received, bit 1: CMD33 received
+
+    std::array<uint8_t, 6>   m_cmd{};
+    size_t                   m_cmdLen = 0;
+    std::array<uint8_t, 514> m_rx{};
+    size_t                   m_rxLen  = 0;
+    const uint8_t*           m_reg    = nullptr;
+    size_t                   m_regLen = 0;
+    std::array<uint8_t, 16>  m_cid{};
+    std::array<uint8_t, 16>  m_csd{};
+    std::array<uint8_t, 8>   m_scr{};
+    std::array<uint8_t, 64>  m_status{};
+    std::array<uint8_t, 64>  m_switch{};
+    std::deque<uint8_t>      m_out;
+};
+
+}}  // namespace sd::sim
+
+#endif //SDCARD_SDSIMCARD_H
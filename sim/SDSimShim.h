@@ -0,0 +1,334 @@
+#ifndef SDCARD_SDSIMSHIM_H
+#define SDCARD_SDSIMSHIM_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SDSimCard.h"
+
+namespace sd { namespace sim {
+
+/**
+ * SPI shim that clocks bytes into a simulated card instead of a real bus. It fulfills the same
+ * select/deSelect/read/write contract as the hardware shims, so any sd::SpiCard can run against it:
+ *
+ *     sd::sim::Image image(65536);
+ *     sd::sim::CardModel model(image);
+ *     sd::SpiCard<sd::sim::SimShim, sd::ShiftedCRC, sd::defaultTimeouts> card(model);
+ */
+class SimShim {
+public:
+    explicit SimShim(CardModel& card) : m_card(&card) {}
+
+    bool active() { return m_card != nullptr; }
+    bool begin() { return active(); }
+
+    void select() { m_card->select(); }
+    void deSelect() { m_card->deSelect(); }
+    ssize_t write(const uint8_t* buf, const size_t LEN) {
+        for(size_t i = 0; i < LEN; ++i) { m_card->exchange(buf[i]); }
+        return LEN;
+    }
+    uint8_t write(uint8_t val) { return read(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) {
+        for(size_t i = 0; i < LEN; ++i) { buf[i] = m_card->exchange(0xFF); }
+        return LEN;
+    }
+    uint8_t read(uint8_t val = 0xFF) { return m_card->exchange(val); }
+
+protected:
+    CardModel* m_card;
+};
+
+/**
+ * SimShim with bulk polling: pollRead clocks a run of fill bytes in one call, so the driver scans for
+ * responses, tokens and the end of busy in chunks (see sd::detail::hasPollRead).
+ */
+class SimPollShim : public SimShim {
+public:
+    using SimShim::SimShim;
+
+    void pollRead(uint8_t* buf, const size_t LEN) { SimShim::read(buf, LEN); }
+};
+
+/**
+ * SimShim with clock control (see sd::detail::hasSetClock): setClock moves the simulated card to the requested
+ * clock, capped at what the host controller can do. SpiCard::begin() then runs identification at 400kHz and raises
+ * the clock to TRAN_SPEED, or to 50MHz after a CMD6 High-Speed switch.
+ */
+class SimClockShim : public SimShim {
+public:
+    explicit SimClockShim(CardModel& card, const uint32_t maxHz = 50000000) : SimShim(card), m_maxHz(maxHz) {}
+
+    uint32_t setClock(const uint32_t hz) {
+        m_card->setClockHz(hz < m_maxHz ? hz : m_maxHz);
+        return m_card->clockHz();
+    }
+
+private:
+    uint32_t m_maxHz;   //< fastest clock the host controller can produce
+};
+
+/// errors SimCRCShim and SimLinkShim inject into their transfers, and what they counted
+struct LinkFaults {
+    uint32_t every    = 0;      //< corrupt one byte of every n-th transfer of block data, 0 for none
+    uint32_t blocks   = 0;      //< transfers of block data seen
+    uint32_t injected = 0;      //< bytes corrupted so far
+    uint32_t queries  = 0;      //< link CRC checks, each a status query on the real adapter
+
+    /// index of the byte to corrupt in a transfer of LEN bytes, LEN if none. Only block data is hit, commands are
+    /// left alone so a corrupted command can not send the driver into a timeout
+    size_t corruptAt(const size_t LEN) {
+        if(every == 0 || LEN < 128 || ++blocks % every != 0) { return LEN; }
+        injected++;
+        return LEN / 2;
+    }
+};
+
+/**
+ * SimPollShim with a CRC unit (see sd::detail::hasCRCUnit), standing in for the CRC engine of an MCU's SPI or DMA
+ * peripheral: every byte written or read after crcStart() is hashed on the bus side, so with sd::PeripheralCRC the
+ * driver never hashes block data itself. LinkFaults corrupt bytes on the wire: after the unit hashed them on the way
+ * out, before it hashes them on the way in.
+ */
+class SimCRCShim : public SimPollShim {
+public:
+    explicit SimCRCShim(CardModel& card, LinkFaults* faults = nullptr) : SimPollShim(card), m_faults(faults) {}
+
+    void crcStart() { m_crc = 0; }
+    uint16_t crcRead() const { return m_crc; }
+
+    ssize_t write(const uint8_t* buf, const size_t LEN) {
+        const size_t bad = m_faults ? m_faults->corruptAt(LEN) : LEN;
+        for(size_t i = 0; i < LEN; ++i) {
+            m_crc = CardModel::crc16(buf + i, 1, m_crc);
+            m_card->exchange(i == bad ? uint8_t(buf[i] ^ 0x10) : buf[i]);
+        }
+        return LEN;
+    }
+    uint8_t write(const uint8_t val) { return read(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) {
+        const size_t bad = m_faults ? m_faults->corruptAt(LEN) : LEN;
+        for(size_t i = 0; i < LEN; ++i) { buf[i] = m_card->exchange(0xFF) ^ (i == bad ? 0x10 : 0); }
+        m_crc = CardModel::crc16(buf, LEN, m_crc);
+        return LEN;
+    }
+    uint8_t read(const uint8_t val = 0xFF) {
+        const uint8_t b = m_card->exchange(val);
+        m_crc = CardModel::crc16(&b, 1, m_crc);
+        return b;
+    }
+    void pollRead(uint8_t* buf, const size_t LEN) { read(buf, LEN); }
+
+private:
+    LinkFaults* m_faults;
+    uint16_t    m_crc = 0;
+};
+
+/**
+ * SimPollShim in front of a model of the SPIDriver's running CRC (see sd::detail::hasLinkCheck): the adapter hashes
+ * every byte it clocks, 64 MOSI bytes then the MISO bytes they clocked, and the host keeps its own copy of what it
+ * sent and received while linkCheckEnable(true). linkCheck() is the status query that compares the two. LinkFaults
+ * corrupt bytes on the host side of the adapter, the way a bad USB link would.
+ */
+class SimLinkShim : public SimPollShim {
+public:
+    explicit SimLinkShim(CardModel& card, LinkFaults* faults = nullptr) : SimPollShim(card), m_faults(faults) {}
+
+    bool linkCheck() {
+        if(m_faults) { m_faults->queries++; }
+        const bool ok = m_hostCrc && m_host == m_adapter;
+        m_host = m_adapter;
+        return ok;
+    }
+    void linkCheckEnable(const bool enable) {
+        if(enable && !m_hostCrc) { m_host = m_adapter; }
+        m_hostCrc = enable;
+    }
+
+    ssize_t write(const uint8_t* buf, const size_t LEN) {
+        const size_t bad = m_faults ? m_faults->corruptAt(LEN) : LEN;
+        for(size_t i = 0; i < LEN; ++i) {
+            const uint8_t b = i == bad ? uint8_t(buf[i] ^ 0x10) : buf[i];
+            m_card->exchange(b);
+            m_adapter = CardModel::crc16(&b, 1, m_adapter);
+        }
+        hostUpdate(buf, LEN);
+        return LEN;
+    }
+    uint8_t write(const uint8_t val) { return read(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) {
+        static constexpr uint8_t FILL[64] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                              0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                              0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                              0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                              0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                              0xFF, 0xFF, 0xFF, 0xFF };
+        const size_t bad = m_faults ? m_faults->corruptAt(LEN) : LEN;
+        for(size_t i = 0; i < LEN; i += 64) {
+            const size_t n = LEN - i < 64 ? LEN - i : 64;
+            m_adapter = CardModel::crc16(FILL, n, m_adapter);
+            for(size_t j = i; j < i + n; ++j) {
+                buf[j] = m_card->exchange(0xFF);
+                m_adapter = CardModel::crc16(buf + j, 1, m_adapter);
+                if(j == bad) { buf[j] ^= 0x10; }
+            }
+            hostUpdate(FILL, n);
+            hostUpdate(buf + i, n);
+        }
+        return LEN;
+    }
+    uint8_t read(const uint8_t val = 0xFF) {
+        const uint8_t b = m_card->exchange(val);
+        m_adapter = CardModel::crc16(&val, 1, m_adapter);
+        m_adapter = CardModel::crc16(&b, 1, m_adapter);
+        hostUpdate(&val, 1);
+        hostUpdate(&b, 1);
+        return b;
+    }
+    void pollRead(uint8_t* buf, const size_t LEN) { read(buf, LEN); }
+
+private:
+    void hostUpdate(const uint8_t* buf, const size_t LEN) {
+        if(m_hostCrc) { m_host = CardModel::crc16(buf, LEN, m_host); }
+    }
+
+    LinkFaults* m_faults;
+    uint16_t    m_adapter = 0xFFFF;     //< the adapter's CRC, read by the status query
+    uint16_t    m_host    = 0xFFFF;     //< the host's copy
+    bool        m_hostCrc = true;
+};
+
+/**
+ * Asynchronous variant of SimShim, standing in for a DMA engine: startRead/startWrite hand the buffer to a
+ * worker thread that clocks it through the card while the caller keeps running. This makes the shim satisfy
+ * sd::isAsyncShim, so SpiCard::readBlocksAsync/writeBlocksAsync can be exercised on the host.
+ * Synchronous calls wait for a pending transfer first, like a driver sharing the bus with its DMA channel.
+ */
+class SimAsyncShim : public SimShim {
+public:
+    explicit SimAsyncShim(CardModel& card) : SimShim(card), m_worker([this] { run(); }) {}
+    ~SimAsyncShim() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_one();
+        m_worker.join();
+    }
+    SimAsyncShim(const SimAsyncShim&) = delete;
+    SimAsyncShim& operator=(const SimAsyncShim&) = delete;
+
+    bool startRead(uint8_t* buf, const size_t LEN) { return start(buf, nullptr, LEN); }
+    bool startWrite(const uint8_t* buf, const size_t LEN) { return start(nullptr, buf, LEN); }
+    bool transferDone() const { return !m_pending.load(std::memory_order_acquire); }
+
+    void select() { waitIdle(); SimShim::select(); }
+    void deSelect() { waitIdle(); SimShim::deSelect(); }
+    ssize_t write(const uint8_t* buf, const size_t LEN) { waitIdle(); return SimShim::write(buf, LEN); }
+    uint8_t write(uint8_t val) { waitIdle(); return SimShim::write(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) { waitIdle(); return SimShim::read(buf, LEN); }
+    uint8_t read(uint8_t val = 0xFF) { waitIdle(); return SimShim::read(val); }
+
+private:
+    bool start(uint8_t* dst, const uint8_t* src, const size_t LEN) {
+        waitIdle();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dst = dst;
+            m_src = src;
+            m_len = LEN;
+            m_pending.store(true, std::memory_order_release);
+        }
+        m_wake.notify_one();
+        return true;
+    }
+
+    void waitIdle() const {
+        while(m_pending.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            m_wake.wait(lock, [this] { return m_quit || m_pending.load(std::memory_order_relaxed); });
+            if(m_quit) { return; }
+            if(m_dst) { SimShim::read(m_dst, m_len); }
+            else      { SimShim::write(m_src, m_len); }
+            m_pending.store(false, std::memory_order_release);
+        }
+    }
+
+    std::mutex              m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool>       m_pending{false};
+    bool                    m_quit = false;
+    uint8_t*                m_dst  = nullptr;
+    const uint8_t*          m_src  = nullptr;
+    size_t                  m_len  = 0;
+    std::thread             m_worker;       //< declared last so it starts after the state above
+};
+
+/**
+ * SPI controller with several chip selects for sd::SharedBus: every byte is clocked through all the simulated cards
+ * on the bus, so they share one clock and one bus time, and only the selected one answers. Chip selects past the
+ * cards are devices without a model (a sensor) that read back 0xFF. setMode only records the SPI mode; a card
+ * selected in any mode but 0 counts a mode error, like a card that would misread every bit.
+ */
+class SimBus {
+public:
+    explicit SimBus(std::vector<CardModel*> cards, const uint32_t maxHz = 50000000)
+        : m_cards(std::move(cards)), m_maxHz(maxHz) {}
+
+    bool active() { return !m_cards.empty(); }
+    bool begin() { return active(); }
+
+    void select(const uint8_t cs) {
+        if(cs >= m_cards.size()) { return; }
+        if(m_mode != 0) { m_modeErrors++; }
+        m_cards[cs]->select();
+    }
+    void deSelect(const uint8_t cs) {
+        if(cs < m_cards.size()) { m_cards[cs]->deSelect(); }
+    }
+    ssize_t write(const uint8_t* buf, const size_t LEN) {
+        for(size_t i = 0; i < LEN; ++i) { exchange(buf[i]); }
+        return LEN;
+    }
+    uint8_t write(uint8_t val) { return read(val); }
+    ssize_t read(uint8_t* buf, const size_t LEN) {
+        for(size_t i = 0; i < LEN; ++i) { buf[i] = exchange(0xFF); }
+        return LEN;
+    }
+    uint8_t read(uint8_t val = 0xFF) { return exchange(val); }
+    void pollRead(uint8_t* buf, const size_t LEN) { read(buf, LEN); }
+
+    uint32_t setClock(const uint32_t hz) {
+        const uint32_t clock = hz < m_maxHz ? hz : m_maxHz;
+        for(CardModel* card : m_cards) { card->setClockHz(clock); }
+        return clock;
+    }
+    void setMode(const uint8_t mode) { m_mode = mode; }
+
+    /// cards selected while the bus was not in mode 0
+    uint32_t modeErrors() const { return m_modeErrors; }
+
+private:
+    uint8_t exchange(const uint8_t mosi) {
+        uint8_t miso = 0xFF;
+        for(CardModel* card : m_cards) { miso &= card->exchange(mosi); }
+        return miso;
+    }
+
+    std::vector<CardModel*> m_cards;
+    uint32_t                m_maxHz;
+    uint32_t                m_modeErrors = 0;
+    uint8_t                 m_mode       = 0;
+};
+
+}}  // namespace sd::sim
+
+#endif //SDCARD_SDSIMSHIM_H
@@ -0,0 +1,152 @@
+#ifndef SDCARD_SDSPIDRIVEREMU_H
+#define SDCARD_SDSPIDRIVEREMU_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "SDSimCard.h"
+
+namespace sd { namespace sim {
+
+/// counters kept by SpiDriverEmulator
+struct EmulatorStats {
+    uint64_t bytesIn     = 0;   //< protocol bytes received from the host
+    uint64_t bytesOut    = 0;   //< protocol bytes sent back
+    uint64_t transfers   = 0;   //< 0x80 and 0xC0 transfer commands
+    uint64_t spiBytes    = 0;   //< bytes clocked through the card
+    uint32_t selects     = 0;
+    uint32_t statusReads = 0;   //< '?' commands
+    uint32_t echoes      = 0;   //< 'e' commands
+    uint32_t unknown     = 0;   //< bytes that are not a command, ignored
+};
+
+/**
+ * The serial protocol of the SPIDriver USB adapter in front of a CardModel, so the host driver in
+ * external/spiDriver can be run end to end without hardware. feed() takes what the host wrote to the
+ * serial port and appends the adapter's replies:
+ *
+ *   '@'          reset, ignored
+ *   'e' c        echo c
+ *   '?'          80 byte status line with the running CCITT CRC
+ *   's' / 'u'    select / unselect the card
+ *   'a' v, 'b' v set the A and B lines
+ *   0xC0 + n-1   write the n bytes that follow (n <= 64)
+ *   0x80 + n-1   write the n bytes that follow, reply with the n bytes read back
+ *
+ * Like the firmware, the CRC runs over the MOSI bytes of every transfer chunk followed by its MISO bytes
+ * (for 0x80), so spi_getstatus can check the host's copy against it.
+ */
+class SpiDriverEmulator {
+public:
+    explicit SpiDriverEmulator(CardModel& card) : m_card(&card) {}
+
+    /**
+     * Run the commands in the host's bytes.
+     * @param in [in] bytes written by the host
+     * @param len [in] number of bytes in in
+     * @param out [out] replies are appended here
+     * @return bytes consumed. A command split across calls is left unconsumed, pass it again with more bytes
+     */
+    size_t feed(const uint8_t* in, size_t len, std::vector<uint8_t>& out);
+
+    uint16_t crc() const { return m_crc; }
+    const EmulatorStats& stats() const { return m_stats; }
+
+private:
+    void crcUpdate(const uint8_t* data, size_t n) {
+        while(n--) {
+            m_crc ^= static_cast<uint16_t>(*data++ << 8);
+            for(int b = 0; b < 8; ++b) {
+                m_crc = static_cast<uint16_t>((m_crc & 0x8000) ? (m_crc << 1) ^ 0x1021 : (m_crc << 1));
+            }
+        }
+    }
+    void status(std::vector<uint8_t>& out);
+
+    CardModel*    m_card;
+    uint16_t      m_crc = 0xFFFF;
+    uint8_t       m_a   = 1;
+    uint8_t       m_b   = 1;
+    uint8_t       m_cs  = 1;
+    EmulatorStats m_stats;
+};
+
+inline size_t SpiDriverEmulator::feed(const uint8_t* in, const size_t len, std::vector<uint8_t>& out)
+{
+    const size_t before = out.size();
+    size_t pos = 0;
+    while(pos < len) {
+        const uint8_t c = in[pos];
+        size_t need = 1;
+        if(c == 'e' || c == 'a' || c == 'b') { need = 2; }
+        else if(c >= 0x80)                    { need = 1 + (c & 0x3F) + 1; }
+        if(len - pos < need) { break; }
+
+        const uint8_t* arg = in + pos + 1;
+        switch(c) {
+            case '@':
+                break;
+            case 'e':
+                out.push_back(arg[0]);
+                m_stats.echoes++;
+                break;
+            case '?':
+                status(out);
+                m_stats.statusReads++;
+                break;
+            case 's':
+                m_card->select();
+                m_cs = 0;
+                m_stats.selects++;
+                break;
+            case 'u':
+                m_card->deSelect();
+                m_cs = 1;
+                break;
+            case 'a': m_a = arg[0] & 1; break;
+            case 'b': m_b = arg[0] & 1; break;
+            default:
+                if(c >= 0x80) {
+                    const size_t n = need - 1;
+                    crcUpdate(arg, n);
+                    if(c >= 0xC0) {
+                        for(size_t i = 0; i < n; ++i) { m_card->exchange(arg[i]); }
+                    }
+                    else {
+                        uint8_t miso[64];
+                        for(size_t i = 0; i < n; ++i) { miso[i] = m_card->exchange(arg[i]); }
+                        crcUpdate(miso, n);
+                        out.insert(out.end(), miso, miso + n);
+                    }
+                    m_stats.transfers++;
+                    m_stats.spiBytes += n;
+                }
+                else {
+                    m_stats.unknown++;
+                }
+                break;
+        }
+        pos += need;
+    }
+    m_stats.bytesIn  += pos;
+    m_stats.bytesOut += out.size() - before;
+    return pos;
+}
+
+inline void SpiDriverEmulator::status(std::vector<uint8_t>& out)
+{
+    // same layout as the firmware: model, serial, uptime, volts, mA, temperature, A, B, CS, CRC
+    char line[81];
+    const unsigned long uptime = static_cast<unsigned long>(m_card->nowPs() / 1000000000000ULL);
+    std::snprintf(line, sizeof(line), "[spidriver1 EMU00001 %09lu 5.000 000 25.0 %u %u %u %04x ]", uptime, m_a, m_b,
+                  m_cs, m_crc);
+    const size_t n = std::strlen(line);
+    out.insert(out.end(), line, line + n);
+    out.insert(out.end(), 80 - n, ' ');
+}
+
+}}  // namespace sd::sim
+
+#endif //SDCARD_SDSPIDRIVEREMU_H
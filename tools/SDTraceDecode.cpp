@@ -0,0 +1,305 @@
+/**
+ * Offline decoder for traces recorded by the sd::SDTrace policy.
+ *
+ *     SDTraceDecode trace.bin            timeline followed by a summary
+ *     SDTraceDecode --summary trace.bin  summary only
+ *
+ * The timeline shows one line per command with its response and the time until the response, data tokens and
+ * payload, busy waits and driver operations (indented by nesting). Times are relative to the first event and
+ * unwrap the 32 bit tick counter, so events must be less than one counter period apart.
+ */
+
+#include <array>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "SDTrace.h"
+
+namespace {
+
+const char* commandName(const uint8_t cmd, const bool app)
+{
+    if(app) {
+        switch(cmd) {
+            case 6:  return "SET_BUS_WIDTH";
+            case 13: return "SD_STATUS";
+            case 22: return "SEND_NUM_WR_BLOCKS";
+            case 23: return "SET_WR_BLK_ERASE_COUNT";
+            case 41: return "SD_SEND_OP_COND";
+            default: return "";
+        }
+    }
+    switch(cmd) {
+        case 0:  return "GO_IDLE_STATE";
+        case 6:  return "SWITCH_FUNC";
+        case 8:  return "SEND_IF_COND";
+        case 9:  return "SEND_CSD";
+        case 10: return "SEND_CID";
+        case 12: return "STOP_TRANSMISSION";
+        case 13: return "SEND_STATUS";
+        case 16: return "SET_BLOCKLEN";
+        case 17: return "READ_SINGLE_BLOCK";
+        case 18: return "READ_MULTIPLE_BLOCK";
+        case 24: return "WRITE_BLOCK";
+        case 25: return "WRITE_MULTIPLE_BLOCK";
+        case 32: return "ERASE_WR_BLK_START";
+        case 33: return "ERASE_WR_BLK_END";
+        case 38: return "ERASE";
+        case 55: return "APP_CMD";
+        case 58: return "READ_OCR";
+        case 59: return "CRC_ON_OFF";
+        default: return "";
+    }
+}
+
+const char* operationName(const uint8_t op)
+{
+    static const char* const names[] = { "init", "read", "write", "readStream", "writeStream", "register", "erase" };
+    return op < sizeof(names) / sizeof(names[0]) ? names[op] : "?";
+}
+
+const char* tokenName(const uint8_t token)
+{
+    switch(token) {
+        case 0xFE: return "start block";
+        case 0xFF: return "none";
+        default:   return (token & 0xF0) == 0 ? "error token" : "unexpected";
+    }
+}
+
+struct Summary {
+    uint64_t commands     = 0;
+    uint64_t errorR1      = 0;
+    uint64_t dataTokens   = 0;
+    uint64_t errorTokens  = 0;
+    uint64_t bytesRead    = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t busyWaits    = 0;
+    double   busyUs       = 0;
+    double   maxBusyUs    = 0;
+    uint64_t busyFailed   = 0;
+    uint64_t crcErrors    = 0;
+    uint64_t retries      = 0;
+    uint64_t timeouts     = 0;
+    uint64_t lost         = 0;
+    std::array<uint64_t, 64> perCommand{};
+    std::array<uint64_t, 64> perAppCommand{};
+    std::array<uint64_t, static_cast<size_t>(sd::Operation::COUNT)> ops{};
+    std::array<double, static_cast<size_t>(sd::Operation::COUNT)>   opUs{};
+};
+
+class Decoder {
+public:
+    Decoder(const sd::TraceFileHeader& header, const bool timeline)
+        : m_usPerTick(1e6 * header.tickNum / header.tickDen), m_timeline(timeline) {}
+
+    void event(const sd::TraceEvent& e);
+    void summary() const;
+
+private:
+    double usOf(const uint64_t ticks) const { return ticks * m_usPerTick; }
+    /// event time in us since the first event, unwrapping the 32 bit counter
+    double unwrap(uint32_t time);
+    void line(double t, const char* fmt, ...) const __attribute__((format(printf, 3, 4)));
+
+    double   m_usPerTick;
+    bool     m_timeline;
+    bool     m_started  = false;
+    uint32_t m_last     = 0;
+    uint64_t m_ticks    = 0;
+    int      m_depth    = 0;
+
+    // a command is printed once its response arrives
+    bool     m_haveCmd  = false;
+    sd::TraceEvent m_cmd{};
+    double   m_cmdTime  = 0;
+
+    std::array<double, static_cast<size_t>(sd::Operation::COUNT)> m_opStart{};
+    Summary  m_sum;
+};
+
+double Decoder::unwrap(const uint32_t time)
+{
+    if(!m_started) {
+        m_started = true;
+        m_last    = time;
+    }
+    m_ticks += static_cast<uint32_t>(time - m_last);
+    m_last   = time;
+    return usOf(m_ticks);
+}
+
+void Decoder::line(const double t, const char* fmt, ...) const
+{
+    if(!m_timeline) { return; }
+    std::printf("%12.1f  %*s", t, m_depth * 2, "");
+    va_list args;
+    va_start(args, fmt);
+    std::vprintf(fmt, args);
+    va_end(args);
+    std::printf("\n");
+}
+
+void Decoder::event(const sd::TraceEvent& e)
+{
+    const auto type = static_cast<sd::TraceType>(e.type);
+    if(type == sd::TraceType::LOST) {
+        // LOST markers carry no time, the next event restarts the clock
+        m_sum.lost += e.arg;
+        m_started   = false;
+        m_haveCmd   = false;
+        if(m_timeline) { std::printf("%12s  --- %" PRIu32 " events lost ---\n", "", e.arg); }
+        return;
+    }
+
+    const double t   = unwrap(e.time);
+    const bool   app = e.flags & sd::TRACE_APP;
+    if(m_haveCmd && type == sd::TraceType::COMMAND && app && m_cmd.code == 55) {
+        // CMD55 goes out in one write with the application command, its R1 is not read
+        line(m_cmdTime, "CMD55 %-22s arg=0x%08" PRIX32, commandName(55, false), m_cmd.arg);
+        m_haveCmd = false;
+    }
+    if(m_haveCmd && type != sd::TraceType::RESPONSE) {
+        line(m_cmdTime, "%sCMD%-2u %-22s arg=0x%08" PRIX32 "  (no response)", (m_cmd.flags & sd::TRACE_APP) ? "A" : "",
+             m_cmd.code, commandName(m_cmd.code, m_cmd.flags & sd::TRACE_APP), m_cmd.arg);
+        m_haveCmd = false;
+    }
+
+    switch(type) {
+        case sd::TraceType::COMMAND:
+            m_sum.commands++;
+            (app ? m_sum.perAppCommand : m_sum.perCommand)[e.code & 0x3F]++;
+            m_haveCmd = true;
+            m_cmd     = e;
+            m_cmdTime = t;
+            break;
+        case sd::TraceType::RESPONSE:
+            if(e.value & 0xFE) { m_sum.errorR1++; }
+            if(m_haveCmd && m_cmd.code == e.code) {
+                line(m_cmdTime, "%sCMD%-2u %-22s arg=0x%08" PRIX32 "  R1=0x%02X  +%.1fus", app ? "A" : "", e.code,
+                     commandName(e.code, app), m_cmd.arg, e.value, t - m_cmdTime);
+            }
+            else {
+                line(t, "%sCMD%-2u response R1=0x%02X", app ? "A" : "", e.code, e.value);
+            }
+            m_haveCmd = false;
+            break;
+        case sd::TraceType::DATA_TOKEN:
+            m_sum.dataTokens++;
+            if(e.value != 0xFE && e.value != 0xFF) { m_sum.errorTokens++; }
+            line(t, "token 0x%02X (%s)", e.value, tokenName(e.value));
+            break;
+        case sd::TraceType::DATA:
+            ((e.flags & sd::TRACE_WRITE) ? m_sum.bytesWritten : m_sum.bytesRead) += e.arg;
+            line(t, "%s %" PRIu32 " bytes", (e.flags & sd::TRACE_WRITE) ? "wrote" : "read", e.arg);
+            break;
+        case sd::TraceType::BUSY: {
+            const double us = usOf(e.arg);
+            m_sum.busyWaits++;
+            m_sum.busyUs += us;
+            if(us > m_sum.maxBusyUs) { m_sum.maxBusyUs = us; }
+            if(e.flags & sd::TRACE_FAILED) { m_sum.busyFailed++; }
+            line(t, "busy %.1fus%s", us, (e.flags & sd::TRACE_FAILED) ? " TIMED OUT" : "");
+            break;
+        }
+        case sd::TraceType::CRC_ERROR:
+            m_sum.crcErrors++;
+            line(t, "CRC ERROR");
+            break;
+        case sd::TraceType::RETRY:
+            m_sum.retries++;
+            line(t, "retry");
+            break;
+        case sd::TraceType::TIMEOUT:
+            m_sum.timeouts++;
+            line(t, "TIMEOUT");
+            break;
+        case sd::TraceType::OP_BEGIN:
+            if(e.code < m_opStart.size()) { m_opStart[e.code] = t; }
+            line(t, "%s {", operationName(e.code));
+            m_depth++;
+            break;
+        case sd::TraceType::OP_END:
+            if(m_depth > 0) { m_depth--; }
+            if(e.code < m_opStart.size()) {
+                m_sum.ops[e.code]++;
+                m_sum.opUs[e.code] += t - m_opStart[e.code];
+                line(t, "} %s %.1fus", operationName(e.code), t - m_opStart[e.code]);
+            }
+            break;
+        default:
+            line(t, "unknown event type %u", e.type);
+            break;
+    }
+}
+
+void Decoder::summary() const
+{
+    std::printf("\nsummary over %.1fus\n", usOf(m_ticks));
+    std::printf("  commands      %" PRIu64 " (%" PRIu64 " error responses)\n", m_sum.commands, m_sum.errorR1);
+    for(size_t i = 0; i < 64; ++i) {
+        if(m_sum.perCommand[i])    { std::printf("    CMD%-2zu  %-22s %" PRIu64 "\n", i, commandName(i, false), m_sum.perCommand[i]); }
+        if(m_sum.perAppCommand[i]) { std::printf("    ACMD%-2zu %-22s %" PRIu64 "\n", i, commandName(i, true), m_sum.perAppCommand[i]); }
+    }
+    std::printf("  data tokens   %" PRIu64 " (%" PRIu64 " error tokens)\n", m_sum.dataTokens, m_sum.errorTokens);
+    std::printf("  bytes         %" PRIu64 " read, %" PRIu64 " written\n", m_sum.bytesRead, m_sum.bytesWritten);
+    std::printf("  busy waits    %" PRIu64 ", %.1fus total, %.1fus max, %" PRIu64 " timed out\n", m_sum.busyWaits,
+                m_sum.busyUs, m_sum.maxBusyUs, m_sum.busyFailed);
+    std::printf("  crc errors    %" PRIu64 "\n", m_sum.crcErrors);
+    std::printf("  retries       %" PRIu64 "\n", m_sum.retries);
+    std::printf("  timeouts      %" PRIu64 "\n", m_sum.timeouts);
+    for(size_t i = 0; i < m_sum.ops.size(); ++i) {
+        if(m_sum.ops[i]) {
+            std::printf("  %-13s %" PRIu64 " calls, mean %.1fus\n", operationName(static_cast<uint8_t>(i)), m_sum.ops[i],
+                        m_sum.opUs[i] / m_sum.ops[i]);
+        }
+    }
+    if(m_sum.lost) { std::printf("  LOST          %" PRIu64 " events (buffer overwritten before it was drained)\n", m_sum.lost); }
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    bool timeline = true;
+    const char* path = nullptr;
+    for(int i = 1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "--summary")) { timeline = false; }
+        else { path = argv[i]; }
+    }
+    if(!path) {
+        std::fprintf(stderr, "usage: %s [--summary] trace.bin\n", argv[0]);
+        return 1;
+    }
+
+    std::FILE* file = std::fopen(path, "rb");
+    if(!file) {
+        std::perror(path);
+        return 1;
+    }
+
+    sd::TraceFileHeader header;
+    if(std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, "SDTR", 4) != 0) {
+        std::fprintf(stderr, "%s: not an SD trace file\n", path);
+        std::fclose(file);
+        return 1;
+    }
+    if(header.version != 1 || header.eventSize != sizeof(sd::TraceEvent) || header.tickDen == 0) {
+        std::fprintf(stderr, "%s: unsupported trace version %u (event size %u)\n", path, header.version, header.eventSize);
+        std::fclose(file);
+        return 1;
+    }
+
+    Decoder decoder(header, timeline);
+    std::array<sd::TraceEvent, 256> chunk;
+    size_t n;
+    while((n = std::fread(chunk.data(), sizeof(sd::TraceEvent), chunk.size(), file)) > 0) {
+        for(size_t i = 0; i < n; ++i) { decoder.event(chunk[i]); }
+    }
+    std::fclose(file);
+
+    decoder.summary();
+    return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * SPIDriver emulator on a pseudo-terminal, with a simulated SD card behind it. Runs the real host path
+ * (main.cpp -> SPIShim -> spidriver.c -> serial port) without the adapter:
+ *
+ *     SPIDriverEmu --link /tmp/spidriver &
+ *     SDCardTest /tmp/spidriver
+ *
+ *     --image FILE     back the card with a raw image file instead of RAM
+ *     --blocks N       card size in 512 byte blocks (default 65536)
+ *     --clock HZ       SPI clock the card's bus time is counted against
+ *     --baud N         limit the serial link to N baud, 10 bits per byte (default: unlimited)
+ *     --latency US     delay every reply by US microseconds, like the USB latency timer (default: 0)
+ *     --link PATH      also make the pty reachable as PATH
+ *
+ * The pty name is printed on the first line of stdout. The emulator runs until SIGINT or SIGTERM and then
+ * prints what the host made it do on stderr. The card's clock follows the wall clock between bursts, so busy
+ * periods end while the host is waiting for replies, as they do on hardware.
+ *
+ * The real adapter at 460800 baud with the FTDI latency timer in low-latency mode is roughly
+ * --baud 460800 --latency 1000.
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "SDSpiDriverEmu.h"
+
+namespace {
+
+volatile sig_atomic_t g_stop = 0;
+
+void onSignal(int) { g_stop = 1; }
+
+struct Options {
+    const char* image   = nullptr;
+    const char* link    = nullptr;
+    uint32_t    blocks  = 65536;
+    uint32_t    clockHz = 0;
+    uint32_t    baud    = 0;
+    uint32_t    latency = 0;
+};
+
+bool parse(const int argc, char* argv[], Options& opt)
+{
+    for(int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if(!v) { return false; }
+        if(!std::strcmp(a, "--image"))        { opt.image   = v; }
+        else if(!std::strcmp(a, "--link"))    { opt.link    = v; }
+        else if(!std::strcmp(a, "--blocks"))  { opt.blocks  = static_cast<uint32_t>(std::strtoul(v, nullptr, 0)); }
+        else if(!std::strcmp(a, "--clock"))   { opt.clockHz = static_cast<uint32_t>(std::strtoul(v, nullptr, 0)); }
+        else if(!std::strcmp(a, "--baud"))    { opt.baud    = static_cast<uint32_t>(std::strtoul(v, nullptr, 0)); }
+        else if(!std::strcmp(a, "--latency")) { opt.latency = static_cast<uint32_t>(std::strtoul(v, nullptr, 0)); }
+        else { return false; }
+        ++i;
+    }
+    return true;
+}
+
+/// open a raw pty pair. The slave stays open here too, so the master never sees a hangup between clients
+bool openPty(int& master, int& slave, const char*& name)
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::perror("pty");
+        return false;
+    }
+    name  = ptsname(master);
+    slave = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+    if(slave < 0) {
+        std::perror("pty slave");
+        return false;
+    }
+    termios t;
+    tcgetattr(slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+    return true;
+}
+
+bool writeAll(const int fd, const uint8_t* data, size_t len)
+{
+    while(len > 0) {
+        const ssize_t n = write(fd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) { continue; }
+            std::perror("write");
+            return false;
+        }
+        data += n;
+        len  -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if(!parse(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--image FILE] [--blocks N] [--clock HZ] [--baud N] [--latency US] "
+                             "[--link PATH]\n", argv[0]);
+        return 1;
+    }
+
+    std::unique_ptr<sd::sim::Image> image = opt.image ? std::make_unique<sd::sim::Image>(opt.image, opt.blocks)
+                                                      : std::make_unique<sd::sim::Image>(opt.blocks);
+    if(!image->valid()) {
+        std::fprintf(stderr, "%s: cannot open image\n", opt.image ? opt.image : "RAM");
+        return 1;
+    }
+    sd::sim::CardConfig cfg;
+    if(opt.clockHz) { cfg.clockHz = opt.clockHz; }
+    sd::sim::CardModel card(*image, cfg);
+    sd::sim::SpiDriverEmulator emu(card);
+
+    int master, slave;
+    const char* name;
+    if(!openPty(master, slave, name)) { return 1; }
+    if(opt.link) {
+        unlink(opt.link);
+        if(symlink(name, opt.link) != 0) {
+            std::perror(opt.link);
+            return 1;
+        }
+    }
+    std::printf("%s\n", name);
+    std::fflush(stdout);
+
+    struct sigaction sa{};
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<uint8_t> pending;
+    std::vector<uint8_t> reply;
+    uint8_t buf[4096];
+    uint64_t bursts = 0;
+    Clock::time_point lineFree = Clock::now();
+    Clock::time_point last     = lineFree;
+
+    while(!g_stop) {
+        pollfd p{ master, POLLIN, 0 };
+        const int r = poll(&p, 1, 200);
+        if(r < 0 && errno != EINTR) {
+            std::perror("poll");
+            break;
+        }
+        if(r <= 0) { continue; }
+
+        const ssize_t n = read(master, buf, sizeof(buf));
+        if(n <= 0) {
+            if(n < 0 && errno != EINTR && errno != EAGAIN) {
+                std::perror("read");
+                break;
+            }
+            continue;
+        }
+        // a real card keeps programming while the host is away, so wall time between bursts passes on the card too
+        const Clock::time_point now = Clock::now();
+        const auto away = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        card.elapse(static_cast<uint64_t>(away) * 1000);
+        last = now;
+
+        pending.insert(pending.end(), buf, buf + n);
+        reply.clear();
+        pending.erase(pending.begin(), pending.begin() + emu.feed(pending.data(), pending.size(), reply));
+
+        // the UART is full duplex: a burst takes as long as the longer direction, and the reply leaves once
+        // the USB latency has passed
+        if(opt.baud) {
+            const size_t bytes = std::max(static_cast<size_t>(n), reply.size());
+            lineFree = std::max(lineFree, Clock::now()) + std::chrono::microseconds(bytes * 10000000ULL / opt.baud);
+        }
+        if(reply.empty()) { continue; }
+        bursts++;
+        if(opt.latency) { std::this_thread::sleep_for(std::chrono::microseconds(opt.latency)); }
+        if(opt.baud) { std::this_thread::sleep_until(lineFree); }
+        if(!writeAll(master, reply.data(), reply.size())) { break; }
+    }
+
+    const auto& s = emu.stats();
+    std::fprintf(stderr, "SPIDriverEmu: %" PRIu64 " bytes in, %" PRIu64 " bytes out in %" PRIu64 " replies\n",
+                 s.bytesIn, s.bytesOut, bursts);
+    std::fprintf(stderr, "  %" PRIu64 " transfers, %" PRIu64 " SPI bytes, %u selects, %u status reads, %u echoes, "
+                         "%u unknown bytes\n", s.transfers, s.spiBytes, s.selects, s.statusReads, s.echoes, s.unknown);
+    const auto& bus = card.stats();
+    std::fprintf(stderr, "  card: %u commands, %u blocks read, %u blocks written, %u CRC errors, %.3fs bus time\n",
+                 bus.commands, bus.blocksRead, bus.blocksWritten, bus.crcErrors, bus.busPs * 1e-12);
+
+    if(opt.link) { unlink(opt.link); }
+    close(slave);
+    close(master);
+    return 0;
+}